@@ -0,0 +1,648 @@
+#include "allocation_profile.hpp"
+
+#if defined( ALLOCATION_PROFILE )
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Demangle/Demangle.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/FormatVariadic.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <link.h>
+
+#include "arguments_parse.hpp"
+#include "trace.hpp"
+
+// Frames walked to find call site in c_extra code
+constexpr int g_allocationBacktraceDepth = 16;
+// Distinct frames of executable classified, rest are looked up every time
+constexpr size_t g_allocationFrameLimit = 16384;
+// Distinct call sites counted, allocations of rest are not attributed
+constexpr size_t g_allocationCallSiteLimit = 16384;
+// Slots probed for call site before it is given up
+constexpr size_t g_allocationCallSiteProbeLimit = 64;
+// Call sites reported by --profile detailed
+constexpr size_t g_reportedAllocationCallSiteCount = 20;
+
+// In allocationHandler order
+static constexpr const char* g_allocationHandlerNames[] = {
+    "none",
+    "iterate_struct_union",
+    "iterate_enum",
+    "iterate_arguments",
+    "iterate_scope",
+    "generate_soa",
+    "generate_serializers",
+};
+
+static_assert( ( sizeof( g_allocationHandlerNames ) /
+                 sizeof( *g_allocationHandlerNames ) ) ==
+                   static_cast< size_t >( allocationHandler::count ),
+               "Every allocation handler needs name" );
+
+struct AllocationCounter {
+    std::atomic< uint64_t > count = 0;
+    std::atomic< uint64_t > bytes = 0;
+};
+
+struct AllocationCallSite {
+    // Return address in c_extra code, 0 if slot is free
+    std::atomic< uintptr_t > address = 0;
+    AllocationCounter counter;
+};
+
+enum class allocationFrameKind : uint8_t {
+    unknown,
+    cExtra,
+    // LLVM, Clang and standard library are linked statically
+    library,
+};
+
+struct AllocationFrame {
+    // Return address in executable, 0 if slot is free
+    std::atomic< uintptr_t > address = 0;
+    std::atomic< allocationFrameKind > kind = allocationFrameKind::unknown;
+};
+
+static std::atomic< bool > g_isAllocationTracked = false;
+static std::atomic< uint8_t > g_allocationPhase =
+    static_cast< uint8_t >( phase::count );
+static thread_local allocationHandler g_allocationHandler =
+    allocationHandler::none;
+// Set while allocation is counted, so allocations of counting are not
+static thread_local bool g_isCountingAllocation = false;
+
+// Last one is outside of phases
+static AllocationCounter
+    g_phaseAllocations[ static_cast< size_t >( phase::count ) + 1 ];
+static AllocationCounter
+    g_handlerAllocations[ static_cast< size_t >( allocationHandler::count ) ];
+static AllocationCallSite g_allocationCallSites[ g_allocationCallSiteLimit ];
+static AllocationFrame g_allocationFrames[ g_allocationFrameLimit ];
+// Outside of c_extra code or over call site limit
+static AllocationCounter g_unattributedAllocations;
+
+// Executable code of c_extra, [ begin, end )
+static uintptr_t g_executableBegin = 0;
+static uintptr_t g_executableEnd = 0;
+// For addr2line, executable may be position independent
+static uintptr_t g_executableLoadAddress = 0;
+
+// NOTE: Functions called by allocation functions are not traced, tracing
+// allocates
+
+static void addAllocation( AllocationCounter& _counter, const size_t _size ) {
+    _counter.count.fetch_add( 1, std::memory_order_relaxed );
+    _counter.bytes.fetch_add( _size, std::memory_order_relaxed );
+}
+
+static void addAllocationCallSite( const uintptr_t _address,
+                                   const size_t _size ) {
+    if ( !_address ) {
+        addAllocation( g_unattributedAllocations, _size );
+
+        return;
+    }
+
+    // Fibonacci hashing, return addresses are aligned poorly
+    size_t l_slotIndex = static_cast< size_t >(
+        ( static_cast< uint64_t >( _address ) * 0x9E3779B97F4A7C15ULL ) %
+        g_allocationCallSiteLimit );
+
+    for ( size_t l_probeIndex = 0;
+          l_probeIndex < g_allocationCallSiteProbeLimit; l_probeIndex++ ) {
+        AllocationCallSite& l_callSite = g_allocationCallSites[ l_slotIndex ];
+        uintptr_t l_address =
+            l_callSite.address.load( std::memory_order_relaxed );
+
+        if ( ( !l_address ) &&
+             ( l_callSite.address.compare_exchange_strong(
+                 l_address, _address, std::memory_order_relaxed ) ) ) {
+            l_address = _address;
+        }
+
+        if ( l_address == _address ) {
+            addAllocation( l_callSite.counter, _size );
+
+            return;
+        }
+
+        l_slotIndex = ( ( l_slotIndex + 1 ) % g_allocationCallSiteLimit );
+    }
+
+    addAllocation( g_unattributedAllocations, _size );
+}
+
+// Mangled names in llvm::, clang:: or std::, rest (C functions, static
+// functions, main) is c_extra code
+static auto isLibrarySymbol( const char* _name ) -> bool {
+    if ( ( _name[ 0 ] != '_' ) || ( _name[ 1 ] != 'Z' ) ) {
+        return ( false );
+    }
+
+    const char* l_name = ( _name + 2 );
+
+    // Nested name, optionally qualified member function
+    if ( *l_name == 'N' ) {
+        l_name++;
+
+        while ( llvm::StringRef( "rVKRO" ).contains( *l_name ) ) {
+            l_name++;
+        }
+    }
+
+    // St, Sa, Ss, ... are std:: abbreviations
+    return ( ( *l_name == 'S' ) ||
+             ( llvm::StringRef( l_name ).starts_with( "4llvm" ) ) ||
+             ( llvm::StringRef( l_name ).starts_with( "5clang" ) ) );
+}
+
+static auto classifyAllocationFrame( const uintptr_t _address )
+    -> allocationFrameKind {
+    Dl_info l_information;
+
+    // Return address, call is before it
+    if ( ( dladdr( reinterpret_cast< void* >( _address - 1 ),
+                   &l_information ) ) &&
+         ( l_information.dli_sname ) &&
+         ( isLibrarySymbol( l_information.dli_sname ) ) ) {
+        return ( allocationFrameKind::library );
+    }
+
+    return ( allocationFrameKind::cExtra );
+}
+
+// Cached, dladdr is too slow for every allocation
+static auto isCextraFrame( const uintptr_t _address ) -> bool {
+    size_t l_slotIndex = static_cast< size_t >(
+        ( static_cast< uint64_t >( _address ) * 0x9E3779B97F4A7C15ULL ) %
+        g_allocationFrameLimit );
+
+    for ( size_t l_probeIndex = 0;
+          l_probeIndex < g_allocationCallSiteProbeLimit; l_probeIndex++ ) {
+        AllocationFrame& l_frame = g_allocationFrames[ l_slotIndex ];
+        uintptr_t l_address = l_frame.address.load( std::memory_order_acquire );
+
+        if ( ( !l_address ) &&
+             ( l_frame.address.compare_exchange_strong(
+                 l_address, _address, std::memory_order_acq_rel ) ) ) {
+            l_address = _address;
+        }
+
+        if ( l_address == _address ) {
+            allocationFrameKind l_kind =
+                l_frame.kind.load( std::memory_order_relaxed );
+
+            // Other thread may classify it at the same time, same result
+            if ( l_kind == allocationFrameKind::unknown ) {
+                l_kind = classifyAllocationFrame( _address );
+
+                l_frame.kind.store( l_kind, std::memory_order_relaxed );
+            }
+
+            return ( l_kind == allocationFrameKind::cExtra );
+        }
+
+        l_slotIndex = ( ( l_slotIndex + 1 ) % g_allocationFrameLimit );
+    }
+
+    return ( classifyAllocationFrame( _address ) ==
+             allocationFrameKind::cExtra );
+}
+
+// Not inlined, so frames to skip are known
+__attribute__( ( noinline ) ) static void countAllocation(
+    const size_t _size ) {
+    if ( ( !g_isAllocationTracked.load( std::memory_order_relaxed ) ) ||
+         ( g_isCountingAllocation ) ) {
+        return;
+    }
+
+    g_isCountingAllocation = true;
+
+    addAllocation( g_phaseAllocations[ g_allocationPhase.load(
+                       std::memory_order_relaxed ) ],
+                   _size );
+    addAllocation(
+        g_handlerAllocations[ static_cast< size_t >( g_allocationHandler ) ],
+        _size );
+
+    {
+        void* l_frames[ g_allocationBacktraceDepth ];
+        const int l_frameCount =
+            backtrace( l_frames, g_allocationBacktraceDepth );
+        uintptr_t l_callSite = 0;
+
+        // 0 - here, 1 - allocation function.
+        // Frames of shared libraries (libstdc++ std::string growth) and
+        // of statically linked LLVM, Clang and standard library templates
+        // are skipped up to first caller in c_extra code.
+        for ( int l_frameIndex = 2; l_frameIndex < l_frameCount;
+              l_frameIndex++ ) {
+            const uintptr_t l_address =
+                reinterpret_cast< uintptr_t >( l_frames[ l_frameIndex ] );
+
+            if ( ( l_address >= g_executableBegin ) &&
+                 ( l_address < g_executableEnd ) &&
+                 ( isCextraFrame( l_address ) ) ) {
+                l_callSite = l_address;
+
+                break;
+            }
+        }
+
+        addAllocationCallSite( l_callSite, _size );
+    }
+
+    g_isCountingAllocation = false;
+}
+
+#if defined( __GLIBC__ )
+
+// Not interposed by definitions below
+extern "C" {
+void* __libc_malloc( size_t _size );
+void* __libc_calloc( size_t _count, size_t _size );
+void* __libc_realloc( void* _memory, size_t _size );
+}
+
+static auto allocate( const size_t _size ) -> void* {
+    return ( __libc_malloc( _size ) );
+}
+
+extern "C" auto malloc( size_t _size ) noexcept -> void* {
+    countAllocation( _size );
+
+    return ( __libc_malloc( _size ) );
+}
+
+extern "C" auto calloc( size_t _count, size_t _size ) noexcept -> void* {
+    countAllocation( _count * _size );
+
+    return ( __libc_calloc( _count, _size ) );
+}
+
+extern "C" auto realloc( void* _memory, size_t _size ) noexcept -> void* {
+    countAllocation( _size );
+
+    return ( __libc_realloc( _memory, _size ) );
+}
+
+#else
+
+static auto allocate( const size_t _size ) -> void* {
+    return ( std::malloc( _size ) );
+}
+
+#endif
+
+static auto allocateAligned( const size_t _size, const std::align_val_t _align )
+    -> void* {
+    void* l_memory = nullptr;
+
+    if ( posix_memalign( &l_memory,
+                         std::max( static_cast< size_t >( _align ),
+                                   sizeof( void* ) ),
+                         ( ( _size ) ? ( _size ) : ( 1 ) ) ) ) {
+        l_memory = nullptr;
+    }
+
+    return ( l_memory );
+}
+
+auto operator new( size_t _size ) -> void* {
+    countAllocation( _size );
+
+    void* l_memory = allocate( ( _size ) ? ( _size ) : ( 1 ) );
+
+    if ( !l_memory ) {
+        llvm::report_bad_alloc_error( "Allocation failed" );
+    }
+
+    return ( l_memory );
+}
+
+auto operator new[]( size_t _size ) -> void* {
+    countAllocation( _size );
+
+    void* l_memory = allocate( ( _size ) ? ( _size ) : ( 1 ) );
+
+    if ( !l_memory ) {
+        llvm::report_bad_alloc_error( "Allocation failed" );
+    }
+
+    return ( l_memory );
+}
+
+auto operator new( size_t _size, const std::nothrow_t& ) noexcept -> void* {
+    countAllocation( _size );
+
+    return ( allocate( ( _size ) ? ( _size ) : ( 1 ) ) );
+}
+
+auto operator new[]( size_t _size, const std::nothrow_t& ) noexcept -> void* {
+    countAllocation( _size );
+
+    return ( allocate( ( _size ) ? ( _size ) : ( 1 ) ) );
+}
+
+auto operator new( size_t _size, std::align_val_t _align ) -> void* {
+    countAllocation( _size );
+
+    void* l_memory = allocateAligned( _size, _align );
+
+    if ( !l_memory ) {
+        llvm::report_bad_alloc_error( "Allocation failed" );
+    }
+
+    return ( l_memory );
+}
+
+auto operator new[]( size_t _size, std::align_val_t _align ) -> void* {
+    countAllocation( _size );
+
+    void* l_memory = allocateAligned( _size, _align );
+
+    if ( !l_memory ) {
+        llvm::report_bad_alloc_error( "Allocation failed" );
+    }
+
+    return ( l_memory );
+}
+
+auto operator new( size_t _size,
+                   std::align_val_t _align,
+                   const std::nothrow_t& ) noexcept -> void* {
+    countAllocation( _size );
+
+    return ( allocateAligned( _size, _align ) );
+}
+
+auto operator new[]( size_t _size,
+                     std::align_val_t _align,
+                     const std::nothrow_t& ) noexcept -> void* {
+    countAllocation( _size );
+
+    return ( allocateAligned( _size, _align ) );
+}
+
+// Every allocation function above allocates with malloc, exceptions are
+// disabled like in LLVM
+
+void operator delete( void* _memory ) noexcept {
+    std::free( _memory );
+}
+
+void operator delete[]( void* _memory ) noexcept {
+    std::free( _memory );
+}
+
+void operator delete( void* _memory, size_t ) noexcept {
+    std::free( _memory );
+}
+
+void operator delete[]( void* _memory, size_t ) noexcept {
+    std::free( _memory );
+}
+
+void operator delete( void* _memory, std::align_val_t ) noexcept {
+    std::free( _memory );
+}
+
+void operator delete[]( void* _memory, std::align_val_t ) noexcept {
+    std::free( _memory );
+}
+
+void operator delete( void* _memory, size_t, std::align_val_t ) noexcept {
+    std::free( _memory );
+}
+
+void operator delete[]( void* _memory, size_t, std::align_val_t ) noexcept {
+    std::free( _memory );
+}
+
+AllocationHandlerScope::AllocationHandlerScope(
+    const allocationHandler _handler )
+    : _previousHandler( g_allocationHandler ) {
+    g_allocationHandler = _handler;
+}
+
+AllocationHandlerScope::~AllocationHandlerScope() {
+    g_allocationHandler = _previousHandler;
+}
+
+// Called for executable first
+static auto findExecutableCode( struct dl_phdr_info* _information,
+                                size_t,
+                                void* ) -> int {
+    traceEnter();
+
+    g_executableLoadAddress = _information->dlpi_addr;
+
+    for ( size_t l_segmentIndex = 0;
+          l_segmentIndex < _information->dlpi_phnum; l_segmentIndex++ ) {
+        const ElfW( Phdr )& l_segment =
+            _information->dlpi_phdr[ l_segmentIndex ];
+
+        if ( ( l_segment.p_type != PT_LOAD ) ||
+             ( !( l_segment.p_flags & PF_X ) ) ) {
+            continue;
+        }
+
+        const uintptr_t l_begin =
+            ( _information->dlpi_addr + l_segment.p_vaddr );
+        const uintptr_t l_end = ( l_begin + l_segment.p_memsz );
+
+        if ( ( !g_executableBegin ) || ( l_begin < g_executableBegin ) ) {
+            g_executableBegin = l_begin;
+        }
+
+        g_executableEnd = std::max( g_executableEnd, l_end );
+    }
+
+    traceExit();
+
+    // Stop
+    return ( 1 );
+}
+
+void startAllocationTracking() {
+    traceEnter();
+
+    if ( g_profileLevel == profileLevel::none ) {
+        goto EXIT;
+    }
+
+    dl_iterate_phdr( findExecutableCode, nullptr );
+
+    // Unwinder is loaded on first backtrace, not from inside of allocation
+    {
+        void* l_frame = nullptr;
+
+        backtrace( &l_frame, 1 );
+    }
+
+    g_isAllocationTracked = true;
+
+EXIT:
+    traceExit();
+}
+
+void setAllocationPhase( const phase _phase ) {
+    traceEnter();
+
+    g_allocationPhase.store( static_cast< uint8_t >( _phase ),
+                             std::memory_order_relaxed );
+
+    traceExit();
+}
+
+// function+offset, executable+offset if it has no symbol
+static auto describeCallSite( const uintptr_t _address ) -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    Dl_info l_information;
+
+    // Return address, call is before it
+    if ( ( dladdr( reinterpret_cast< void* >( _address - 1 ),
+                   &l_information ) ) &&
+         ( l_information.dli_sname ) ) {
+        l_returnValue =
+            llvm::formatv( "{0}+{1:x}",
+                           llvm::demangle( l_information.dli_sname ),
+                           ( _address - reinterpret_cast< uintptr_t >(
+                                            l_information.dli_saddr ) ) )
+                .str();
+
+    } else {
+        l_returnValue = llvm::formatv( "c_extra+{0:x}",
+                                       ( _address - g_executableLoadAddress ) )
+                            .str();
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+static void writeAllocationRow( llvm::raw_ostream& _stream,
+                                const llvm::StringRef _name,
+                                const AllocationCounter& _counter ) {
+    traceEnter();
+
+    _stream << llvm::formatv(
+        "{0,-22}{1,14}{2,18}\n", _name,
+        _counter.count.load( std::memory_order_relaxed ),
+        _counter.bytes.load( std::memory_order_relaxed ) );
+
+    traceExit();
+}
+
+void writeAllocationProfile( llvm::raw_ostream& _stream ) {
+    traceEnter();
+
+    // Report itself is not counted
+    g_isAllocationTracked = false;
+
+    _stream << "\n"
+            << llvm::formatv( "{0,-22}{1,14}{2,18}\n", "PHASE", "ALLOCATIONS",
+                              "BYTES" );
+
+    for ( size_t l_phaseIndex = 0;
+          l_phaseIndex <= static_cast< size_t >( phase::count );
+          l_phaseIndex++ ) {
+        const AllocationCounter& l_counter =
+            g_phaseAllocations[ l_phaseIndex ];
+
+        if ( !l_counter.count.load( std::memory_order_relaxed ) ) {
+            continue;
+        }
+
+        writeAllocationRow(
+            _stream,
+            ( ( l_phaseIndex < static_cast< size_t >( phase::count ) )
+                  ? ( getPhaseName( static_cast< phase >( l_phaseIndex ) ) )
+                  : ( "other" ) ),
+            l_counter );
+    }
+
+    _stream << "\n"
+            << llvm::formatv( "{0,-22}{1,14}{2,18}\n", "HANDLER",
+                              "ALLOCATIONS", "BYTES" );
+
+    for ( size_t l_handlerIndex = 0;
+          l_handlerIndex < static_cast< size_t >( allocationHandler::count );
+          l_handlerIndex++ ) {
+        writeAllocationRow( _stream, g_allocationHandlerNames[ l_handlerIndex ],
+                            g_handlerAllocations[ l_handlerIndex ] );
+    }
+
+    if ( g_profileLevel == profileLevel::detailed ) {
+        std::vector< const AllocationCallSite* > l_callSites;
+
+        for ( const AllocationCallSite& l_callSite : g_allocationCallSites ) {
+            if ( l_callSite.address.load( std::memory_order_relaxed ) ) {
+                l_callSites.push_back( &l_callSite );
+            }
+        }
+
+        const size_t l_reportedCount =
+            std::min( l_callSites.size(), g_reportedAllocationCallSiteCount );
+
+        // Most allocations first
+        std::partial_sort(
+            l_callSites.begin(), ( l_callSites.begin() + l_reportedCount ),
+            l_callSites.end(),
+            []( const AllocationCallSite* _left,
+                const AllocationCallSite* _right ) {
+                return (
+                    _left->counter.count.load( std::memory_order_relaxed ) >
+                    _right->counter.count.load( std::memory_order_relaxed ) );
+            } );
+
+        _stream << "\n"
+                << llvm::formatv( "{0,14}{1,18}  {2}\n", "ALLOCATIONS",
+                                  "BYTES", "CALL SITE" );
+
+        for ( size_t l_callSiteIndex = 0; l_callSiteIndex < l_reportedCount;
+              l_callSiteIndex++ ) {
+            const AllocationCallSite& l_callSite =
+                *( l_callSites[ l_callSiteIndex ] );
+
+            _stream << llvm::formatv(
+                "{0,14}{1,18}  {2}\n",
+                l_callSite.counter.count.load( std::memory_order_relaxed ),
+                l_callSite.counter.bytes.load( std::memory_order_relaxed ),
+                describeCallSite(
+                    l_callSite.address.load( std::memory_order_relaxed ) ) );
+        }
+
+        _stream << llvm::formatv(
+            "{0,14}{1,18}  {2}\n",
+            g_unattributedAllocations.count.load( std::memory_order_relaxed ),
+            g_unattributedAllocations.bytes.load( std::memory_order_relaxed ),
+            "(outside of c_extra code)" );
+    }
+
+    traceExit();
+}
+
+#else
+
+void startAllocationTracking() {}
+
+void setAllocationPhase( const phase ) {}
+
+void writeAllocationProfile( llvm::raw_ostream& ) {}
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdint>
+
+#include "statistics.hpp"
+
+// Heap allocations (operator new, malloc/ calloc/ realloc) are counted per
+// phase, handler and call site in builds with ALLOCATION_PROFILE, see
+// C_EXTRA_ALLOCATION_PROFILE, and reported by --profile.
+// Other builds do not replace allocation functions, tracking does nothing.
+
+// Handler allocating thread runs
+enum class allocationHandler : uint8_t {
+    none,
+    iterateStructUnion,
+    iterateEnum,
+    iterateArguments,
+    iterateScope,
+    generateSoa,
+    generateSerializers,
+    count,
+};
+
+#if defined( ALLOCATION_PROFILE )
+
+// Allocations of calling thread go to _handler until end of scope
+class AllocationHandlerScope {
+public:
+    AllocationHandlerScope( const allocationHandler _handler );
+    ~AllocationHandlerScope();
+
+private:
+    // Deferred expansion runs inside of other handler
+    allocationHandler _previousHandler;
+};
+
+#define trackAllocations( _handler )                       \
+    const AllocationHandlerScope l_allocationHandlerScope( \
+        allocationHandler::_handler )
+
+#else
+
+#define trackAllocations( _handler ) \
+    do {                             \
+    } while ( 0 )
+
+#endif
+
+// Does nothing unless requested by arguments.
+// Called before any thread is started.
+void startAllocationTracking();
+
+// Allocations of every thread go to _phase, phase::count is outside of phases
+void setAllocationPhase( const phase _phase );
+
+// Per phase/ handler, top call sites for --profile detailed
+void writeAllocationProfile( llvm::raw_ostream& _stream );
@@ -2,6 +2,9 @@
 
 #include <argp.h>
 
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <string>
 
 #include "trace.hpp"
@@ -19,6 +22,17 @@ const std::vector< std::string > g_defaultIncludes = {
 std::vector< std::string > g_sources;
 std::string g_prefix = ".";
 std::string g_extension;
+std::string g_layoutReportFilePath;
+std::string g_layoutReorderFilePath;
+unsigned g_flattenDepth = 0;
+std::string g_expansionCacheFilePath;
+unsigned g_outlineThreshold = 0;
+unsigned g_jobCount = 1;
+std::string g_bundleFilePath;
+std::vector< std::string > g_intrinsicMacros;
+std::string g_logFilePath;
+std::string g_statisticsFilePath;
+std::string g_profileFilePath;
 
 // Flags
 bool g_isVerboseRun = false;
@@ -31,6 +45,21 @@ bool g_needDefaultSystemIncludePaths = true;
 bool g_needWarningsAsErrors = false;
 bool g_isCheckOnly = false;
 bool g_needTrace = false;
+bool g_needResolvedLayout = false;
+bool g_needDumpAst = false;
+bool g_needDumpTokens = false;
+bool g_needInternalDump = false;
+bool g_isIncrementalRun = false;
+bool g_isWatchRun = false;
+bool g_needDepfile = false;
+bool g_needSemanticDependencies = false;
+bool g_needNoinlineOutlined = false;
+bool g_needSkipFunctionBodies = false;
+
+typedCallbacks g_typedCallbacks = typedCallbacks::none;
+passthroughMode g_passthroughMode = passthroughMode::none;
+logFormat g_logFormat = logFormat::text;
+profileLevel g_profileLevel = profileLevel::none;
 
 constexpr const char* g_applicationIdentifier = "c_extra";
 constexpr const char* g_applicationVersion = "0.0";
@@ -39,6 +68,9 @@ constexpr const char* g_applicationDescription =
     "Clang/GNU-compatible C code.";
 constexpr const char* g_applicationContactAddress = "<lurkydismal@duck.com>";
 
+// Threads started per translation unit
+constexpr unsigned long g_jobCountLimit = 1024;
+
 const char* argp_program_version;
 const char* argp_program_bug_address;
 
@@ -60,8 +92,69 @@ enum class parserOption : int16_t {
     warningsAsErrors = 'W',
     checkOnly = 'c',
     trace = 1004,
+    resolveLayout = 1005,
+    layoutReport = 1006,
+    layoutReorder = 1007,
+    typedCallbacks = 1008,
+    flattenDepth = 1009,
+    dumpAst = 1010,
+    dumpTokens = 1011,
+    internalDump = 1012,
+    incremental = 1013,
+    depfile = 1014,
+    semanticDependencies = 1015,
+    expansionCache = 1016,
+    outline = 1017,
+    outlineNoinline = 1018,
+    bundle = 1019,
+    passthrough = 1020,
+    intrinsicMacro = 1021,
+    skipFunctionBodies = 1022,
+    jobs = 'j',
+    logFormat = 1023,
+    logFile = 1024,
+    statistics = 1025,
+    profile = 1026,
+    profileOutput = 1027,
+    watch = 1028,
 };
 
+// Decimal without sign, up to _maximum
+static auto parseCount( const char* _value,
+                        const unsigned long _maximum,
+                        unsigned& _count ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    // strtoul accepts and negates sign
+    if ( ( *_value < '0' ) || ( *_value > '9' ) ) {
+        goto EXIT;
+    }
+
+    {
+        char* l_end = nullptr;
+
+        errno = 0;
+
+        const unsigned long l_count = strtoul( _value, &l_end, 10 );
+
+        if ( ( *l_end != '\0' ) || ( errno == ERANGE ) ||
+             ( l_count > _maximum ) ) {
+            goto EXIT;
+        }
+
+        _count = l_count;
+    }
+
+    l_returnValue = true;
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
 static auto parserForOption( int _key, char* _value, struct argp_state* _state )
     -> error_t {
     traceEnter();
@@ -176,6 +269,213 @@ static auto parserForOption( int _key, char* _value, struct argp_state* _state )
             break;
         }
 
+        case ( int )parserOption::resolveLayout: {
+            g_needResolvedLayout = true;
+
+            break;
+        }
+
+        case ( int )parserOption::layoutReport: {
+            g_layoutReportFilePath = _value;
+
+            break;
+        }
+
+        case ( int )parserOption::layoutReorder: {
+            g_layoutReorderFilePath = _value;
+
+            break;
+        }
+
+        case ( int )parserOption::typedCallbacks: {
+            const std::string l_mode = _value;
+
+            if ( l_mode == "none" ) {
+                g_typedCallbacks = typedCallbacks::none;
+
+            } else if ( l_mode == "id" ) {
+                g_typedCallbacks = typedCallbacks::typeId;
+
+            } else if ( l_mode == "suffix" ) {
+                g_typedCallbacks = typedCallbacks::suffix;
+
+            } else {
+                argp_error( _state, "Unknown typed callbacks mode: '%s'.",
+                            _value );
+            }
+
+            break;
+        }
+
+        case ( int )parserOption::flattenDepth: {
+            if ( !parseCount( _value, UINT_MAX, g_flattenDepth ) ) {
+                argp_error( _state, "Invalid flatten depth: '%s'.", _value );
+            }
+
+            break;
+        }
+
+        case ( int )parserOption::outline: {
+            if ( !parseCount( _value, UINT_MAX, g_outlineThreshold ) ) {
+                argp_error( _state, "Invalid outline threshold: '%s'.",
+                            _value );
+            }
+
+            break;
+        }
+
+        case ( int )parserOption::outlineNoinline: {
+            g_needNoinlineOutlined = true;
+
+            break;
+        }
+
+        case ( int )parserOption::jobs: {
+            if ( ( !parseCount( _value, g_jobCountLimit, g_jobCount ) ) ||
+                 ( !g_jobCount ) ) {
+                argp_error( _state, "Invalid job count: '%s'.", _value );
+            }
+
+            break;
+        }
+
+        case ( int )parserOption::skipFunctionBodies: {
+            g_needSkipFunctionBodies = true;
+
+            break;
+        }
+
+        case ( int )parserOption::dumpAst: {
+            g_needDumpAst = true;
+
+            break;
+        }
+
+        case ( int )parserOption::dumpTokens: {
+            g_needDumpTokens = true;
+
+            break;
+        }
+
+        case ( int )parserOption::internalDump: {
+            g_needDumpAst = true;
+            g_needInternalDump = true;
+
+            break;
+        }
+
+        case ( int )parserOption::incremental: {
+            g_isIncrementalRun = true;
+
+            break;
+        }
+
+        case ( int )parserOption::watch: {
+            g_isWatchRun = true;
+
+            break;
+        }
+
+        case ( int )parserOption::depfile: {
+            g_needDepfile = true;
+
+            break;
+        }
+
+        case ( int )parserOption::semanticDependencies: {
+            g_needSemanticDependencies = true;
+
+            break;
+        }
+
+        case ( int )parserOption::expansionCache: {
+            g_expansionCacheFilePath = _value;
+
+            break;
+        }
+
+        case ( int )parserOption::bundle: {
+            g_bundleFilePath = _value;
+
+            break;
+        }
+
+        case ( int )parserOption::passthrough: {
+            const std::string l_mode = _value;
+
+            if ( l_mode == "copy" ) {
+                g_passthroughMode = passthroughMode::copy;
+
+            } else if ( l_mode == "link" ) {
+                g_passthroughMode = passthroughMode::link;
+
+            } else if ( l_mode == "skip" ) {
+                g_passthroughMode = passthroughMode::skip;
+
+            } else {
+                argp_error( _state, "Unknown passthrough mode: '%s'.",
+                            _value );
+            }
+
+            break;
+        }
+
+        case ( int )parserOption::logFormat: {
+            const std::string l_mode = _value;
+
+            if ( l_mode == "text" ) {
+                g_logFormat = logFormat::text;
+
+            } else if ( l_mode == "json" ) {
+                g_logFormat = logFormat::json;
+
+            } else {
+                argp_error( _state, "Unknown log format: '%s'.", _value );
+            }
+
+            break;
+        }
+
+        case ( int )parserOption::logFile: {
+            g_logFilePath = _value;
+
+            break;
+        }
+
+        case ( int )parserOption::statistics: {
+            g_statisticsFilePath = _value;
+
+            break;
+        }
+
+        case ( int )parserOption::profile: {
+            const std::string l_level = _value;
+
+            if ( l_level == "summary" ) {
+                g_profileLevel = profileLevel::summary;
+
+            } else if ( l_level == "detailed" ) {
+                g_profileLevel = profileLevel::detailed;
+
+            } else {
+                argp_error( _state, "Unknown profile level: '%s'.", _value );
+            }
+
+            break;
+        }
+
+        case ( int )parserOption::profileOutput: {
+            g_profileFilePath = _value;
+
+            break;
+        }
+
+        case ( int )parserOption::intrinsicMacro: {
+            g_intrinsicMacros.emplace_back( _value );
+
+            break;
+        }
+
         case ARGP_KEY_ARG: {
             if ( _value ) {
                 g_sources.emplace_back( _value );
@@ -185,10 +485,61 @@ static auto parserForOption( int _key, char* _value, struct argp_state* _state )
         }
 
         case ARGP_KEY_END: {
-            if ( g_sources.empty() ) {
+            // Inputs of incremental run are read from standard input
+            if ( ( g_sources.empty() ) && ( !g_isIncrementalRun ) ) {
                 argp_error( _state, "No input(s) provided." );
             }
 
+            if ( ( g_isIncrementalRun ) && ( g_isWatchRun ) ) {
+                argp_error( _state,
+                            "Incremental and watch run can not be combined." );
+            }
+
+            // Session never ends to write it
+            if ( ( ( g_isIncrementalRun ) || ( g_isWatchRun ) ) &&
+                 ( !g_bundleFilePath.empty() ) ) {
+                argp_error( _state, "Bundle can not be written by incremental "
+                                    "or watch run." );
+            }
+
+            // Uses of renamed names in skipped bodies would keep original
+            // spelling
+            if ( ( !g_bundleFilePath.empty() ) &&
+                 ( g_needSkipFunctionBodies ) ) {
+                argp_error( _state,
+                            "Function bodies can not be skipped by bundle "
+                            "run." );
+            }
+
+            // Reparsed translation unit is built without consumer
+            if ( ( ( g_isIncrementalRun ) || ( g_isWatchRun ) ) &&
+                 ( g_needSkipFunctionBodies ) ) {
+                argp_error( _state, "Function bodies can not be skipped by "
+                                    "incremental or watch run." );
+            }
+
+            // Protocol lines are written to standard output
+            if ( ( ( g_isIncrementalRun ) || ( g_isWatchRun ) ) &&
+                 ( g_needOnlyPrintResult ) ) {
+                argp_error( _state, "Result can not be written to standard "
+                                    "output by incremental or watch run." );
+            }
+
+            // Rewritten input would change again
+            if ( ( g_isWatchRun ) && ( g_needEditInPlace ) ) {
+                argp_error( _state, "Watch run can not edit in place." );
+            }
+
+            // Passed through inputs are never parsed
+            if ( ( g_passthroughMode != passthroughMode::none ) &&
+                 ( ( g_isIncrementalRun ) || ( g_isWatchRun ) ||
+                   ( g_isCheckOnly ) || ( !g_bundleFilePath.empty() ) ||
+                   ( g_needDumpAst ) || ( g_needDumpTokens ) ) ) {
+                argp_error( _state,
+                            "Passthrough can not be used with incremental, "
+                            "watch, check only, bundle or dump run." );
+            }
+
             // Only append default include paths if default system include paths
             // will not be added
             if ( g_needDefaultIncludePaths &&
@@ -258,6 +609,42 @@ auto parseArguments( int _argumentCount, char** _argumentVector ) -> bool {
                   "Do not include helpers header file before input", 1 },
                 { "stdout", ( int )parserOption::printResult, nullptr, 0,
                   "Write result to standard output", 1 },
+                { "incremental", ( int )parserOption::incremental, nullptr, 0,
+                  "Keep running, read input file per line from standard input "
+                  "and process it again reusing previous parse",
+                  1 },
+                { "watch", ( int )parserOption::watch, nullptr, 0,
+                  "Keep running, process input again reusing previous parse "
+                  "once it or file it includes is saved (Linux only)",
+                  1 },
+                { "depfile", ( int )parserOption::depfile, nullptr, 0,
+                  "Write Makefile/ Ninja depfile next to generated file (e.g. "
+                  "filename.c.d)",
+                  1 },
+                { "semantic-deps", ( int )parserOption::semanticDependencies,
+                  nullptr, 0,
+                  "Write declarations used by generated file with their "
+                  "hashes next to it (e.g. filename.c.sdeps)",
+                  1 },
+                { "expansion-cache", ( int )parserOption::expansionCache,
+                  "FILE", 0,
+                  "Reuse expansions of unchanged declarations from FILE and "
+                  "store new ones to it",
+                  1 },
+                { "passthrough", ( int )parserOption::passthrough, "MODE", 0,
+                  "Copy (reflink if supported), hard link or skip inputs "
+                  "mentioning no intrinsic without parsing them (copy, link, "
+                  "skip)",
+                  1 },
+                { "intrinsic-macro", ( int )parserOption::intrinsicMacro,
+                  "NAME", 0,
+                  "Macro expanding to intrinsic call, inputs/ function bodies "
+                  "mentioning it are not passed through/ skipped",
+                  1 },
+                { "bundle", ( int )parserOption::bundle, "FILE", 0,
+                  "Write every generated file into one unity build FILE, "
+                  "renaming colliding internal names",
+                  1 },
                 // TODO: Implement
                 { "enable-feature", 'f', "NAME", 0,
                   "Enable a specific custom syntax/ feature", 2 },
@@ -282,23 +669,78 @@ auto parseArguments( int _argumentCount, char** _argumentVector ) -> bool {
                 { "no-warnings", 0, nullptr, 0, "Suppress warnings", 2 },
                 { "check-only", ( int )parserOption::checkOnly, nullptr, 0,
                   "Parse and validate without generating output", 2 },
-                // TODO: Implement
-                { "dump-ast", 0, nullptr, 0, "Output parsed AST for debugging",
+                { "resolve-layout", ( int )parserOption::resolveLayout, nullptr,
+                  0,
+                  "Emit field offsets/ sizes as integer literals resolved from "
+                  "record layout",
                   2 },
-                // TODO: Implement
-                { "dump-tokens", 0, nullptr, 0,
+                { "layout-report", ( int )parserOption::layoutReport, "FILE", 0,
+                  "Write padding/ cache line report of iterated records", 2 },
+                { "layout-reorder", ( int )parserOption::layoutReorder, "FILE",
+                  0,
+                  "Write iterated record definitions reordered to minimize "
+                  "size",
+                  2 },
+                { "typed-callbacks", ( int )parserOption::typedCallbacks,
+                  "MODE", 0,
+                  "Pass field/ variable type to callbacks as type identifier "
+                  "or callback name suffix (none, id, suffix)",
+                  2 },
+                { "flatten-depth", ( int )parserOption::flattenDepth, "DEPTH",
+                  0,
+                  "Expand nested records and fixed-size arrays of iterated "
+                  "records up to DEPTH levels",
+                  2 },
+                { "outline", ( int )parserOption::outline, "CALLS", 0,
+                  "Share one expansion function per type and callback between "
+                  "calls expanding to at least CALLS callback calls",
+                  2 },
+                { "outline-noinline", ( int )parserOption::outlineNoinline,
+                  nullptr, 0,
+                  "Mark shared expansion functions noinline instead of inline",
+                  2 },
+                { "jobs", ( int )parserOption::jobs, "JOBS", 0,
+                  "Run handlers of translation unit on JOBS threads, each "
+                  "matching contiguous part of main file; threads take tokens "
+                  "of make/ Ninja jobserver from MAKEFLAGS if there is one",
+                  2 },
+                { "skip-function-bodies",
+                  ( int )parserOption::skipFunctionBodies, nullptr, 0,
+                  "Do not parse function bodies mentioning no intrinsic or "
+                  "intrinsic macro, errors in them are not reported",
+                  2 },
+                { "dump-ast", ( int )parserOption::dumpAst, nullptr, 0,
+                  "Output parsed AST for debugging", 2 },
+                { "dump-tokens", ( int )parserOption::dumpTokens, nullptr, 0,
                   "Output token stream before/ after transformation", 2 },
                 { "trace", ( int )parserOption::trace, nullptr, 0,
                   "Trace processing steps", 3 },
-                // TODO: Implement
-                { "profile", 0, "LEVEL", 0,
-                  "Print timing/ performance info (summary, detailed, flame)",
+                { "stats", ( int )parserOption::statistics, "FILE", 0,
+                  "Write counters of matches, expansions, bytes and cache "
+                  "behaviour with per input times as JSON to FILE ('-' for "
+                  "standard output)",
                   3 },
-                // TODO: Implement
-                { "profile-output", 0, "FILE", 0, "Path to profile output file",
+                { "log-format", ( int )parserOption::logFormat, "FORMAT", 0,
+                  "Write log lines as text or JSON objects, one per line "
+                  "(text, json)",
                   3 },
-                // TODO: Implement
-                { "internal-dump", 0, nullptr, 0,
+                { "log-file", ( int )parserOption::logFile, "FILE", 0,
+                  "Append every log line to FILE instead of standard "
+                  "output/ error",
+                  3 },
+                { "profile", ( int )parserOption::profile, "LEVEL", 0,
+                  "Print time of every phase, summed up or per input with "
+                  "hardware counters (summary, detailed); allocations per "
+                  "phase/ handler/ call site if built with "
+                  "C_EXTRA_ALLOCATION_PROFILE",
+                  3 },
+                { "profile-output", ( int )parserOption::profileOutput, "FILE",
+                  0,
+                  "Write profile to FILE ('-' for standard output) instead of "
+                  "standard error",
+                  3 },
+                { "internal-dump", ( int )parserOption::internalDump, nullptr,
+                  0,
                   "Dump raw internal LLVM/ Clang structures (for dev only)",
                   3 },
                 { nullptr, 0, nullptr, 0, nullptr, 0 } };
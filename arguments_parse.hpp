@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -9,6 +10,17 @@ extern std::vector< std::string > g_compileArguments;
 extern std::vector< std::string > g_sources;
 extern std::string g_prefix;
 extern std::string g_extension;
+extern std::string g_layoutReportFilePath;
+extern std::string g_layoutReorderFilePath;
+extern unsigned g_flattenDepth;
+extern std::string g_expansionCacheFilePath;
+extern unsigned g_outlineThreshold;
+extern unsigned g_jobCount;
+extern std::string g_bundleFilePath;
+extern std::vector< std::string > g_intrinsicMacros;
+extern std::string g_logFilePath;
+extern std::string g_statisticsFilePath;
+extern std::string g_profileFilePath;
 
 // Flags
 extern bool g_isVerboseRun;
@@ -21,5 +33,64 @@ extern bool g_needDefaultSystemIncludePaths;
 extern bool g_needWarningsAsErrors;
 extern bool g_isCheckOnly;
 extern bool g_needTrace;
+extern bool g_needResolvedLayout;
+extern bool g_needDumpAst;
+extern bool g_needDumpTokens;
+extern bool g_needInternalDump;
+extern bool g_isIncrementalRun;
+extern bool g_isWatchRun;
+extern bool g_needDepfile;
+extern bool g_needSemanticDependencies;
+extern bool g_needNoinlineOutlined;
+extern bool g_needSkipFunctionBodies;
+
+// How field/ variable type is passed to callbacks
+enum class typedCallbacks : uint8_t {
+    // "typeName"
+    none,
+    // typeId
+    typeId,
+    // callbackName_typeIdName( "fieldName", "typeName", ... )
+    suffix,
+};
+
+extern typedCallbacks g_typedCallbacks;
+
+// What is done with inputs mentioning no intrinsic, see prescan
+enum class passthroughMode : uint8_t {
+    // Parsed like every input
+    none,
+    // Copied to output path, reflinked if file system supports it
+    copy,
+    // Hard linked to output path, copied if not possible
+    link,
+    // Not written
+    skip,
+};
+
+extern passthroughMode g_passthroughMode;
+
+// How log lines are written, see writeLog
+enum class logFormat : uint8_t {
+    // "LEVEL: message"
+    text,
+    // {"level":"...","thread":0,"function":"...","file":"...","line":0,
+    // "message":"..."}
+    json,
+};
+
+extern logFormat g_logFormat;
+
+// What --profile prints, see writeProfile
+enum class profileLevel : uint8_t {
+    none,
+    // Time of every phase summed up over inputs
+    summary,
+    // Per input too, with cycles/ instructions/ cache misses/ page faults/
+    // context switches
+    detailed,
+};
+
+extern profileLevel g_profileLevel;
 
 auto parseArguments( int _argumentCount, char** _argumentVector ) -> bool;
@@ -0,0 +1,712 @@
+#include "bundle.hpp"
+
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Lex/Lexer.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "arguments_parse.hpp"
+#include "cextra_frontend.hpp"
+#include "log.hpp"
+#include "parallel_match.hpp"
+#include "statistics.hpp"
+#include "top_level_declarations.hpp"
+#include "trace.hpp"
+
+// Declared at file scope by input itself, renamed when other input declares
+// it too
+struct BundledName {
+    std::string name;
+    // Struct/ union/ enum tag
+    bool isTag = false;
+    // Inserted by handler, see addBundledHelper
+    bool isHelper = false;
+};
+
+// Identifier of rewritten text naming BundledName
+struct BundledNameUse {
+    // End of identifier, renaming suffix is written there
+    size_t offset = 0;
+    size_t nameIndex = 0;
+};
+
+struct BundledInput {
+    std::string filePath;
+    std::string text;
+    std::vector< BundledName > names;
+    // By offset
+    std::vector< BundledNameUse > nameUses;
+    // Defined in input or generated code, in definition order
+    std::vector< std::string > macroNames;
+};
+
+// In processing order
+static std::vector< BundledInput > g_bundledInputs;
+// Inputs declaring name at file scope, in any file
+static llvm::StringMap< unsigned > g_declaringInputCounts;
+// Inputs declaring tag at file scope, in any file
+static llvm::StringMap< unsigned > g_taggingInputCounts;
+// In recording order
+static llvm::DenseMap< const clang::ASTContext*, std::vector< BundledName > >
+    g_bundledHelpers;
+
+// Identifier of raw lexed text
+struct LexedIdentifier {
+    size_t offset = 0;
+    llvm::StringRef name;
+    // After "." or "->"
+    bool isMemberName = false;
+    // After "struct", "union" or "enum"
+    bool isTagName = false;
+    // After "#define"
+    bool isMacroName = false;
+};
+
+// Comments, string and character literals are skipped
+static auto lexIdentifiers( const llvm::StringRef _text,
+                            const clang::LangOptions& _langOptions )
+    -> std::vector< LexedIdentifier > {
+    traceEnter();
+
+    std::vector< LexedIdentifier > l_returnValue;
+
+    // Locations are not used, text is not in source manager
+    clang::Lexer l_lexer( clang::SourceLocation(), _langOptions, _text.begin(),
+                          _text.begin(), _text.end() );
+
+    clang::Token l_token;
+    clang::Token l_previousToken;
+    // "#" starting line, then "define"
+    size_t l_directiveTokens = 0;
+
+    l_previousToken.startToken();
+
+    for ( ;; ) {
+        const bool l_isEndOfFile = l_lexer.LexFromRawLexer( l_token );
+
+        if ( l_token.is( clang::tok::raw_identifier ) ) {
+            LexedIdentifier l_identifier;
+
+            l_identifier.offset =
+                ( static_cast< size_t >( l_lexer.getBufferLocation() -
+                                         _text.begin() ) -
+                  l_token.getLength() );
+            l_identifier.name = l_token.getRawIdentifier();
+            l_identifier.isMemberName = l_previousToken.isOneOf(
+                clang::tok::period, clang::tok::arrow );
+
+            if ( l_previousToken.is( clang::tok::raw_identifier ) ) {
+                const llvm::StringRef l_keyword =
+                    l_previousToken.getRawIdentifier();
+
+                l_identifier.isTagName =
+                    ( ( l_keyword == "struct" ) || ( l_keyword == "union" ) ||
+                      ( l_keyword == "enum" ) );
+            }
+
+            l_identifier.isMacroName = ( l_directiveTokens == 2 );
+
+            l_returnValue.push_back( l_identifier );
+        }
+
+        if ( ( l_token.is( clang::tok::hash ) ) &&
+             ( l_token.isAtStartOfLine() ) ) {
+            l_directiveTokens = 1;
+
+        } else if ( ( l_directiveTokens == 1 ) &&
+                    ( l_token.is( clang::tok::raw_identifier ) ) &&
+                    ( l_token.getRawIdentifier() == "define" ) ) {
+            l_directiveTokens = 2;
+
+        } else {
+            l_directiveTokens = 0;
+        }
+
+        l_previousToken = l_token;
+
+        if ( l_isEndOfFile ) {
+            break;
+        }
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Main file uses of renamed declarations, names declared inside top level
+// declaration traversed last and names of fields
+class BundledNameCollector
+    : public clang::RecursiveASTVisitor< BundledNameCollector > {
+public:
+    BundledNameCollector(
+        const clang::SourceManager& _sourceManager,
+        const llvm::DenseMap< const clang::Decl*, size_t >& _nameIndices )
+        : _sourceManager( _sourceManager ), _nameIndices( _nameIndices ) {}
+
+    auto VisitNamedDecl( clang::NamedDecl* _declaration ) -> bool {
+        addUse( _declaration, _declaration->getLocation() );
+
+        if ( !_declaration->getIdentifier() ) {
+            return ( true );
+        }
+
+        if ( !_declaration->getDeclContext()->isFileContext() ) {
+            innerNames.insert( _declaration->getName() );
+        }
+
+        if ( llvm::isa< clang::FieldDecl >( _declaration ) ) {
+            fieldNames.insert( _declaration->getName() );
+        }
+
+        return ( true );
+    }
+
+    auto VisitDeclRefExpr( clang::DeclRefExpr* _expression ) -> bool {
+        addUse( _expression->getDecl(), _expression->getLocation() );
+
+        return ( true );
+    }
+
+    auto VisitTypedefTypeLoc( clang::TypedefTypeLoc _typeLocation ) -> bool {
+        addUse( _typeLocation.getTypedefNameDecl(),
+                _typeLocation.getNameLoc() );
+
+        return ( true );
+    }
+
+    auto VisitTagTypeLoc( clang::TagTypeLoc _typeLocation ) -> bool {
+        addUse( _typeLocation.getDecl(), _typeLocation.getNameLoc() );
+
+        return ( true );
+    }
+
+    struct Use {
+        clang::SourceLocation location;
+        size_t nameIndex = 0;
+    };
+
+    std::vector< Use > uses;
+    llvm::StringSet<> innerNames;
+    llvm::StringSet<> fieldNames;
+
+private:
+    void addUse( const clang::Decl* _declaration,
+                 const clang::SourceLocation _location ) {
+        const auto l_iterator =
+            _nameIndices.find( _declaration->getCanonicalDecl() );
+
+        if ( l_iterator == _nameIndices.end() ) {
+            return;
+        }
+
+        // Written in macro definition or argument of main file
+        const clang::SourceLocation l_location =
+            _sourceManager.getSpellingLoc( _location );
+
+        if ( _sourceManager.getFileID( l_location ) !=
+             _sourceManager.getMainFileID() ) {
+            return;
+        }
+
+        uses.push_back( { l_location, l_iterator->second } );
+    }
+
+    const clang::SourceManager& _sourceManager;
+    const llvm::DenseMap< const clang::Decl*, size_t >& _nameIndices;
+};
+
+void addToBundle( clang::ASTContext& _context, clang::Rewriter& _rewriter ) {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+    const clang::FileID l_fileId = l_sourceManager.getMainFileID();
+    const clang::SourceLocation l_fileStart =
+        l_sourceManager.getLocForStartOfFile( l_fileId );
+
+    BundledInput l_input;
+
+    l_input.filePath = getMainFilePath( l_sourceManager ).str();
+
+    {
+        llvm::raw_string_ostream l_textStringStream( l_input.text );
+
+        _rewriter.getEditBuffer( l_fileId ).write( l_textStringStream );
+
+        l_textStringStream.flush();
+    }
+
+    // By canonical declaration, redeclarations are renamed with it
+    llvm::DenseMap< const clang::Decl*, size_t > l_nameIndices;
+    llvm::StringMap< size_t > l_ordinaryNameIndices;
+    llvm::StringMap< size_t > l_tagNameIndices;
+
+    {
+        llvm::StringSet<> l_declaredNames;
+        llvm::StringSet<> l_declaredTags;
+
+        // Index of name declared by input itself
+        auto l_addName = [ & ]( const clang::StringRef _name,
+                                const bool _isTag ) -> size_t {
+            llvm::StringMap< size_t >& l_nameIndicesByName =
+                ( ( _isTag ) ? ( l_tagNameIndices )
+                             : ( l_ordinaryNameIndices ) );
+
+            const auto l_iterator =
+                l_nameIndicesByName
+                    .try_emplace( _name, l_input.names.size() )
+                    .first;
+
+            if ( l_iterator->second == l_input.names.size() ) {
+                l_input.names.push_back( { _name.str(), _isTag } );
+            }
+
+            return ( l_iterator->second );
+        };
+
+        auto l_addDeclaration = [ & ]( const clang::NamedDecl* _declaration,
+                                       const bool _isTag ) {
+            const clang::StringRef l_name = _declaration->getName();
+
+            if ( _isTag ) {
+                l_declaredTags.insert( l_name );
+
+            } else {
+                l_declaredNames.insert( l_name );
+            }
+
+            // Only declarations of input itself are renamed
+            const clang::Decl* l_firstDeclaration =
+                _declaration->getCanonicalDecl();
+
+            if ( ( _declaration->isImplicit() ) ||
+                 ( !l_sourceManager.isWrittenInMainFile(
+                     l_sourceManager.getExpansionLoc(
+                         l_firstDeclaration->getLocation() ) ) ) ) {
+                return;
+            }
+
+            if ( ( llvm::isa< clang::FunctionDecl, clang::VarDecl >(
+                     _declaration ) ) &&
+                 ( _declaration->isExternallyVisible() ) ) {
+                return;
+            }
+
+            l_nameIndices[ l_firstDeclaration ] = l_addName( l_name, _isTag );
+        };
+
+        for ( const clang::Decl* l_declaration :
+              _context.getTranslationUnitDecl()->decls() ) {
+            // Enumerators are ordinary identifiers at file scope too
+            if ( const auto* l_enumDeclaration =
+                     llvm::dyn_cast< clang::EnumDecl >( l_declaration ) ) {
+                for ( const clang::EnumConstantDecl* l_enumerator :
+                      l_enumDeclaration->enumerators() ) {
+                    l_addDeclaration( l_enumerator, false );
+                }
+            }
+
+            const auto* l_namedDeclaration =
+                llvm::dyn_cast< clang::NamedDecl >( l_declaration );
+
+            if ( ( !l_namedDeclaration ) ||
+                 ( !l_namedDeclaration->getIdentifier() ) ) {
+                continue;
+            }
+
+            l_addDeclaration(
+                l_namedDeclaration,
+                llvm::isa< clang::TagDecl >( l_namedDeclaration ) );
+        }
+
+        // Declared in generated code, used there and by input itself
+        const auto l_helpers = g_bundledHelpers.find( &_context );
+
+        if ( l_helpers != g_bundledHelpers.end() ) {
+            for ( const BundledName& l_helper : l_helpers->second ) {
+                if ( l_helper.isTag ) {
+                    l_declaredTags.insert( l_helper.name );
+
+                } else {
+                    l_declaredNames.insert( l_helper.name );
+                }
+
+                l_input.names[ l_addName( l_helper.name, l_helper.isTag ) ]
+                    .isHelper = true;
+            }
+        }
+
+        for ( const auto& l_declaredName : l_declaredNames ) {
+            g_declaringInputCounts[ l_declaredName.getKey() ]++;
+        }
+
+        for ( const auto& l_declaredTag : l_declaredTags ) {
+            g_taggingInputCounts[ l_declaredTag.getKey() ]++;
+        }
+    }
+
+    logVariable( l_input.names.size() );
+
+    {
+        const clang::LangOptions& l_langOptions = _context.getLangOpts();
+
+        const std::vector< LexedIdentifier > l_identifiers =
+            lexIdentifiers( l_input.text, l_langOptions );
+
+        auto l_isBundledName = [ & ]( const llvm::StringRef _name ) -> bool {
+            return ( ( l_ordinaryNameIndices.contains( _name ) ) ||
+                     ( l_tagNameIndices.contains( _name ) ) );
+        };
+
+        // By offset in rewritten text, only of bundled names
+        llvm::DenseMap< size_t, size_t > l_identifierIndices;
+
+        for ( size_t l_identifierIndex = 0;
+              l_identifierIndex < l_identifiers.size(); l_identifierIndex++ ) {
+            if ( l_isBundledName( l_identifiers[ l_identifierIndex ].name ) ) {
+                l_identifierIndices[ l_identifiers[ l_identifierIndex ]
+                                         .offset ] = l_identifierIndex;
+            }
+        }
+
+        // Rewriter is gone once every input is processed and collisions are
+        // known, so original text is located in rewritten one now.
+        // Identifier of original text replaced by handler is not found there.
+        auto l_findIdentifier =
+            [ & ]( const clang::SourceLocation _location,
+                   const llvm::StringRef _name ) -> const size_t* {
+            // After text inserted at location
+            const int l_offset = _rewriter.getRangeSize(
+                clang::CharSourceRange::getCharRange( l_fileStart,
+                                                      _location ) );
+
+            if ( l_offset < 0 ) {
+                return ( nullptr );
+            }
+
+            const auto l_iterator = l_identifierIndices.find( l_offset );
+
+            if ( ( l_iterator == l_identifierIndices.end() ) ||
+                 ( l_identifiers[ l_iterator->second ].name != _name ) ) {
+                return ( nullptr );
+            }
+
+            return ( &( l_iterator->second ) );
+        };
+
+        // Rest is generated by handlers
+        std::vector< bool > l_isOriginal( l_identifiers.size(), false );
+        // Of renamed declaration, by identifier
+        llvm::DenseMap< size_t, size_t > l_useNameIndices;
+
+        {
+            const llvm::StringRef l_buffer =
+                l_sourceManager.getBufferData( l_fileId );
+
+            for ( const LexedIdentifier& l_identifier :
+                  lexIdentifiers( l_buffer, l_langOptions ) ) {
+                if ( !l_isBundledName( l_identifier.name ) ) {
+                    continue;
+                }
+
+                if ( const size_t* l_identifierIndex = l_findIdentifier(
+                         l_fileStart.getLocWithOffset( l_identifier.offset ),
+                         l_identifier.name ) ) {
+                    l_isOriginal[ *l_identifierIndex ] = true;
+                }
+            }
+        }
+
+        // Top level declarations in rewritten text, by begin
+        struct Scope {
+            size_t beginOffset = 0;
+            size_t endOffset = 0;
+            llvm::StringSet<> innerNames;
+        };
+
+        std::vector< Scope > l_scopes;
+        llvm::StringSet<> l_fieldNames;
+
+        {
+            BundledNameCollector l_collector( l_sourceManager,
+                                              l_nameIndices );
+
+            for ( clang::Decl* l_declaration :
+                  getMainFileDeclarations( _context ) ) {
+                l_collector.TraverseDecl( l_declaration );
+
+                const int l_beginOffset = _rewriter.getRangeSize(
+                    clang::CharSourceRange::getCharRange(
+                        l_fileStart, l_sourceManager.getExpansionLoc(
+                                         l_declaration->getBeginLoc() ) ) );
+                const int l_endOffset = _rewriter.getRangeSize(
+                    clang::CharSourceRange::getTokenRange(
+                        l_fileStart, l_sourceManager.getExpansionLoc(
+                                         l_declaration->getEndLoc() ) ) );
+
+                if ( ( l_beginOffset >= 0 ) &&
+                     ( l_endOffset >= l_beginOffset ) &&
+                     ( !l_collector.innerNames.empty() ) ) {
+                    l_scopes.push_back(
+                        { static_cast< size_t >( l_beginOffset ),
+                          static_cast< size_t >( l_endOffset ),
+                          std::move( l_collector.innerNames ) } );
+                }
+
+                l_collector.innerNames.clear();
+            }
+
+            for ( const BundledNameCollector::Use& l_use :
+                  l_collector.uses ) {
+                if ( const size_t* l_identifierIndex = l_findIdentifier(
+                         l_use.location,
+                         l_input.names[ l_use.nameIndex ].name ) ) {
+                    l_useNameIndices[ *l_identifierIndex ] = l_use.nameIndex;
+                }
+            }
+
+            l_fieldNames = std::move( l_collector.fieldNames );
+        }
+
+        std::stable_sort( l_scopes.begin(), l_scopes.end(),
+                          []( const Scope& _left, const Scope& _right ) {
+                              return ( _left.beginOffset <
+                                       _right.beginOffset );
+                          } );
+
+        // Whether generated identifier may name declaration inside enclosing
+        // top level declaration, like variable passed to callback
+        auto l_isInnerName = [ & ]( const LexedIdentifier& _identifier )
+            -> bool {
+            const auto l_scope = std::upper_bound(
+                l_scopes.begin(), l_scopes.end(), _identifier.offset,
+                []( const size_t _offset, const Scope& _scope ) {
+                    return ( _offset < _scope.beginOffset );
+                } );
+
+            return ( ( l_scope != l_scopes.begin() ) &&
+                     ( std::prev( l_scope )->endOffset >=
+                       _identifier.offset ) &&
+                     ( std::prev( l_scope )->innerNames.contains(
+                         _identifier.name ) ) );
+        };
+
+        llvm::StringSet<> l_macroNames;
+
+        for ( size_t l_identifierIndex = 0;
+              l_identifierIndex < l_identifiers.size(); l_identifierIndex++ ) {
+            const LexedIdentifier& l_identifier =
+                l_identifiers[ l_identifierIndex ];
+            const size_t l_offset = l_identifier.offset;
+
+            if ( ( l_identifier.isMacroName ) &&
+                 ( l_macroNames.insert( l_identifier.name ).second ) ) {
+                l_input.macroNames.push_back( l_identifier.name.str() );
+            }
+
+            if ( !l_isBundledName( l_identifier.name ) ) {
+                continue;
+            }
+
+            const auto l_use = l_useNameIndices.find( l_identifierIndex );
+
+            if ( l_use != l_useNameIndices.end() ) {
+                l_input.nameUses.push_back(
+                    { ( l_offset + l_identifier.name.size() ),
+                      l_use->second } );
+
+                continue;
+            }
+
+            if ( l_identifier.isMemberName ) {
+                continue;
+            }
+
+            // Generated code is not in AST, ordinary and tag names are told
+            // apart by preceding keyword
+            const llvm::StringMap< size_t >& l_nameIndicesByName =
+                ( ( l_identifier.isTagName ) ? ( l_tagNameIndices )
+                                             : ( l_ordinaryNameIndices ) );
+
+            const auto l_name =
+                l_nameIndicesByName.find( l_identifier.name );
+
+            if ( l_name == l_nameIndicesByName.end() ) {
+                continue;
+            }
+
+            if ( l_input.names[ l_name->second ].isHelper ) {
+                l_input.nameUses.push_back(
+                    { ( l_offset + l_identifier.name.size() ),
+                      l_name->second } );
+
+                continue;
+            }
+
+            // Field, label or shadowing declaration
+            if ( ( l_isOriginal[ l_identifierIndex ] ) ||
+                 ( l_isInnerName( l_identifier ) ) ) {
+                continue;
+            }
+
+            // Generated structure of arrays declares column per field
+            if ( ( !l_identifier.isTagName ) &&
+                 ( l_fieldNames.contains( l_identifier.name ) ) ) {
+                logWarning( "Generated use of '" + l_identifier.name.str() +
+                            "' named like field is not renamed in bundle" );
+
+                continue;
+            }
+
+            l_input.nameUses.push_back(
+                { ( l_offset + l_identifier.name.size() ),
+                  l_name->second } );
+        }
+    }
+
+    logVariable( l_input.nameUses.size() );
+
+    g_bundledInputs.push_back( std::move( l_input ) );
+
+    clearBundledHelpers( _context );
+
+    traceExit();
+}
+
+void clearBundledHelpers( const clang::ASTContext& _context ) {
+    traceEnter();
+
+    g_bundledHelpers.erase( &_context );
+
+    traceExit();
+}
+
+void addBundledHelper( const clang::ASTContext& _context,
+                       const llvm::StringRef _name,
+                       const bool _isTag ) {
+    traceEnter();
+
+    if ( g_bundleFilePath.empty() ) {
+        goto EXIT;
+    }
+
+    // In recording order
+    runOrDefer( [ &_context, l_name = _name.str(), _isTag ] {
+        g_bundledHelpers[ &_context ].push_back( { l_name, _isTag } );
+    } );
+
+EXIT:
+    traceExit();
+}
+
+auto writeBundle() -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    if ( g_bundleFilePath.empty() ) {
+        goto EXIT;
+    }
+
+    {
+        std::error_code l_errorCode;
+
+        llvm::raw_fd_ostream l_bundleFile( g_bundleFilePath, l_errorCode,
+                                           llvm::sys::fs::OF_None );
+
+        if ( l_errorCode ) {
+            logError( l_errorCode.message() );
+
+            l_returnValue = false;
+
+            goto EXIT;
+        }
+
+        for ( size_t l_inputIndex = 0; l_inputIndex < g_bundledInputs.size();
+              l_inputIndex++ ) {
+            const BundledInput& l_input = g_bundledInputs[ l_inputIndex ];
+
+            // Declared by other input too
+            std::vector< bool > l_isRenamed;
+            llvm::StringSet<> l_renamedNames;
+
+            for ( const BundledName& l_name : l_input.names ) {
+                const llvm::StringMap< unsigned >& l_inputCounts =
+                    ( ( l_name.isTag ) ? ( g_taggingInputCounts )
+                                       : ( g_declaringInputCounts ) );
+
+                l_isRenamed.push_back(
+                    l_inputCounts.lookup( l_name.name ) > 1 );
+
+                if ( ( l_isRenamed.back() ) && ( !l_name.isTag ) ) {
+                    l_renamedNames.insert( l_name.name );
+                }
+            }
+
+            const llvm::StringRef l_text = l_input.text;
+
+            l_bundleFile << "/* c_extra bundle: " << l_input.filePath
+                         << " */\n";
+
+            // name -> name_c_extra_index
+            size_t l_offset = 0;
+
+            for ( const BundledNameUse& l_nameUse : l_input.nameUses ) {
+                if ( !l_isRenamed[ l_nameUse.nameIndex ] ) {
+                    continue;
+                }
+
+                l_bundleFile << l_text.slice( l_offset, l_nameUse.offset )
+                             << "_c_extra_" << l_inputIndex;
+
+                l_offset = l_nameUse.offset;
+            }
+
+            l_bundleFile << l_text.drop_front( l_offset );
+
+            if ( ( !l_text.empty() ) && ( l_text.back() != '\n' ) ) {
+                l_bundleFile << "\n";
+            }
+
+            // Next input sees macros of its own and of headers only
+            for ( const std::string& l_macroName : l_input.macroNames ) {
+                l_bundleFile << "#undef " << l_macroName;
+
+                if ( l_renamedNames.contains( l_macroName ) ) {
+                    l_bundleFile << "_c_extra_" << l_inputIndex;
+                }
+
+                l_bundleFile << "\n";
+            }
+
+            l_bundleFile << "\n";
+        }
+
+        addStatistic( statistic::bytesWritten, l_bundleFile.tell() );
+
+        l_bundleFile.close();
+
+        if ( l_bundleFile.has_error() ) {
+            logError( l_bundleFile.error().message() );
+
+            l_bundleFile.clear_error();
+
+            l_returnValue = false;
+        }
+
+        logVariable( g_bundledInputs.size() );
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
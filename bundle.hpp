@@ -0,0 +1,27 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+// Unity output, see --bundle.
+// Rewritten inputs are kept in processing order and written as one file once
+// every input is processed, so downstream compiler is invoked once.
+// Internal function/ variable, typedef, tag or enumerator of input whose name
+// is declared at file scope by other input too is renamed to
+// "name_c_extra_index" where it is declared and used, located through AST.
+// Generated code is not in AST, so names there are matched by spelling,
+// skipping members and names declared inside enclosing declaration.
+// Macros defined in input are undefined after it.
+void addToBundle( clang::ASTContext& _context, clang::Rewriter& _rewriter );
+
+// Forget helpers recorded for translation unit, before its handlers run
+void clearBundledHelpers( const clang::ASTContext& _context );
+
+// Function/ macro or tag inserted by handler, renamed like internal names,
+// everywhere but in member names, when other input declares it too
+void addBundledHelper( const clang::ASTContext& _context,
+                       const llvm::StringRef _name,
+                       const bool _isTag = false );
+
+// Does nothing unless requested by arguments
+auto writeBundle() -> bool;
@@ -1,17 +1,51 @@
 #include "cextra_ast_consumer.hpp"
 
+#include "arguments_parse.hpp"
+#include "bundle.hpp"
+#include "cextra_frontend.hpp"
+#include "dependencies.hpp"
+#include "generate_serializers.hpp"
+#include "generate_soa.hpp"
 #include "iterate_arguments.hpp"
 #include "iterate_enum.hpp"
+#include "iterate_scope.hpp"
 #include "iterate_struct_union.hpp"
+#include "log.hpp"
+#include "parallel_match.hpp"
+#include "prescan.hpp"
+#include "structural_hash.hpp"
 #include "trace.hpp"
 
-CExtraASTConsumer::CExtraASTConsumer( clang::Rewriter& _rewriter ) {
+CExtraASTConsumer::CExtraASTConsumer( clang::Rewriter& _rewriter )
+    : _rewriter( _rewriter ),
+      _macroCallSites( _topLevelDeclarations ),
+      _outlinedExpansions( _topLevelDeclarations ) {
     traceEnter();
 
     // TODO: Improve to not hardcode it
-    IterateArgumentsHandler::addMatcher( _matcher, _rewriter );
-    IterateEnumHandler::addMatcher( _matcher, _rewriter );
-    IterateStructUnionHandler::addMatcher( _matcher, _rewriter );
+    IterateArgumentsHandler::addCallSiteHandler( _scopeIndex, _rewriter );
+    IterateScopeHandler::addCallSiteHandler( _scopeIndex, _rewriter );
+
+    // Workers fill own matchers
+    if ( g_jobCount <= 1 ) {
+        addMatchers( _matcher );
+    }
+
+    traceExit();
+}
+
+void CExtraASTConsumer::addMatchers(
+    clang::ast_matchers::MatchFinder& _matcher ) {
+    traceEnter();
+
+    GenerateSerializersHandler::addMatcher( _matcher, _rewriter,
+                                            _recordLayoutCache );
+    GenerateSoaHandler::addMatcher( _matcher, _rewriter );
+    IterateEnumHandler::addMatcher( _matcher, _rewriter, _macroCallSites,
+                                    _outlinedExpansions );
+    IterateStructUnionHandler::addMatcher( _matcher, _rewriter,
+                                           _recordLayoutCache, _macroCallSites,
+                                           _outlinedExpansions );
 
     traceExit();
 }
@@ -19,7 +53,74 @@ CExtraASTConsumer::CExtraASTConsumer( clang::Rewriter& _rewriter ) {
 void CExtraASTConsumer::HandleTranslationUnit( clang::ASTContext& _context ) {
     traceEnter();
 
-    _matcher.matchAST( _context );
+    const clang::StringRef l_filePath =
+        getMainFilePath( _context.getSourceManager() );
+
+    endPhase( l_filePath, phase::parse, _parseStart );
+
+    const PhaseStart l_matchStart = startPhase( phase::match );
+
+    clearSemanticDependencies( _context );
+    clearStructuralHashes( _context );
+    clearBundledHelpers( _context );
+    clearJsonHelpers( _context );
+
+    _topLevelDeclarations.build( _context );
+    _scopeIndex.dispatch( _context );
+
+    if ( g_jobCount > 1 ) {
+        matchInParallel(
+            _context, g_jobCount,
+            [ this ]( clang::ast_matchers::MatchFinder& _workerMatcher ) {
+                addMatchers( _workerMatcher );
+            } );
+
+    } else {
+        _matcher.matchAST( _context );
+    }
+
+    endPhase( l_filePath, phase::match, l_matchStart );
+
+    const PhaseStart l_rewriteStart = startPhase( phase::rewrite );
+
+    // Calls from macro expansions, once every type they expand for is known
+    _macroCallSites.rewrite( _context, _rewriter );
+    _outlinedExpansions.insert( _context, _rewriter );
+    insertJsonHelpers( _context, _rewriter );
+
+    endPhase( l_filePath, phase::rewrite, l_rewriteStart );
+
+    traceExit();
+}
+
+auto CExtraASTConsumer::shouldSkipFunctionBody( clang::Decl* _declaration )
+    -> bool {
+    traceEnter();
+
+    // Declaration itself is parsed either way, only body without intrinsic
+    // calls is skipped
+    const bool l_returnValue = !mayFunctionBodyMentionIntrinsics(
+        _rewriter.getSourceMgr(), _rewriter.getLangOpts(),
+        _declaration->getEndLoc(), _intrinsicMacros );
+
+    if ( l_returnValue ) {
+        if ( const auto* l_namedDeclaration =
+                 llvm::dyn_cast< clang::NamedDecl >( _declaration ) ) {
+            log( "Skipping body of " + l_namedDeclaration->getNameAsString() );
+        }
+
+        addStatistic( statistic::skippedFunctionBodies );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto CExtraASTConsumer::getIntrinsicMacros() -> llvm::StringSet<>& {
+    traceEnter();
 
     traceExit();
+
+    return ( _intrinsicMacros );
 }
@@ -3,6 +3,14 @@
 #include <clang/AST/ASTConsumer.h>
 #include <clang/ASTMatchers/ASTMatchFinder.h>
 #include <clang/Rewrite/Core/Rewriter.h>
+#include <llvm/ADT/StringSet.h>
+
+#include "macro_call_sites.hpp"
+#include "outlined_expansions.hpp"
+#include "record_layout.hpp"
+#include "scope_index.hpp"
+#include "statistics.hpp"
+#include "top_level_declarations.hpp"
 
 class CExtraASTConsumer : public clang::ASTConsumer {
 public:
@@ -10,6 +18,25 @@ public:
 
     void HandleTranslationUnit( clang::ASTContext& _context ) override;
 
+    // Consulted while parsing, see --skip-function-bodies
+    auto shouldSkipFunctionBody( clang::Decl* _declaration ) -> bool override;
+
+    // Filled by IntrinsicMacroCollector while preprocessing
+    auto getIntrinsicMacros() -> llvm::StringSet<>&;
+
 private:
+    // Handlers of intrinsics/ annotations matched by MatchFinder
+    void addMatchers( clang::ast_matchers::MatchFinder& _matcher );
+
+    clang::Rewriter& _rewriter;
     clang::ast_matchers::MatchFinder _matcher;
+    ScopeIndex _scopeIndex;
+    RecordLayoutCache _recordLayoutCache;
+    // Built before handlers run, read by them
+    TopLevelDeclarations _topLevelDeclarations;
+    MacroCallSites _macroCallSites;
+    OutlinedExpansions _outlinedExpansions;
+    llvm::StringSet<> _intrinsicMacros;
+    // Consumer is created before parsing starts, see --stats
+    const PhaseStart _parseStart = startPhase( phase::parse );
 };
@@ -12,7 +12,13 @@
 #include <cstdio>
 
 #include "arguments_parse.hpp"
+#include "bundle.hpp"
 #include "cextra_ast_consumer.hpp"
+#include "dependencies.hpp"
+#include "dump.hpp"
+#include "prescan.hpp"
+#include "statistics.hpp"
+#include "structural_hash.hpp"
 #include "clang/Basic/LLVM.h"
 #include "llvm/Support/raw_ostream.h"
 #include "log.hpp"
@@ -51,9 +57,20 @@ auto CExtraFrontendAction::CreateASTConsumer(
     _rewriter.setSourceMgr( _compilerInstance.getSourceManager(),
                             _compilerInstance.getLangOpts() );
 
+    auto l_consumer = std::make_unique< CExtraASTConsumer >( _rewriter );
+
+    // Read once parsing starts, preprocessor already exists
+    if ( g_needSkipFunctionBodies ) {
+        _compilerInstance.getFrontendOpts().SkipFunctionBodies = true;
+
+        _compilerInstance.getPreprocessor().addPPCallbacks(
+            std::make_unique< IntrinsicMacroCollector >(
+                l_consumer->getIntrinsicMacros() ) );
+    }
+
     traceExit();
 
-    return ( std::make_unique< CExtraASTConsumer >( _rewriter ) );
+    return ( l_consumer );
 }
 
 #if 0
@@ -86,8 +103,13 @@ static inline auto writeToFile( const clang::StringRef _filePath,
 
     // TODO: Improve
     if ( g_needOnlyPrintResult ) {
+        // Lines logged while processing come before result
+        flushLog();
+
         _rewriter.getEditBuffer( _fileId ).write( llvm::outs() );
 
+        l_returnValue = true;
+
     } else {
         llvm::raw_fd_ostream l_outputFile( _filePath, l_errorCode,
                                            llvm::sys::fs::OF_None );
@@ -101,6 +123,8 @@ static inline auto writeToFile( const clang::StringRef _filePath,
         }
 
         _rewriter.getEditBuffer( _fileId ).write( l_outputFile );
+
+        addStatistic( statistic::bytesWritten, l_outputFile.tell() );
     }
 
 EXIT:
@@ -109,82 +133,163 @@ EXIT:
     return ( l_returnValue );
 }
 
-void CExtraFrontendAction::EndSourceFileAction() {
+auto getMainFilePath( const clang::SourceManager& _sourceManager )
+    -> clang::StringRef {
     traceEnter();
 
-    clang::DiagnosticsEngine& l_diagnosticsEngine =
-        getCompilerInstance().getDiagnostics();
+    const clang::FileID l_fileId = _sourceManager.getMainFileID();
+    const clang::OptionalFileEntryRef l_fileEntry =
+        _sourceManager.getFileEntryRefForID( l_fileId );
+    clang::StringRef l_returnValue;
 
-    if ( l_diagnosticsEngine.hasErrorOccurred() ) {
-        logError( "Processing failed due to errors." );
+    if ( l_fileEntry ) {
+        l_returnValue = l_fileEntry->getFileEntry().tryGetRealPathName();
+    }
 
-        goto EXIT;
+    if ( l_returnValue.empty() ) {
+        l_returnValue =
+            _sourceManager.getBufferOrFake( l_fileId ).getBufferIdentifier();
     }
 
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto buildOutputPath( const clang::StringRef _inputFile,
+                      clang::SmallString< FILENAME_MAX >& _outputPath )
+    -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
     {
-        const clang::SourceManager& l_sourceManager = _rewriter.getSourceMgr();
+        clang::SmallString< FILENAME_MAX > l_filePath = _inputFile;
 
-        const clang::FileID l_fileId = l_sourceManager.getMainFileID();
-        const clang::StringRef l_inputFile =
-            l_sourceManager.getFileEntryForID( l_fileId )->tryGetRealPathName();
+        // Do not edit in-place and write to fileName ->
+        // prefix.fileName.extension
+        if ( !g_needEditInPlace ) {
+            const clang::StringRef l_fileName =
+                llvm::sys::path::filename( l_filePath );
+            // With prefix
+            std::string l_newFileName = ( g_prefix + l_fileName.str() );
 
-        if ( l_inputFile.empty() ) {
-            goto EXIT;
+            // Add extension
+            {
+                const std::string l_extension =
+                    llvm::sys::path::extension( l_newFileName ).str();
+
+                if ( l_extension.empty() ) {
+                    logError( "Extension not found in file name." );
+
+                    goto EXIT;
+                }
+
+                // Remove extension temporarily
+                l_newFileName.resize( l_newFileName.size() -
+                                      l_extension.size() );
+
+                // Append custom extension + original one
+                l_newFileName += g_extension;
+                l_newFileName += l_extension;
+            }
+
+            llvm::sys::path::remove_filename( l_filePath );
+            llvm::sys::path::append( l_filePath, l_newFileName );
         }
 
-        {
-            clang::SmallString< FILENAME_MAX > l_filePath = l_inputFile;
+        if ( !g_outputDirectory.empty() ) {
+            const clang::StringRef l_fileName =
+                llvm::sys::path::filename( l_filePath );
+
+            _outputPath = ( g_outputDirectory + l_fileName.str() );
+
+        } else {
+            _outputPath = l_filePath;
+        }
+
+        l_returnValue = true;
+    }
+
+EXIT:
+    traceExit();
 
-            // Do not edit in-place and write to fileName ->
-            // prefix.fileName.extension
-            if ( !g_needEditInPlace ) {
-                const clang::StringRef l_fileName =
-                    llvm::sys::path::filename( l_filePath );
-                // With prefix
-                std::string l_newFileName = ( g_prefix + l_fileName.str() );
+    return ( l_returnValue );
+}
 
-                // Add extension
-                {
-                    const std::string l_extension =
-                        llvm::sys::path::extension( l_newFileName ).str();
+auto writeRewrittenMainFile( clang::ASTContext& _context,
+                             clang::Rewriter& _rewriter ) -> bool {
+    traceEnter();
 
-                    if ( l_extension.empty() ) {
-                        logError( "Extension not found in file name." );
+    bool l_returnValue = false;
 
-                        goto EXIT;
-                    }
+    const PhaseStart l_writeStart = startPhase( phase::write );
 
-                    // Remove extension temporarily
-                    l_newFileName.resize( l_newFileName.size() -
-                                          l_extension.size() );
+    const clang::SourceManager& l_sourceManager = _rewriter.getSourceMgr();
 
-                    // Append custom extension + original one
-                    l_newFileName += g_extension;
-                    l_newFileName += l_extension;
-                }
+    const clang::FileID l_fileId = l_sourceManager.getMainFileID();
+    const clang::OptionalFileEntryRef l_fileEntry =
+        l_sourceManager.getFileEntryRefForID( l_fileId );
+    // Buffer without file has no path to write next to
+    const clang::StringRef l_inputFile =
+        ( ( l_fileEntry ) ? ( l_fileEntry->getFileEntry().tryGetRealPathName() )
+                          : ( clang::StringRef() ) );
 
-                llvm::sys::path::remove_filename( l_filePath );
-                llvm::sys::path::append( l_filePath, l_newFileName );
-            }
+    clang::SmallString< FILENAME_MAX > l_outputPath;
 
-            if ( !g_isDryRun ) {
-                clang::SmallString< FILENAME_MAX > l_outputPath;
+    if ( ( l_inputFile.empty() ) ||
+         ( !buildOutputPath( l_inputFile, l_outputPath ) ) ) {
+        goto EXIT;
+    }
 
-                if ( !g_outputDirectory.empty() ) {
-                    const clang::StringRef l_fileName =
-                        llvm::sys::path::filename( l_filePath );
+    {
+        l_returnValue = true;
 
-                    l_outputPath = ( g_outputDirectory + l_fileName.str() );
+        // Written with every other input by writeBundle
+        if ( !g_bundleFilePath.empty() ) {
+            addToBundle( _context, _rewriter );
 
-                } else {
-                    l_outputPath = l_filePath;
-                }
+        } else if ( !g_isDryRun ) {
+            l_returnValue = writeToFile( l_outputPath, l_fileId, _rewriter );
+        }
 
-                writeToFile( l_outputPath, l_fileId, _rewriter );
-            }
+        // Next to output -> prefix.fileName.extension.cxd
+        if ( ( g_needDumpAst ) || ( g_needDumpTokens ) ) {
+            writeDump( _context, _rewriter, ( l_outputPath + ".cxd" ).str() );
         }
+
+        // prefix.fileName.extension.d/ prefix.fileName.extension.sdeps
+        if ( ( g_needDepfile ) || ( g_needSemanticDependencies ) ) {
+            l_returnValue = ( writeDependencyFiles( _context, l_outputPath ) &&
+                              l_returnValue );
+        }
+
+        endPhase( l_inputFile, phase::write, l_writeStart );
     }
 
+EXIT:
+    clearStructuralHashes( _context );
+    clearBundledHelpers( _context );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void CExtraFrontendAction::EndSourceFileAction() {
+    traceEnter();
+
+    clang::DiagnosticsEngine& l_diagnosticsEngine =
+        getCompilerInstance().getDiagnostics();
+
+    if ( l_diagnosticsEngine.hasErrorOccurred() ) {
+        logError( "Processing failed due to errors." );
+
+        goto EXIT;
+    }
+
+    writeRewrittenMainFile( getCompilerInstance().getASTContext(), _rewriter );
+
 EXIT:
     traceExit();
 }
@@ -3,6 +3,9 @@
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Frontend/FrontendActions.h>
 #include <clang/Rewrite/Core/Rewriter.h>
+#include <llvm/ADT/SmallString.h>
+
+#include <cstdio>
 
 class CExtraFrontendAction : public clang::ASTFrontendAction {
 public:
@@ -19,3 +22,18 @@ public:
 private:
     clang::Rewriter _rewriter;
 };
+
+// Real path of main file, identifier of its buffer if it has no file entry
+// (memory buffer, standard input)
+auto getMainFilePath( const clang::SourceManager& _sourceManager )
+    -> clang::StringRef;
+
+// prefix.fileName.extension in output directory, or next to input
+auto buildOutputPath( const clang::StringRef _inputFile,
+                      clang::SmallString< FILENAME_MAX >& _outputPath )
+    -> bool;
+
+// Write rewritten main file next to input/ into output directory (or to
+// standard output) and its dump if requested
+auto writeRewrittenMainFile( clang::ASTContext& _context,
+                             clang::Rewriter& _rewriter ) -> bool;
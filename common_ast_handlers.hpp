@@ -7,8 +7,11 @@
 #include <tuple>
 
 #include "common.hpp"
+#include "expansion_cache.hpp"
 #include "llvm/Support/raw_ostream.h"
 #include "log.hpp"
+#include "parallel_match.hpp"
+#include "statistics.hpp"
 #include "trace.hpp"
 
 namespace ast = clang::ast_matchers;
@@ -118,6 +121,28 @@ auto anyReference( const MatcherType& _type ) {
                     common::castPointerType( _type ) ) );
 }
 
+// String literal passed as _argumentIndex argument or nullptr
+inline auto getStringLiteralArgument( const clang::CallExpr* _callingExpression,
+                                      const unsigned _argumentIndex )
+    -> const clang::StringLiteral* {
+    traceEnter();
+
+    const clang::StringLiteral* l_returnValue = nullptr;
+
+    if ( ( !_callingExpression ) ||
+         ( _callingExpression->getNumArgs() <= _argumentIndex ) ) {
+        goto EXIT;
+    }
+
+    l_returnValue = llvm::dyn_cast< clang::StringLiteral >(
+        _callingExpression->getArg( _argumentIndex )->IgnoreParenImpCasts() );
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
 template < typename QualifierType >
 auto buildUnderlyingTypeString( QualifierType _qualifierType ) -> std::string {
     traceEnter();
@@ -140,56 +165,310 @@ auto buildUnderlyingTypeString( QualifierType _qualifierType ) -> std::string {
     return ( l_returnValue );
 }
 
-// Build replacement text
+// "struct name"/ "union name" or typedef name of anonymous record
+inline auto buildRecordTypeString( const clang::RecordDecl* _record )
+    -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    if ( _record->getIdentifier() ) {
+        l_returnValue =
+            ( _record->getKindName() + " " + _record->getName() ).str();
+
+    } else if ( const clang::TypedefNameDecl* l_typedefDeclaration =
+                    _record->getTypedefNameForAnonDecl() ) {
+        l_returnValue = l_typedefDeclaration->getNameAsString();
+
+    } else {
+        l_returnValue = ( _record->getKindName() + " <anonymous>" ).str();
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Record identifier or typedef name of anonymous record, empty if none.
+// Used as prefix of generated declarations
+inline auto buildRecordBaseName( const clang::RecordDecl* _record )
+    -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    if ( _record->getIdentifier() ) {
+        l_returnValue = _record->getNameAsString();
+
+    } else if ( const clang::TypedefNameDecl* l_typedefDeclaration =
+                    _record->getTypedefNameForAnonDecl() ) {
+        l_returnValue = l_typedefDeclaration->getNameAsString();
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Whether declaration has __attribute__((annotate("_annotation")))
+inline auto hasAnnotation( const clang::Decl* _declaration,
+                           const clang::StringRef _annotation ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    for ( const clang::AnnotateAttr* l_annotateAttribute :
+          _declaration->specific_attrs< clang::AnnotateAttr >() ) {
+        if ( l_annotateAttribute->getAnnotation() == _annotation ) {
+            l_returnValue = true;
+
+            break;
+        }
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Location after the declaration of record, including its typedef and
+// trailing semicolon, invalid if it is not in main file
+inline auto getLocationAfterRecordDeclaration(
+    const clang::SourceManager& _sourceManager,
+    const clang::LangOptions& _langOptions,
+    const clang::RecordDecl* _record ) -> clang::SourceLocation {
+    traceEnter();
+
+    // typedef struct { ... } name;
+    const clang::TypedefNameDecl* l_typedefDeclaration =
+        _record->getTypedefNameForAnonDecl();
+    const clang::SourceLocation l_endLocation = _sourceManager.getExpansionLoc(
+        ( l_typedefDeclaration ) ? ( l_typedefDeclaration->getEndLoc() )
+                                 : ( _record->getEndLoc() ) );
+
+    clang::SourceLocation l_returnValue = clang::Lexer::findLocationAfterToken(
+        l_endLocation, clang::tok::semi, _sourceManager, _langOptions, true );
+
+    if ( l_returnValue.isInvalid() ) {
+        l_returnValue = clang::Lexer::getLocForEndOfToken(
+            l_endLocation, 0, _sourceManager, _langOptions );
+    }
+
+    if ( ( l_returnValue.isValid() ) &&
+         ( !_sourceManager.isWrittenInMainFile( l_returnValue ) ) ) {
+        l_returnValue = clang::SourceLocation();
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Insert text after the declaration of record, including its typedef and
+// trailing semicolon
+inline void insertAfterRecordDeclaration( clang::Rewriter& _rewriter,
+                                          const clang::RecordDecl* _record,
+                                          const clang::StringRef _text ) {
+    traceEnter();
+
+    if ( isDeferringActions() ) {
+        runOrDefer( [ &_rewriter, _record, l_text = _text.str() ] {
+            insertAfterRecordDeclaration( _rewriter, _record, l_text );
+        } );
+
+        goto EXIT;
+    }
+
+    {
+        const clang::SourceLocation l_insertLocation =
+            getLocationAfterRecordDeclaration( _rewriter.getSourceMgr(),
+                                               _rewriter.getLangOpts(),
+                                               _record );
+
+        if ( l_insertLocation.isInvalid() ) {
+            logError( "Invalid or non-main file location for insertion." );
+
+            goto EXIT;
+        }
+
+        _rewriter.InsertTextAfter( l_insertLocation, _text );
+
+        addStatistic( statistic::bytesInserted, _text.size() );
+    }
+
+EXIT:
+    traceExit();
+}
+
+// Build text of every element, each line indented
 template < typename Range, typename Builder >
-auto buildReplacementText( const clang::Rewriter& _rewriter,
-                           const clang::CallExpr* _callingExpression,
-                           const Range& _range,
-                           Builder&& _builder ) -> std::string {
+auto buildIndentedText( const Range& _range,
+                        Builder&& _builder,
+                        const clang::StringRef _indentation ) -> std::string {
     traceEnter();
 
     std::string l_returnValue;
 
-    const clang::SourceManager& l_sourceManager = _rewriter.getSourceMgr();
+    {
+        llvm::raw_string_ostream l_textStringStream( l_returnValue );
+
+        for ( const auto& l_element : _range ) {
+            std::forward< Builder >( _builder )( l_element, l_textStringStream,
+                                                 _indentation );
+        }
+
+        l_textStringStream.flush();
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Column of call, caller holds lockHandlerState
+inline auto getIndentationWidth( const clang::SourceManager& _sourceManager,
+                                 const clang::CallExpr* _callingExpression )
+    -> unsigned {
+    traceEnter();
 
     // Determine indentation from call location
     // Use spelling loc for column
     const clang::SourceLocation l_sourceStartLocation =
-        l_sourceManager.getExpansionLoc( _callingExpression->getBeginLoc() );
-    unsigned l_spellingColumnNumber =
-        l_sourceManager.getExpansionColumnNumber( l_sourceStartLocation );
-    l_spellingColumnNumber =
+        _sourceManager.getExpansionLoc( _callingExpression->getBeginLoc() );
+    const unsigned l_spellingColumnNumber =
+        _sourceManager.getExpansionColumnNumber( l_sourceStartLocation );
+
+    const unsigned l_returnValue =
         ( ( l_spellingColumnNumber > 0 ) ? ( l_spellingColumnNumber - 1 )
                                          : ( 0 ) );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Replacement text buildReplacementText cached under expansion key, empty if
+// there is none.
+// Lets handler skip preparing elements of replacement on hit, miss is counted
+// by buildReplacementText.
+inline auto findCachedReplacementText(
+    const clang::Rewriter& _rewriter,
+    const clang::CallExpr* _callingExpression,
+    const std::string& _expansionKey ) -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    ExpansionCache* l_expansionCache = getExpansionCache();
+
+    if ( ( !l_expansionCache ) || ( _expansionKey.empty() ) ) {
+        goto EXIT;
+    }
+
+    {
+        const auto l_handlerStateLock = lockHandlerState();
+
+        const std::string* l_cachedReplacementText = l_expansionCache->find(
+            _expansionKey + ":" +
+            std::to_string( getIndentationWidth( _rewriter.getSourceMgr(),
+                                                 _callingExpression ) ) );
+
+        if ( l_cachedReplacementText ) {
+            l_returnValue = *l_cachedReplacementText;
+
+            addStatistic( statistic::expansionCacheHits );
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Build replacement text.
+// Cached under expansion key and indentation of call, if key is not empty.
+template < typename Range, typename Builder >
+auto buildReplacementText( const clang::Rewriter& _rewriter,
+                           const clang::CallExpr* _callingExpression,
+                           const Range& _range,
+                           Builder&& _builder,
+                           const std::string& _expansionKey = "" )
+    -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    auto l_handlerStateLock = lockHandlerState();
+
+    const unsigned l_spellingColumnNumber =
+        getIndentationWidth( _rewriter.getSourceMgr(), _callingExpression );
     const std::string l_indentation( l_spellingColumnNumber, ' ' );
 
-    llvm::raw_string_ostream l_replacementTextStringStream( l_returnValue );
+    ExpansionCache* l_expansionCache = getExpansionCache();
+    const std::string l_expansionKey =
+        ( ( ( l_expansionCache ) && ( !_expansionKey.empty() ) )
+              ? ( _expansionKey + ":" +
+                  std::to_string( l_spellingColumnNumber ) )
+              : ( "" ) );
+
+    if ( !l_expansionKey.empty() ) {
+        const std::string* l_cachedReplacementText =
+            l_expansionCache->find( l_expansionKey );
 
-    for ( const auto* l_declaration : _range ) {
-        std::forward< Builder >( _builder )(
-            l_declaration, l_replacementTextStringStream, l_indentation );
+        if ( l_cachedReplacementText ) {
+            l_returnValue = *l_cachedReplacementText;
+
+            addStatistic( statistic::expansionCacheHits );
+
+            goto EXIT;
+        }
+
+        addStatistic( statistic::expansionCacheMisses );
     }
 
-    l_replacementTextStringStream.flush();
+    {
+        l_handlerStateLock.unlock();
+
+        l_returnValue = buildIndentedText(
+            _range, std::forward< Builder >( _builder ), l_indentation );
+
+        l_returnValue.erase( 0, l_indentation.length() );
+
+        if ( ( !l_returnValue.empty() ) && ( l_returnValue.back() == '\n' ) ) {
+            l_returnValue.pop_back();
+        }
 
-    l_returnValue.erase( 0, l_indentation.length() );
+        if ( !l_expansionKey.empty() ) {
+            l_handlerStateLock.lock();
 
-    if ( ( !l_returnValue.empty() ) && ( l_returnValue.back() == '\n' ) ) {
-        l_returnValue.pop_back();
+            l_expansionCache->store( l_expansionKey, l_returnValue );
+        }
     }
 
+EXIT:
     traceExit();
 
     return ( l_returnValue );
 }
 
 // Replace the entire call (including trailing semen/paren if present) with
-// replacement text
+// replacement text.
+// Calls coming from macro expansions would replace whole macro use, they go
+// through MacroCallSites or are left as is instead.
 static void replaceText( clang::Rewriter& rewriter,
                          const clang::CallExpr* callExpr,
                          const clang::StringRef replacementText ) {
     traceEnter();
 
+    if ( isDeferringActions() ) {
+        runOrDefer( [ &rewriter, callExpr, text = replacementText.str() ] {
+            replaceText( rewriter, callExpr, text );
+        } );
+        traceExit();
+        return;
+    }
+
     const clang::SourceManager& SM = rewriter.getSourceMgr();
     const clang::LangOptions& LO = rewriter.getLangOpts();
 
@@ -336,6 +615,11 @@ static void replaceText( clang::Rewriter& rewriter,
     // Do the replacement
     rewriter.ReplaceText( replaceRange, replacementText );
 
+    addStatistic( statistic::bytesReplaced,
+                  ( SM.getFileOffset( replaceRange.getEnd() ) -
+                    SM.getFileOffset( replaceRange.getBegin() ) ) );
+    addStatistic( statistic::bytesInserted, replacementText.size() );
+
     traceExit();
 }
 
@@ -525,7 +809,7 @@ static void replaceText( clang::Rewriter& _rewriter,
 
     _rewriter.ReplaceText( l_sourceRangeToReplace, _replacementText );
 
-    // FIX: When expanded from macro -> always empty or not yet rewritten
+    // Calls expanded from macro are rewritten by MacroCallSites
 #if 0
         // Debug existing rewritten text safely
     {
@@ -614,6 +898,8 @@ auto inferCallbackArgumentContext( const ast::MatchFinder::MatchResult& _result,
                 goto EXIT;
             }
 
+            const auto l_handlerStateLock = lockHandlerState();
+
             clang::Expected< clang::StringRef > l_sourceText =
                 clang::Lexer::getSourceText( l_sourceRange, l_sourceManager,
                                              l_langOptions );
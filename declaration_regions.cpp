@@ -0,0 +1,638 @@
+#include "declaration_regions.hpp"
+
+#include <clang/Basic/SourceManager.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Twine.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "arguments_parse.hpp"
+#include "dependencies.hpp"
+#include "log.hpp"
+#include "statistics.hpp"
+#include "structural_hash.hpp"
+#include "trace.hpp"
+
+// Line beginning with #, including ones in comments
+static auto hasDirective( const clang::StringRef _text ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    llvm::SmallVector< clang::StringRef, 64 > l_lines;
+
+    _text.split( l_lines, '\n' );
+
+    l_returnValue = std::any_of(
+        l_lines.begin(), l_lines.end(), []( const clang::StringRef _line ) {
+            return ( _line.ltrim( " \t" ).starts_with( "#" ) );
+        } );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Same as typed at file scope, empty if declaration is not at file scope or
+// has no name
+static auto buildFileScopeName( const clang::Decl* _declaration )
+    -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    if ( !_declaration->getDeclContext()->isFileContext() ) {
+        goto EXIT;
+    }
+
+    if ( const auto* l_namedDeclaration =
+             llvm::dyn_cast< clang::NamedDecl >( _declaration ) ) {
+        if ( l_namedDeclaration->getIdentifier() ) {
+            l_returnValue = l_namedDeclaration->getName().str();
+        }
+    }
+
+    // typedef struct { ... } name;
+    if ( const auto* l_tagDeclaration =
+             llvm::dyn_cast< clang::TagDecl >( _declaration ) ) {
+        if ( ( l_returnValue.empty() ) &&
+             ( l_tagDeclaration->getTypedefNameForAnonDecl() ) ) {
+            l_returnValue = l_tagDeclaration->getTypedefNameForAnonDecl()
+                                ->getName()
+                                .str();
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Offset of declaration location in main file, expansions are recorded by it
+static auto getDeclarationOffset( const clang::SourceManager& _sourceManager,
+                                  const clang::Decl* _declaration,
+                                  unsigned& _offset ) -> bool {
+    traceEnter();
+
+    const clang::SourceLocation l_location =
+        _sourceManager.getExpansionLoc( _declaration->getLocation() );
+
+    const bool l_returnValue =
+        ( ( l_location.isValid() ) &&
+          ( _sourceManager.getFileID( l_location ) ==
+            _sourceManager.getMainFileID() ) );
+
+    if ( l_returnValue ) {
+        _offset = _sourceManager.getFileOffset( l_location );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Offset in rewritten main file of original offset, before or after text
+// inserted there
+static auto getMappedOffset( const clang::Rewriter& _rewriter,
+                             const unsigned _offset,
+                             const bool _isAfterInsertions ) -> unsigned {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _rewriter.getSourceMgr();
+    const clang::SourceLocation l_fileLocation =
+        l_sourceManager.getLocForStartOfFile( l_sourceManager.getMainFileID() );
+
+    clang::Rewriter::RewriteOptions l_options;
+
+    l_options.IncludeInsertsAtEndOfRange = _isAfterInsertions;
+
+    // From beginning of file, including text inserted there
+    const int l_returnValue = _rewriter.getRangeSize(
+        clang::CharSourceRange::getCharRange(
+            l_fileLocation, l_fileLocation.getLocWithOffset( _offset ) ),
+        l_options );
+
+    traceExit();
+
+    return ( static_cast< unsigned >( std::max( l_returnValue, 0 ) ) );
+}
+
+static auto getRewrittenMainFile( const clang::Rewriter& _rewriter )
+    -> std::string {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _rewriter.getSourceMgr();
+    const clang::FileID l_fileId = l_sourceManager.getMainFileID();
+
+    const std::string l_returnValue = _rewriter.getRewrittenText(
+        clang::CharSourceRange::getCharRange(
+            l_sourceManager.getLocForStartOfFile( l_fileId ),
+            l_sourceManager.getLocForEndOfFile( l_fileId ) ) );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void DeclarationRegions::build(
+    clang::ASTContext& _context,
+    const std::vector< clang::Decl* >& _declarations,
+    std::vector< clang::Decl* >& _otherDeclarations ) {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+    const clang::StringRef l_buffer =
+        l_sourceManager.getBufferData( l_sourceManager.getMainFileID() );
+
+    std::vector< std::pair< unsigned, clang::Decl* > > l_beginnings;
+
+    for ( clang::Decl* l_declaration : _declarations ) {
+        const clang::SourceLocation l_beginLocation =
+            l_sourceManager.getExpansionLoc( l_declaration->getBeginLoc() );
+        unsigned l_offset = 0;
+
+        // Declarations of headers included after preamble
+        if ( ( l_beginLocation.isInvalid() ) ||
+             ( l_sourceManager.getFileID( l_beginLocation ) !=
+               l_sourceManager.getMainFileID() ) ||
+             ( !getDeclarationOffset( l_sourceManager, l_declaration,
+                                      l_offset ) ) ) {
+            _otherDeclarations.push_back( l_declaration );
+
+            continue;
+        }
+
+        l_beginnings.emplace_back(
+            l_sourceManager.getFileOffset( l_beginLocation ), l_declaration );
+    }
+
+    // Declarations expanded from macros may come out of order
+    std::stable_sort( l_beginnings.begin(), l_beginnings.end(),
+                      []( const std::pair< unsigned, clang::Decl* >& _left,
+                          const std::pair< unsigned, clang::Decl* >& _right ) {
+                          return ( _left.first < _right.first );
+                      } );
+
+    _currentRegions.clear();
+    _currentRegions.emplace_back();
+
+    // struct a { ... } b; - declarations beginning together share region
+    for ( const auto& [ l_offset, l_declaration ] : l_beginnings ) {
+        if ( ( _currentRegions.size() == 1 ) ||
+             ( _currentRegions.back().beginOffset != l_offset ) ) {
+            _currentRegions.emplace_back();
+            _currentRegions.back().beginOffset = l_offset;
+        }
+
+        _currentRegions.back().declarations.push_back( l_declaration );
+    }
+
+    for ( size_t l_index = 0; l_index < _currentRegions.size(); l_index++ ) {
+        CurrentRegion& l_region = _currentRegions[ l_index ];
+
+        l_region.endOffset =
+            ( ( ( l_index + 1 ) < _currentRegions.size() )
+                  ? ( _currentRegions[ l_index + 1 ].beginOffset )
+                  : ( static_cast< unsigned >( l_buffer.size() ) ) );
+        l_region.text = l_buffer.slice( l_region.beginOffset,
+                                        l_region.endOffset );
+
+        const size_t l_lineBreak =
+            l_buffer.rfind( '\n', l_region.beginOffset );
+
+        l_region.linePrefix = l_buffer.slice(
+            ( ( l_lineBreak == clang::StringRef::npos ) ? ( 0 )
+                                                        : ( l_lineBreak + 1 ) ),
+            l_region.beginOffset );
+    }
+
+    logVariable( _currentRegions.size() );
+
+    traceExit();
+}
+
+auto DeclarationRegions::resolve( clang::ASTContext& _context,
+                                  const std::vector< size_t >& _currentIndices,
+                                  const Dependency& _dependency ) const
+    -> const clang::Decl* {
+    traceEnter();
+
+    const clang::Decl* l_returnValue = nullptr;
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+
+    const size_t l_currentIndex = _currentIndices[ _dependency.regionIndex ];
+
+    // Region is same, declaration is at same offset in it
+    if ( l_currentIndex != g_noRegion ) {
+        const CurrentRegion& l_region = _currentRegions[ l_currentIndex ];
+        const unsigned l_offset =
+            ( l_region.beginOffset + _dependency.offset );
+
+        std::vector< const clang::Decl* > l_declarations(
+            l_region.declarations.begin(), l_region.declarations.end() );
+
+        // Nested records, fields, parameters and variables of functions
+        while ( !l_declarations.empty() ) {
+            const clang::Decl* l_declaration = l_declarations.back();
+            unsigned l_declarationOffset = 0;
+
+            l_declarations.pop_back();
+
+            if ( ( l_declaration->getKind() == _dependency.kind ) &&
+                 ( getDeclarationOffset( l_sourceManager, l_declaration,
+                                         l_declarationOffset ) ) &&
+                 ( l_declarationOffset == l_offset ) ) {
+                l_returnValue = l_declaration;
+
+                goto EXIT;
+            }
+
+            if ( const auto* l_function =
+                     llvm::dyn_cast< clang::FunctionDecl >( l_declaration ) ) {
+                l_declarations.insert( l_declarations.end(),
+                                       l_function->param_begin(),
+                                       l_function->param_end() );
+            }
+
+            if ( const auto* l_declarationContext =
+                     llvm::dyn_cast< clang::DeclContext >( l_declaration ) ) {
+                l_declarations.insert( l_declarations.end(),
+                                       l_declarationContext->decls_begin(),
+                                       l_declarationContext->decls_end() );
+            }
+        }
+    }
+
+    if ( _dependency.name.empty() ) {
+        goto EXIT;
+    }
+
+    // Region changed, declaration may have not
+    for ( const clang::NamedDecl* l_namedDeclaration :
+          _context.getTranslationUnitDecl()->lookup(
+              &( _context.Idents.get( _dependency.name ) ) ) ) {
+        const clang::Decl* l_declaration = l_namedDeclaration;
+
+        // typedef struct { ... } name;
+        if ( const auto* l_typedefDeclaration =
+                 llvm::dyn_cast< clang::TypedefNameDecl >(
+                     l_namedDeclaration ) ) {
+            if ( const clang::TagDecl* l_tagDeclaration =
+                     l_typedefDeclaration->getAnonDeclWithTypedefName() ) {
+                l_declaration = l_tagDeclaration;
+            }
+        }
+
+        if ( const auto* l_tagDeclaration =
+                 llvm::dyn_cast< clang::TagDecl >( l_declaration ) ) {
+            l_declaration = l_tagDeclaration->getDefinition();
+        }
+
+        unsigned l_declarationOffset = 0;
+
+        if ( ( l_declaration ) &&
+             ( l_declaration->getKind() == _dependency.kind ) &&
+             ( getDeclarationOffset( l_sourceManager, l_declaration,
+                                     l_declarationOffset ) ) ) {
+            l_returnValue = l_declaration;
+
+            break;
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto DeclarationRegions::findRegion( const clang::SourceManager& _sourceManager,
+                                     clang::SourceLocation _location ) const
+    -> size_t {
+    traceEnter();
+
+    size_t l_returnValue = g_noRegion;
+
+    _location = _sourceManager.getExpansionLoc( _location );
+
+    if ( ( _location.isInvalid() ) ||
+         ( _sourceManager.getFileID( _location ) !=
+           _sourceManager.getMainFileID() ) ) {
+        goto EXIT;
+    }
+
+    {
+        const unsigned l_offset = _sourceManager.getFileOffset( _location );
+
+        // After last region beginning at or before location, first one
+        // begins at 0
+        const auto l_region = std::upper_bound(
+            _currentRegions.begin(), _currentRegions.end(), l_offset,
+            []( const unsigned _offset, const CurrentRegion& _region ) {
+                return ( _offset < _region.beginOffset );
+            } );
+
+        l_returnValue = static_cast< size_t >(
+            std::prev( l_region ) - _currentRegions.begin() );
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto DeclarationRegions::plan( clang::ASTContext& _context,
+                               const std::vector< clang::Decl* >& _declarations,
+                               const bool _canReuse )
+    -> std::vector< clang::Decl* > {
+    traceEnter();
+
+    std::vector< clang::Decl* > l_returnValue;
+
+    build( _context, _declarations, l_returnValue );
+
+    // Semantic dependencies and layout report list what every expansion read
+    const bool l_canReuse = ( ( _canReuse ) && ( !_regions.empty() ) &&
+                              ( !g_needSemanticDependencies ) &&
+                              ( g_layoutReportFilePath.empty() ) &&
+                              ( g_layoutReorderFilePath.empty() ) );
+
+    if ( !l_canReuse ) {
+        l_returnValue = _declarations;
+
+        goto EXIT;
+    }
+
+    {
+        // Of previous request by line prefix and text, earliest last
+        llvm::StringMap< llvm::SmallVector< size_t, 1 > > l_previousIndices;
+
+        for ( size_t l_index = _regions.size(); l_index > 0; l_index-- ) {
+            const Region& l_region = _regions[ l_index - 1 ];
+
+            l_previousIndices[ l_region.linePrefix + "\n" + l_region.text ]
+                .push_back( l_index - 1 );
+        }
+
+        // Of current request by previous index
+        std::vector< size_t > l_currentIndices( _regions.size(), g_noRegion );
+
+        for ( size_t l_index = 0; l_index < _currentRegions.size();
+              l_index++ ) {
+            CurrentRegion& l_region = _currentRegions[ l_index ];
+
+            const auto l_iterator = l_previousIndices.find(
+                ( l_region.linePrefix + "\n" + l_region.text ).str() );
+
+            if ( ( l_iterator == l_previousIndices.end() ) ||
+                 ( l_iterator->second.empty() ) ) {
+                continue;
+            }
+
+            l_region.previousIndex = l_iterator->second.pop_back_val();
+            l_currentIndices[ l_region.previousIndex ] = l_index;
+        }
+
+        // Macros may expand differently in every region
+        const bool l_hasDirectiveChanged =
+            ( ( std::any_of( _currentRegions.begin(), _currentRegions.end(),
+                             []( const CurrentRegion& _region ) {
+                                 return ( ( _region.previousIndex ==
+                                            g_noRegion ) &&
+                                          ( hasDirective( _region.text ) ) );
+                             } ) ) ||
+              ( std::any_of( l_previousIndices.begin(),
+                             l_previousIndices.end(),
+                             [ this ]( const auto& _entry ) {
+                                 return ( std::any_of(
+                                     _entry.second.begin(),
+                                     _entry.second.end(),
+                                     [ this ]( const size_t _index ) {
+                                         return ( hasDirective(
+                                             _regions[ _index ].text ) );
+                                     } ) );
+                             } ) ) );
+
+        if ( l_hasDirectiveChanged ) {
+            log( "Preprocessor directive changed, processing every "
+                 "declaration" );
+
+            l_returnValue = _declarations;
+
+            goto EXIT;
+        }
+
+        // First region has no declarations to skip
+        for ( size_t l_index = 1; l_index < _currentRegions.size();
+              l_index++ ) {
+            CurrentRegion& l_region = _currentRegions[ l_index ];
+
+            if ( ( l_region.previousIndex == g_noRegion ) ||
+                 ( _regions[ l_region.previousIndex ].isShared ) ) {
+                l_returnValue.insert( l_returnValue.end(),
+                                      l_region.declarations.begin(),
+                                      l_region.declarations.end() );
+
+                continue;
+            }
+
+            l_region.isReused = true;
+
+            for ( const Dependency& l_dependency :
+                  _regions[ l_region.previousIndex ].dependencies ) {
+                const clang::Decl* l_declaration =
+                    resolve( _context, l_currentIndices, l_dependency );
+
+                if ( ( !l_declaration ) ||
+                     ( buildStructuralHash( _context, l_declaration ) !=
+                       l_dependency.structuralHash ) ) {
+                    l_region.isReused = false;
+
+                    break;
+                }
+
+                l_region.dependencies.push_back( l_declaration );
+            }
+
+            if ( !l_region.isReused ) {
+                l_region.dependencies.clear();
+
+                l_returnValue.insert( l_returnValue.end(),
+                                      l_region.declarations.begin(),
+                                      l_region.declarations.end() );
+            }
+        }
+    }
+
+EXIT:
+    logVariable( l_returnValue.size() );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto DeclarationRegions::reuse( clang::Rewriter& _rewriter ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    const clang::SourceManager& l_sourceManager = _rewriter.getSourceMgr();
+    const clang::SourceLocation l_fileLocation =
+        l_sourceManager.getLocForStartOfFile( l_sourceManager.getMainFileID() );
+    const std::string l_rewrittenFile = getRewrittenMainFile( _rewriter );
+
+    // Text inserted at either end belongs to neighbouring region
+    for ( const CurrentRegion& l_region : _currentRegions ) {
+        if ( !l_region.isReused ) {
+            continue;
+        }
+
+        const unsigned l_beginOffset =
+            getMappedOffset( _rewriter, l_region.beginOffset, true );
+        const unsigned l_endOffset =
+            getMappedOffset( _rewriter, l_region.endOffset, false );
+
+        if ( clang::StringRef( l_rewrittenFile )
+                 .slice( l_beginOffset, l_endOffset ) != l_region.text ) {
+            log( "Reused declaration rewritten by handlers of other "
+                 "declarations, processing every declaration" );
+
+            l_returnValue = false;
+
+            goto EXIT;
+        }
+    }
+
+    for ( const CurrentRegion& l_region : _currentRegions ) {
+        if ( !l_region.isReused ) {
+            continue;
+        }
+
+        const std::string& l_previousRewrittenText =
+            _regions[ l_region.previousIndex ].rewrittenText;
+
+        if ( l_previousRewrittenText != l_region.text ) {
+            _rewriter.ReplaceText(
+                l_fileLocation.getLocWithOffset( l_region.beginOffset ),
+                ( l_region.endOffset - l_region.beginOffset ),
+                l_previousRewrittenText );
+        }
+
+        addStatistic( statistic::reusedDeclarations,
+                      l_region.declarations.size() );
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void DeclarationRegions::record( clang::ASTContext& _context,
+                                 const clang::Rewriter& _rewriter ) {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+    const clang::SourceLocation l_fileLocation =
+        l_sourceManager.getLocForStartOfFile( l_sourceManager.getMainFileID() );
+    const std::string l_rewrittenFile = getRewrittenMainFile( _rewriter );
+
+    std::vector< Region > l_regions( _currentRegions.size() );
+    std::vector< llvm::SmallVector< const clang::Decl*, 4 > > l_dependencies(
+        _currentRegions.size() );
+
+    for ( size_t l_index = 0; l_index < _currentRegions.size(); l_index++ ) {
+        const CurrentRegion& l_currentRegion = _currentRegions[ l_index ];
+        Region& l_region = l_regions[ l_index ];
+
+        // Text inserted at beginning belongs to region, at end to next one
+        const unsigned l_beginOffset =
+            getMappedOffset( _rewriter, l_currentRegion.beginOffset, false );
+        const unsigned l_endOffset =
+            ( ( ( l_index + 1 ) < _currentRegions.size() )
+                  ? ( getMappedOffset( _rewriter, l_currentRegion.endOffset,
+                                       false ) )
+                  : ( static_cast< unsigned >( l_rewrittenFile.size() ) ) );
+
+        l_region.linePrefix = l_currentRegion.linePrefix.str();
+        l_region.text = l_currentRegion.text.str();
+        l_region.rewrittenText =
+            clang::StringRef( l_rewrittenFile )
+                .slice( l_beginOffset, l_endOffset )
+                .str();
+
+        // Text inserted between regions is written by handlers of either
+        l_region.isShared =
+            ( ( getMappedOffset( _rewriter, l_currentRegion.beginOffset,
+                                 true ) != l_beginOffset ) ||
+              ( getMappedOffset( _rewriter, l_currentRegion.endOffset,
+                                 true ) != l_endOffset ) );
+
+        l_dependencies[ l_index ].assign(
+            l_currentRegion.dependencies.begin(),
+            l_currentRegion.dependencies.end() );
+    }
+
+    if ( const LocationDependencies* l_locationDependencies =
+             getLocationDependencies( _context ) ) {
+        for ( const auto& [ l_location, l_declaration ] :
+              l_locationDependencies->declarations ) {
+            const size_t l_index = findRegion( l_sourceManager, l_location );
+
+            if ( l_index != g_noRegion ) {
+                l_dependencies[ l_index ].push_back( l_declaration );
+            }
+        }
+
+        for ( const clang::SourceLocation l_location :
+              l_locationDependencies->sharedLocations ) {
+            const size_t l_index = findRegion( l_sourceManager, l_location );
+
+            if ( l_index != g_noRegion ) {
+                l_regions[ l_index ].isShared = true;
+            }
+        }
+    }
+
+    // Declarations of headers are same while included files are
+    for ( size_t l_index = 0; l_index < l_regions.size(); l_index++ ) {
+        llvm::SmallPtrSet< const clang::Decl*, 8 > l_recordedDeclarations;
+
+        for ( const clang::Decl* l_declaration : l_dependencies[ l_index ] ) {
+            unsigned l_offset = 0;
+
+            if ( ( !l_recordedDeclarations.insert( l_declaration ).second ) ||
+                 ( !getDeclarationOffset( l_sourceManager, l_declaration,
+                                          l_offset ) ) ) {
+                continue;
+            }
+
+            Dependency l_dependency;
+
+            l_dependency.kind = l_declaration->getKind();
+            l_dependency.regionIndex = findRegion(
+                l_sourceManager, l_fileLocation.getLocWithOffset( l_offset ) );
+            l_dependency.offset =
+                ( l_offset -
+                  _currentRegions[ l_dependency.regionIndex ].beginOffset );
+            l_dependency.name = buildFileScopeName( l_declaration );
+            l_dependency.structuralHash =
+                buildStructuralHash( _context, l_declaration );
+
+            l_regions[ l_index ].dependencies.push_back(
+                std::move( l_dependency ) );
+        }
+    }
+
+    _regions = std::move( l_regions );
+    _currentRegions.clear();
+
+    traceExit();
+}
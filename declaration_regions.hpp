@@ -0,0 +1,100 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Main file of translation unit kept by incremental/ watch run, split at
+// beginnings of top level declarations into regions, text before first
+// declaration being first region.
+// What handlers read and wrote per region is kept between requests, so region
+// is reused while its text is same, declarations its expansions read (see
+// addSemanticDependency) have same structural hash and nothing written into it
+// is shared with other regions (see addSharedLocation): handlers do not run
+// for its declarations, its rewritten text of previous request replaces it.
+// Every region is processed again once included file besides system headers
+// or preprocessor directive of main file changes, as macros may expand
+// differently.
+class DeclarationRegions {
+public:
+    // After parse, before handlers run, _declarations being top level
+    // declarations parsed after preamble.
+    // Declarations to run handlers for, every one unless _canReuse.
+    auto plan( clang::ASTContext& _context,
+               const std::vector< clang::Decl* >& _declarations,
+               const bool _canReuse ) -> std::vector< clang::Decl* >;
+
+    // After handlers ran, text of reused regions is replaced by rewritten
+    // text of previous request.
+    // False if handlers of other regions rewrote reused one, then nothing is
+    // replaced and every declaration has to be processed again.
+    auto reuse( clang::Rewriter& _rewriter ) -> bool;
+
+    // After handlers ran, kept for next request
+    void record( clang::ASTContext& _context,
+                 const clang::Rewriter& _rewriter );
+
+private:
+    // Index of region outside of main file
+    static constexpr size_t g_noRegion = SIZE_MAX;
+
+    // Declaration read by expansions of region, in main file
+    struct Dependency {
+        clang::Decl::Kind kind = clang::Decl::Kind::TranslationUnit;
+        size_t regionIndex = 0;
+        // Of location, from beginning of region
+        unsigned offset = 0;
+        // Looked up at file scope once its region changed, empty if
+        // declaration is not there
+        std::string name;
+        std::string structuralHash;
+    };
+
+    // Of previous request
+    struct Region {
+        // Text before region on its line, expansions are indented by it
+        std::string linePrefix;
+        std::string text;
+        std::string rewrittenText;
+        // Written together with other regions or by handlers of other
+        // regions
+        bool isShared = false;
+        std::vector< Dependency > dependencies;
+    };
+
+    // Of current request
+    struct CurrentRegion {
+        unsigned beginOffset = 0;
+        unsigned endOffset = 0;
+        clang::StringRef linePrefix;
+        clang::StringRef text;
+        std::vector< clang::Decl* > declarations;
+        // Same region of previous request, if text is same
+        size_t previousIndex = g_noRegion;
+        bool isReused = false;
+        // Resolved dependencies of previous request, if reused
+        std::vector< const clang::Decl* > dependencies;
+    };
+
+    void build( clang::ASTContext& _context,
+                const std::vector< clang::Decl* >& _declarations,
+                std::vector< clang::Decl* >& _otherDeclarations );
+
+    // Same declaration in current request, nullptr if it is gone
+    auto resolve( clang::ASTContext& _context,
+                  const std::vector< size_t >& _currentIndices,
+                  const Dependency& _dependency ) const
+        -> const clang::Decl*;
+
+    // Of main file location
+    auto findRegion( const clang::SourceManager& _sourceManager,
+                     clang::SourceLocation _location ) const -> size_t;
+
+    std::vector< Region > _regions;
+    std::vector< CurrentRegion > _currentRegions;
+};
@@ -0,0 +1,346 @@
+#include "dependencies.hpp"
+
+#include <clang/Basic/SourceManager.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SetVector.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "arguments_parse.hpp"
+#include "log.hpp"
+#include "parallel_match.hpp"
+#include "structural_hash.hpp"
+#include "trace.hpp"
+
+// In recording order
+static llvm::DenseMap< const clang::ASTContext*,
+                       llvm::SetVector< const clang::Decl* > >
+    g_semanticDependencies;
+static llvm::DenseMap< const clang::ASTContext*, LocationDependencies >
+    g_locationDependencies;
+
+// Escaped for Make, Ninja accepts same escaping
+static void writeDependencyFileName( llvm::raw_ostream& _stream,
+                                     const clang::StringRef _fileName ) {
+    traceEnter();
+
+    for ( const char l_character : _fileName ) {
+        if ( ( l_character == ' ' ) || ( l_character == '#' ) ) {
+            _stream << '\\';
+
+        } else if ( l_character == '$' ) {
+            _stream << '$';
+        }
+
+        _stream << l_character;
+    }
+
+    traceExit();
+}
+
+static auto buildDeclarationName( const clang::Decl* _declaration )
+    -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    if ( const auto* l_namedDeclaration =
+             llvm::dyn_cast< clang::NamedDecl >( _declaration ) ) {
+        l_returnValue = l_namedDeclaration->getQualifiedNameAsString();
+    }
+
+    // typedef struct { ... } name;
+    if ( const auto* l_tagDeclaration =
+             llvm::dyn_cast< clang::TagDecl >( _declaration ) ) {
+        if ( ( l_returnValue.empty() ) &&
+             ( l_tagDeclaration->getTypedefNameForAnonDecl() ) ) {
+            l_returnValue = l_tagDeclaration->getTypedefNameForAnonDecl()
+                                ->getNameAsString();
+        }
+    }
+
+    if ( l_returnValue.empty() ) {
+        l_returnValue = "(anonymous)";
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+static auto writeDepfile( const clang::SourceManager& _sourceManager,
+                          const clang::StringRef _outputPath,
+                          const std::string& _filePath ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    std::error_code l_errorCode;
+
+    llvm::raw_fd_ostream l_outputFile( _filePath, l_errorCode,
+                                       llvm::sys::fs::OF_Text );
+
+    l_returnValue = !( l_errorCode );
+
+    if ( !l_returnValue ) {
+        logError( l_errorCode.message() );
+
+        goto EXIT;
+    }
+
+    {
+        const clang::OptionalFileEntryRef l_mainFile =
+            _sourceManager.getFileEntryRefForID(
+                _sourceManager.getMainFileID() );
+
+        std::vector< std::string > l_files;
+
+        for ( auto l_iterator = _sourceManager.fileinfo_begin();
+              l_iterator != _sourceManager.fileinfo_end(); l_iterator++ ) {
+            const clang::FileEntryRef l_file = l_iterator->first;
+
+            if ( ( l_mainFile ) &&
+                 ( l_file.getUID() == l_mainFile->getUID() ) ) {
+                continue;
+            }
+
+            l_files.push_back( l_file.getName().str() );
+        }
+
+        // Stable between runs
+        std::sort( l_files.begin(), l_files.end() );
+        l_files.erase( std::unique( l_files.begin(), l_files.end() ),
+                       l_files.end() );
+
+        // output: input header... (one per line)
+        writeDependencyFileName( l_outputFile, _outputPath );
+
+        l_outputFile << ":";
+
+        if ( l_mainFile ) {
+            l_outputFile << " ";
+
+            writeDependencyFileName( l_outputFile, l_mainFile->getName() );
+        }
+
+        for ( const std::string& l_file : l_files ) {
+            l_outputFile << " \\\n  ";
+
+            writeDependencyFileName( l_outputFile, l_file );
+        }
+
+        l_outputFile << "\n";
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+static auto writeSemanticDependencyFile( const clang::ASTContext& _context,
+                                         const std::string& _filePath )
+    -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    std::error_code l_errorCode;
+
+    llvm::raw_fd_ostream l_outputFile( _filePath, l_errorCode,
+                                       llvm::sys::fs::OF_Text );
+
+    l_returnValue = !( l_errorCode );
+
+    if ( !l_returnValue ) {
+        logError( l_errorCode.message() );
+
+        goto EXIT;
+    }
+
+    {
+        const clang::SourceManager& l_sourceManager =
+            _context.getSourceManager();
+
+        const auto l_iterator = g_semanticDependencies.find( &_context );
+
+        if ( l_iterator == g_semanticDependencies.end() ) {
+            goto EXIT;
+        }
+
+        for ( const clang::Decl* l_declaration : l_iterator->second ) {
+            const clang::PresumedLoc l_location =
+                l_sourceManager.getPresumedLoc(
+                    l_sourceManager.getExpansionLoc(
+                        l_declaration->getLocation() ) );
+
+            l_outputFile << l_declaration->getDeclKindName() << "\t"
+                         << buildDeclarationName( l_declaration ) << "\t";
+
+            if ( l_location.isValid() ) {
+                l_outputFile << l_location.getFilename() << ":"
+                             << l_location.getLine();
+            }
+
+            l_outputFile << "\t" << buildStructuralHash( _context,
+                                                         l_declaration )
+                         << "\n";
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void clearSemanticDependencies( const clang::ASTContext& _context ) {
+    traceEnter();
+
+    g_semanticDependencies.erase( &_context );
+    g_locationDependencies.erase( &_context );
+
+    traceExit();
+}
+
+void addSemanticDependency( const clang::ASTContext& _context,
+                            const clang::SourceLocation _location,
+                            const clang::Decl* _declaration ) {
+    traceEnter();
+
+    const bool l_needLocation = ( ( g_isIncrementalRun ) || ( g_isWatchRun ) );
+
+    if ( ( ( !g_needSemanticDependencies ) && ( !l_needLocation ) ) ||
+         ( !_declaration ) ) {
+        goto EXIT;
+    }
+
+    runOrDefer( [ &_context, _location, _declaration, l_needLocation ] {
+        if ( g_needSemanticDependencies ) {
+            g_semanticDependencies[ &_context ].insert( _declaration );
+        }
+
+        if ( l_needLocation ) {
+            g_locationDependencies[ &_context ].declarations.emplace_back(
+                _location, _declaration );
+        }
+    } );
+
+EXIT:
+    traceExit();
+}
+
+void addSharedLocation( const clang::ASTContext& _context,
+                        const clang::SourceLocation _location ) {
+    traceEnter();
+
+    if ( ( !g_isIncrementalRun ) && ( !g_isWatchRun ) ) {
+        goto EXIT;
+    }
+
+    runOrDefer( [ &_context, _location ] {
+        g_locationDependencies[ &_context ].sharedLocations.push_back(
+            _location );
+    } );
+
+EXIT:
+    traceExit();
+}
+
+auto getLocationDependencies( const clang::ASTContext& _context )
+    -> const LocationDependencies* {
+    traceEnter();
+
+    const LocationDependencies* l_returnValue = nullptr;
+
+    const auto l_iterator = g_locationDependencies.find( &_context );
+
+    if ( l_iterator != g_locationDependencies.end() ) {
+        l_returnValue = &( l_iterator->second );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto writeDependencyFiles( const clang::ASTContext& _context,
+                           const clang::StringRef _outputPath ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    if ( g_needDepfile ) {
+        l_returnValue =
+            ( writeDepfile( _context.getSourceManager(), _outputPath,
+                            ( _outputPath + ".d" ).str() ) &&
+              l_returnValue );
+    }
+
+    if ( g_needSemanticDependencies ) {
+        l_returnValue = ( writeSemanticDependencyFile(
+                              _context, ( _outputPath + ".sdeps" ).str() ) &&
+                          l_returnValue );
+    }
+
+    clearSemanticDependencies( _context );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto writePassthroughDependencyFiles( const clang::StringRef _inputPath,
+                                      const clang::StringRef _outputPath )
+    -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    if ( g_needDepfile ) {
+        std::error_code l_errorCode;
+
+        llvm::raw_fd_ostream l_outputFile( ( _outputPath + ".d" ).str(),
+                                           l_errorCode,
+                                           llvm::sys::fs::OF_Text );
+
+        if ( l_errorCode ) {
+            logError( l_errorCode.message() );
+
+            l_returnValue = false;
+
+        } else {
+            // output: input
+            writeDependencyFileName( l_outputFile, _outputPath );
+
+            l_outputFile << ": ";
+
+            writeDependencyFileName( l_outputFile, _inputPath );
+
+            l_outputFile << "\n";
+        }
+    }
+
+    // No declarations
+    if ( g_needSemanticDependencies ) {
+        std::error_code l_errorCode;
+
+        llvm::raw_fd_ostream l_outputFile( ( _outputPath + ".sdeps" ).str(),
+                                           l_errorCode,
+                                           llvm::sys::fs::OF_Text );
+
+        if ( l_errorCode ) {
+            logError( l_errorCode.message() );
+
+            l_returnValue = false;
+        }
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
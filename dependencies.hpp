@@ -0,0 +1,50 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/Basic/SourceLocation.h>
+
+#include <utility>
+#include <vector>
+
+// Forget declarations/ locations recorded for translation unit, before its
+// handlers run
+void clearSemanticDependencies( const clang::ASTContext& _context );
+
+// Declaration expansion/ generated code at location of translation unit
+// depends on
+void addSemanticDependency( const clang::ASTContext& _context,
+                            const clang::SourceLocation _location,
+                            const clang::Decl* _declaration );
+
+// Location of expansion/ generated code written together with other top level
+// declarations of main file: macro call sites, shared expansion functions,
+// JSON helpers, where they are used and where they are inserted
+void addSharedLocation( const clang::ASTContext& _context,
+                        const clang::SourceLocation _location );
+
+// Recorded by incremental and watch run only, see DeclarationRegions
+struct LocationDependencies {
+    // In recording order
+    std::vector< std::pair< clang::SourceLocation, const clang::Decl* > >
+        declarations;
+    std::vector< clang::SourceLocation > sharedLocations;
+};
+
+// nullptr if nothing was recorded
+auto getLocationDependencies( const clang::ASTContext& _context )
+    -> const LocationDependencies*;
+
+// Next to output path, as requested by arguments:
+// output.d - Makefile/ Ninja depfile with every file translation unit read
+// output.sdeps - recorded declarations, one per line
+//   "kind<TAB>name<TAB>file:line<TAB>structural hash", regeneration can be
+//   skipped while every hash is same
+auto writeDependencyFiles( const clang::ASTContext& _context,
+                           const clang::StringRef _outputPath ) -> bool;
+
+// Same files for input passed through without parsing, depending on input
+// only
+auto writePassthroughDependencyFiles( const clang::StringRef _inputPath,
+                                      const clang::StringRef _outputPath )
+    -> bool;
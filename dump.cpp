@@ -0,0 +1,444 @@
+#include "dump.hpp"
+
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Lex/Lexer.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "arguments_parse.hpp"
+#include "dump_format.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+// Every string is stored once, nodes/ tokens refer to it by offset
+class DumpStringTable {
+public:
+    DumpStringTable() : _data( 1, '\0' ) {}
+
+    auto intern( const clang::StringRef _text ) -> uint32_t {
+        if ( _text.empty() ) {
+            return ( 0 );
+        }
+
+        const auto [ l_iterator, l_isInserted ] =
+            _offsets.try_emplace( _text, _data.size() );
+
+        if ( l_isInserted ) {
+            _data.append( _text.data(), _text.size() );
+            _data.push_back( '\0' );
+        }
+
+        return ( l_iterator->second );
+    }
+
+    auto data() const -> const std::string& { return ( _data ); }
+
+private:
+    llvm::StringMap< uint32_t > _offsets;
+    std::string _data;
+};
+
+class DumpASTVisitor : public clang::RecursiveASTVisitor< DumpASTVisitor > {
+public:
+    DumpASTVisitor( const clang::SourceManager& _sourceManager,
+                    DumpStringTable& _strings,
+                    bool _needInternal )
+        : _sourceManager( _sourceManager ),
+          _strings( _strings ),
+          _needInternal( _needInternal ) {}
+
+    auto TraverseDecl( clang::Decl* _declaration ) -> bool {
+        if ( !_declaration ) {
+            return ( true );
+        }
+
+        if ( clang::isa< clang::TranslationUnitDecl >( _declaration ) ) {
+            return ( RecursiveASTVisitor::TraverseDecl( _declaration ) );
+        }
+
+        // Only main file declarations, with everything nested in them
+        if ( !_sourceManager.isInMainFile(
+                 _sourceManager.getExpansionLoc(
+                     _declaration->getLocation() ) ) ) {
+            return ( true );
+        }
+
+        std::string l_name;
+        clang::QualType l_type;
+
+        if ( const auto* l_namedDeclaration =
+                 clang::dyn_cast< clang::NamedDecl >( _declaration ) ) {
+            l_name = l_namedDeclaration->getNameAsString();
+        }
+
+        if ( const auto* l_valueDeclaration =
+                 clang::dyn_cast< clang::ValueDecl >( _declaration ) ) {
+            l_type = l_valueDeclaration->getType();
+        }
+
+        openNode( ( std::string( _declaration->getDeclKindName() ) + "Decl" ),
+                  l_name, l_type, _declaration->getSourceRange(),
+                  _declaration, _declaration->getKind(), false );
+
+        const bool l_returnValue =
+            RecursiveASTVisitor::TraverseDecl( _declaration );
+
+        closeNode();
+
+        return ( l_returnValue );
+    }
+
+    auto TraverseStmt( clang::Stmt* _statement,
+                       DataRecursionQueue* _queue = nullptr ) -> bool {
+        if ( !_statement ) {
+            return ( true );
+        }
+
+        std::string l_name;
+        clang::QualType l_type;
+
+        if ( const auto* l_declarationReference =
+                 clang::dyn_cast< clang::DeclRefExpr >( _statement ) ) {
+            l_name = l_declarationReference->getNameInfo().getAsString();
+
+        } else if ( const auto* l_memberExpression =
+                        clang::dyn_cast< clang::MemberExpr >( _statement ) ) {
+            l_name = l_memberExpression->getMemberNameInfo().getAsString();
+
+        } else if ( const auto* l_integerLiteral =
+                        clang::dyn_cast< clang::IntegerLiteral >(
+                            _statement ) ) {
+            l_name = llvm::toString(
+                l_integerLiteral->getValue(), 10,
+                l_integerLiteral->getType()->isSignedIntegerType() );
+        }
+
+        if ( const auto* l_expression =
+                 clang::dyn_cast< clang::Expr >( _statement ) ) {
+            l_type = l_expression->getType();
+        }
+
+        openNode( _statement->getStmtClassName(), l_name, l_type,
+                  _statement->getSourceRange(), _statement,
+                  _statement->getStmtClass(), true );
+
+        // Without queue children are traversed recursively, after this node
+        const bool l_returnValue =
+            RecursiveASTVisitor::TraverseStmt( _statement, nullptr );
+
+        closeNode();
+
+        return ( l_returnValue );
+    }
+
+    auto nodes() const -> const std::vector< dump::Node >& {
+        return ( _nodes );
+    }
+
+    auto internalNodes() const -> const std::vector< dump::InternalNode >& {
+        return ( _internalNodes );
+    }
+
+private:
+    void openNode( const clang::StringRef _kind,
+                   const clang::StringRef _name,
+                   const clang::QualType _type,
+                   const clang::SourceRange _sourceRange,
+                   const void* _address,
+                   const uint32_t _clangKind,
+                   const bool _isStatement ) {
+        const uint32_t l_index = _nodes.size();
+
+        const uint32_t l_type =
+            ( ( _type.isNull() )
+                  ? ( 0 )
+                  : ( _strings.intern( getTypeName( _type ) ) ) );
+
+        dump::Node l_node = {
+            _strings.intern( _kind ),
+            _strings.intern( _name ),
+            l_type,
+            dump::g_none,
+            dump::g_none,
+            dump::g_none,
+            dump::g_none,
+            dump::g_none,
+            0,
+            0 };
+
+        // Offsets of first/ last token, end of token is not lexed
+        {
+            const clang::SourceLocation l_beginLocation =
+                _sourceManager.getExpansionLoc( _sourceRange.getBegin() );
+            const clang::SourceLocation l_endLocation =
+                _sourceManager.getExpansionLoc( _sourceRange.getEnd() );
+
+            if ( _sourceManager.isWrittenInMainFile( l_beginLocation ) ) {
+                const std::pair< clang::FileID, unsigned >
+                    l_decomposedLocation =
+                        _sourceManager.getDecomposedLoc( l_beginLocation );
+
+                l_node.beginOffset = l_decomposedLocation.second;
+                l_node.line = _sourceManager.getLineNumber(
+                    l_decomposedLocation.first, l_decomposedLocation.second );
+                l_node.column = _sourceManager.getColumnNumber(
+                    l_decomposedLocation.first, l_decomposedLocation.second );
+            }
+
+            if ( _sourceManager.isWrittenInMainFile( l_endLocation ) ) {
+                l_node.endOffset =
+                    _sourceManager.getFileOffset( l_endLocation );
+            }
+        }
+
+        if ( !_openNodes.empty() ) {
+            OpenNode& l_parent = _openNodes.back();
+
+            l_node.parent = l_parent.index;
+
+            if ( l_parent.lastChild == dump::g_none ) {
+                _nodes[ l_parent.index ].firstChild = l_index;
+
+            } else {
+                _nodes[ l_parent.lastChild ].nextSibling = l_index;
+            }
+
+            l_parent.lastChild = l_index;
+        }
+
+        _nodes.push_back( l_node );
+
+        if ( _needInternal ) {
+            _internalNodes.push_back(
+                { reinterpret_cast< uint64_t >( _address ), _clangKind,
+                  _isStatement } );
+        }
+
+        _openNodes.push_back( { l_index, dump::g_none } );
+    }
+
+    void closeNode() { _openNodes.pop_back(); }
+
+    // Same types are printed once
+    auto getTypeName( const clang::QualType _type ) -> const std::string& {
+        std::string& l_typeName = _typeNames[ _type.getAsOpaquePtr() ];
+
+        if ( l_typeName.empty() ) {
+            l_typeName = _type.getAsString();
+        }
+
+        return ( l_typeName );
+    }
+
+    struct OpenNode {
+        uint32_t index;
+        uint32_t lastChild;
+    };
+
+    const clang::SourceManager& _sourceManager;
+    DumpStringTable& _strings;
+    bool _needInternal;
+    std::vector< dump::Node > _nodes;
+    std::vector< dump::InternalNode > _internalNodes;
+    std::vector< OpenNode > _openNodes;
+    llvm::DenseMap< void*, std::string > _typeNames;
+};
+
+static auto lexTokens( const clang::StringRef _buffer,
+                       const clang::SourceLocation _fileLocation,
+                       const clang::LangOptions& _langOptions,
+                       DumpStringTable& _strings )
+    -> std::vector< dump::Token > {
+    traceEnter();
+
+    std::vector< dump::Token > l_returnValue;
+
+    // Raw lexer, no preprocessing, same as written
+    clang::Lexer l_lexer( _fileLocation, _langOptions, _buffer.begin(),
+                          _buffer.begin(), _buffer.end() );
+    clang::Token l_token;
+
+    while ( true ) {
+        l_lexer.LexFromRawLexer( l_token );
+
+        if ( l_token.is( clang::tok::eof ) ) {
+            break;
+        }
+
+        const uint32_t l_length = l_token.getLength();
+        const uint32_t l_offset =
+            ( ( l_lexer.getBufferLocation() - _buffer.begin() ) - l_length );
+        uint32_t l_flags = 0;
+
+        if ( l_token.isAtStartOfLine() ) {
+            l_flags |= dump::startOfLine;
+        }
+
+        if ( l_token.hasLeadingSpace() ) {
+            l_flags |= dump::leadingSpace;
+        }
+
+        l_returnValue.push_back(
+            { _strings.intern( clang::tok::getTokenName( l_token.getKind() ) ),
+              _strings.intern( _buffer.substr( l_offset, l_length ) ),
+              l_offset, l_flags } );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto writeDump( clang::ASTContext& _context,
+                const clang::Rewriter& _rewriter,
+                const clang::StringRef _filePath ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+    const clang::FileID l_fileId = l_sourceManager.getMainFileID();
+
+    DumpStringTable l_strings;
+    DumpASTVisitor l_visitor( l_sourceManager, l_strings, g_needInternalDump );
+    std::vector< dump::Token > l_tokensBefore;
+    std::vector< dump::Token > l_tokensAfter;
+
+    if ( g_needDumpAst ) {
+        l_visitor.TraverseAST( _context );
+    }
+
+    if ( g_needDumpTokens ) {
+        const clang::StringRef l_bufferBefore =
+            l_sourceManager.getBufferData( l_fileId );
+        const clang::SourceLocation l_fileLocation =
+            l_sourceManager.getLocForStartOfFile( l_fileId );
+
+        l_tokensBefore = lexTokens( l_bufferBefore, l_fileLocation,
+                                    _context.getLangOpts(), l_strings );
+
+        if ( const clang::RewriteBuffer* l_rewriteBuffer =
+                 _rewriter.getRewriteBufferFor( l_fileId ) ) {
+            const std::string l_bufferAfter(
+                l_rewriteBuffer->begin(), l_rewriteBuffer->end() );
+
+            l_tokensAfter = lexTokens( l_bufferAfter, l_fileLocation,
+                                       _context.getLangOpts(), l_strings );
+
+        } else {
+            l_tokensAfter = l_tokensBefore;
+        }
+    }
+
+    {
+        struct SectionData {
+            dump::SectionKind kind;
+            uint32_t entrySize;
+            const void* data;
+            uint64_t count;
+        };
+
+        std::vector< SectionData > l_sections = {
+            { dump::SectionKind::strings, 1, l_strings.data().data(),
+              l_strings.data().size() } };
+
+        if ( g_needDumpAst ) {
+            l_sections.push_back( { dump::SectionKind::nodes,
+                                    sizeof( dump::Node ),
+                                    l_visitor.nodes().data(),
+                                    l_visitor.nodes().size() } );
+
+            if ( g_needInternalDump ) {
+                l_sections.push_back(
+                    { dump::SectionKind::internalNodes,
+                      sizeof( dump::InternalNode ),
+                      l_visitor.internalNodes().data(),
+                      l_visitor.internalNodes().size() } );
+            }
+        }
+
+        if ( g_needDumpTokens ) {
+            l_sections.push_back( { dump::SectionKind::tokensBefore,
+                                    sizeof( dump::Token ),
+                                    l_tokensBefore.data(),
+                                    l_tokensBefore.size() } );
+            l_sections.push_back( { dump::SectionKind::tokensAfter,
+                                    sizeof( dump::Token ),
+                                    l_tokensAfter.data(),
+                                    l_tokensAfter.size() } );
+        }
+
+        auto l_alignTo = []( const uint64_t _value ) -> uint64_t {
+            return ( ( ( _value + dump::g_sectionAlignment - 1 ) /
+                       dump::g_sectionAlignment ) *
+                     dump::g_sectionAlignment );
+        };
+
+        dump::Header l_header = {};
+
+        std::copy( std::begin( dump::g_magic ), std::end( dump::g_magic ),
+                   l_header.magic );
+        l_header.version = dump::g_version;
+        l_header.sectionCount = l_sections.size();
+
+        std::vector< dump::Section > l_sectionTable;
+        uint64_t l_offset = l_alignTo(
+            sizeof( dump::Header ) +
+            ( l_sections.size() * sizeof( dump::Section ) ) );
+
+        for ( const SectionData& l_section : l_sections ) {
+            l_sectionTable.push_back( { ( uint32_t )l_section.kind,
+                                        l_section.entrySize, l_offset,
+                                        l_section.count } );
+
+            l_offset = l_alignTo(
+                l_offset + ( l_section.entrySize * l_section.count ) );
+        }
+
+        std::error_code l_errorCode;
+
+        llvm::raw_fd_ostream l_outputFile( _filePath, l_errorCode,
+                                           llvm::sys::fs::OF_None );
+
+        l_returnValue = !( l_errorCode );
+
+        if ( !l_returnValue ) {
+            logError( l_errorCode.message() );
+
+            goto EXIT;
+        }
+
+        l_outputFile.write( reinterpret_cast< const char* >( &l_header ),
+                            sizeof( l_header ) );
+        l_outputFile.write(
+            reinterpret_cast< const char* >( l_sectionTable.data() ),
+            ( l_sectionTable.size() * sizeof( dump::Section ) ) );
+
+        for ( size_t l_sectionIndex = 0; l_sectionIndex < l_sections.size();
+              l_sectionIndex++ ) {
+            const SectionData& l_section = l_sections[ l_sectionIndex ];
+
+            l_outputFile.write_zeros( l_sectionTable[ l_sectionIndex ].offset -
+                                      l_outputFile.tell() );
+            l_outputFile.write(
+                static_cast< const char* >( l_section.data ),
+                ( l_section.entrySize * l_section.count ) );
+        }
+
+        log( "Dumped " + std::to_string( l_visitor.nodes().size() ) +
+             " nodes, " + std::to_string( l_tokensBefore.size() ) + "/ " +
+             std::to_string( l_tokensAfter.size() ) + " tokens to " +
+             _filePath.str() );
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+// Write main file AST nodes and/ or tokens before and after rewrite to
+// _filePath in dump format, depending on --dump-ast/ --dump-tokens/
+// --internal-dump
+auto writeDump( clang::ASTContext& _context,
+                const clang::Rewriter& _rewriter,
+                clang::StringRef _filePath ) -> bool;
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+
+// Layout of --dump-ast/ --dump-tokens file (.cxd), shared with
+// c_extra_dump_reader.
+// Host byte order. File is DumpHeader, DumpSection table and 8 bytes aligned
+// sections of fixed size entries, so it can be mapped and indexed in place.
+namespace dump {
+
+constexpr char g_magic[ 4 ] = { 'C', 'X', 'D', '\0' };
+constexpr uint32_t g_version = 1;
+constexpr uint32_t g_sectionAlignment = 8;
+
+// No node/ offset
+constexpr uint32_t g_none = UINT32_MAX;
+
+enum class SectionKind : uint32_t {
+    // Null terminated strings referenced by byte offset, offset 0 is ""
+    strings = 0,
+    nodes,
+    // One per node, with --internal-dump
+    internalNodes,
+    // Main file before/ after rewrite
+    tokensBefore,
+    tokensAfter,
+};
+
+struct Header {
+    char magic[ 4 ];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint32_t reserved;
+};
+
+struct Section {
+    uint32_t kind;
+    // Bytes, 1 for strings
+    uint32_t entrySize;
+    // From start of file
+    uint64_t offset;
+    uint64_t count;
+};
+
+// Main file declaration/ statement in pre-order
+struct Node {
+    // Strings
+    uint32_t kind;
+    uint32_t name;
+    uint32_t type;
+    // Nodes
+    uint32_t parent;
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    // Main file bytes of first/ last token
+    uint32_t beginOffset;
+    uint32_t endOffset;
+    uint32_t line;
+    uint32_t column;
+};
+
+struct InternalNode {
+    // clang::Decl*/ clang::Stmt*
+    uint64_t address;
+    // clang::Decl::Kind/ clang::Stmt::StmtClass
+    uint32_t kind;
+    uint32_t isStatement;
+};
+
+enum TokenFlag : uint32_t {
+    startOfLine = ( 1 << 0 ),
+    leadingSpace = ( 1 << 1 ),
+};
+
+struct Token {
+    // Strings
+    uint32_t kind;
+    uint32_t text;
+    // Bytes
+    uint32_t offset;
+    // TokenFlag
+    uint32_t flags;
+};
+
+static_assert( sizeof( Header ) == 16 );
+static_assert( sizeof( Section ) == 24 );
+static_assert( sizeof( Node ) == 40 );
+static_assert( sizeof( InternalNode ) == 16 );
+static_assert( sizeof( Token ) == 16 );
+
+} // namespace dump
@@ -0,0 +1,256 @@
+// c_extra_dump_reader - prints dump written by --dump-ast/ --dump-tokens.
+// Dump file is mapped, nodes/ tokens are read in place.
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "dump_format.hpp"
+
+// Entries of section of kind, empty if section is missing or invalid
+template < typename Entry >
+static auto getSection( const llvm::MemoryBuffer& _file,
+                        const dump::SectionKind _kind )
+    -> llvm::ArrayRef< Entry > {
+    llvm::ArrayRef< Entry > l_returnValue;
+
+    const auto* l_header =
+        reinterpret_cast< const dump::Header* >( _file.getBufferStart() );
+    const auto* l_sections = reinterpret_cast< const dump::Section* >(
+        _file.getBufferStart() + sizeof( dump::Header ) );
+
+    for ( uint32_t l_sectionIndex = 0;
+          l_sectionIndex < l_header->sectionCount; l_sectionIndex++ ) {
+        const dump::Section& l_section = l_sections[ l_sectionIndex ];
+
+        if ( l_section.kind != ( uint32_t )_kind ) {
+            continue;
+        }
+
+        if ( ( l_section.entrySize != sizeof( Entry ) ) ||
+             ( l_section.offset > _file.getBufferSize() ) ||
+             ( l_section.count >
+               ( ( _file.getBufferSize() - l_section.offset ) /
+                 sizeof( Entry ) ) ) ) {
+            llvm::errs() << "ERROR: Invalid section " << l_section.kind
+                         << "\n";
+
+            break;
+        }
+
+        l_returnValue = llvm::ArrayRef< Entry >(
+            reinterpret_cast< const Entry* >( _file.getBufferStart() +
+                                              l_section.offset ),
+            l_section.count );
+
+        break;
+    }
+
+    return ( l_returnValue );
+}
+
+static auto getString( const llvm::ArrayRef< char > _strings,
+                       const uint32_t _offset ) -> llvm::StringRef {
+    llvm::StringRef l_returnValue;
+
+    if ( _offset < _strings.size() ) {
+        // Not terminated if file is truncated
+        l_returnValue = llvm::StringRef(
+            _strings.data() + _offset,
+            strnlen( _strings.data() + _offset, _strings.size() - _offset ) );
+    }
+
+    return ( l_returnValue );
+}
+
+static void printAst( const llvm::ArrayRef< char > _strings,
+                      const llvm::ArrayRef< dump::Node > _nodes,
+                      const llvm::ArrayRef< dump::InternalNode > _internalNodes,
+                      llvm::raw_ostream& _stream ) {
+    // Node index, depth
+    std::vector< std::pair< uint32_t, uint32_t > > l_stack;
+    // Corrupt child/ sibling links can form cycles
+    std::vector< bool > l_isVisited( _nodes.size(), false );
+
+    // Roots in reverse to print in order
+    for ( uint32_t l_nodeIndex = _nodes.size(); l_nodeIndex > 0;
+          l_nodeIndex-- ) {
+        if ( _nodes[ l_nodeIndex - 1 ].parent == dump::g_none ) {
+            l_stack.push_back( { ( l_nodeIndex - 1 ), 0 } );
+
+            l_isVisited[ l_nodeIndex - 1 ] = true;
+        }
+    }
+
+    while ( !l_stack.empty() ) {
+        const auto [ l_nodeIndex, l_depth ] = l_stack.back();
+        const dump::Node& l_node = _nodes[ l_nodeIndex ];
+
+        l_stack.pop_back();
+
+        _stream.indent( l_depth * 2 ) << getString( _strings, l_node.kind );
+
+        if ( l_node.name ) {
+            _stream << " '" << getString( _strings, l_node.name ) << "'";
+        }
+
+        if ( l_node.type ) {
+            _stream << " <" << getString( _strings, l_node.type ) << ">";
+        }
+
+        if ( l_node.beginOffset != dump::g_none ) {
+            _stream << " " << l_node.line << ":" << l_node.column << " ["
+                    << l_node.beginOffset << ", ";
+
+            if ( l_node.endOffset != dump::g_none ) {
+                _stream << l_node.endOffset;
+
+            } else {
+                _stream << "?";
+            }
+
+            _stream << "]";
+        }
+
+        if ( l_nodeIndex < _internalNodes.size() ) {
+            const dump::InternalNode& l_internalNode =
+                _internalNodes[ l_nodeIndex ];
+
+            _stream << " " << llvm::format_hex( l_internalNode.address, 18 )
+                    << ( ( l_internalNode.isStatement ) ? ( " stmt " )
+                                                        : ( " decl " ) )
+                    << l_internalNode.kind;
+        }
+
+        _stream << "\n";
+
+        // Children in reverse to print in order
+        {
+            const size_t l_stackSize = l_stack.size();
+
+            for ( uint32_t l_childIndex = l_node.firstChild;
+                  ( ( l_childIndex != dump::g_none ) &&
+                    ( l_childIndex < _nodes.size() ) &&
+                    ( !l_isVisited[ l_childIndex ] ) );
+                  l_childIndex = _nodes[ l_childIndex ].nextSibling ) {
+                l_stack.push_back( { l_childIndex, ( l_depth + 1 ) } );
+
+                l_isVisited[ l_childIndex ] = true;
+            }
+
+            std::reverse( l_stack.begin() + l_stackSize, l_stack.end() );
+        }
+    }
+}
+
+static void printTokens( const llvm::ArrayRef< char > _strings,
+                         const llvm::ArrayRef< dump::Token > _tokens,
+                         llvm::raw_ostream& _stream ) {
+    for ( const dump::Token& l_token : _tokens ) {
+        _stream << llvm::format( "%-8u ", l_token.offset )
+                << llvm::left_justify( getString( _strings, l_token.kind ),
+                                       20 )
+                << " "
+                // ^ - start of line, _ - leading space
+                << ( ( l_token.flags & dump::startOfLine ) ? ( "^" )
+                                                           : ( " " ) )
+                << ( ( l_token.flags & dump::leadingSpace ) ? ( "_" )
+                                                            : ( " " ) )
+                << " '" << getString( _strings, l_token.text ) << "'\n";
+    }
+}
+
+auto main( int _argumentCount, char* _argumentVector[] ) -> int {
+    bool l_returnValue = false;
+
+    if ( _argumentCount < 2 ) {
+        llvm::errs() << "Usage: " << _argumentVector[ 0 ]
+                     << " FILE [ast|tokens-before|tokens-after]...\n";
+
+        goto EXIT;
+    }
+
+    {
+        // Mapped if large enough
+        llvm::ErrorOr< std::unique_ptr< llvm::MemoryBuffer > > l_file =
+            llvm::MemoryBuffer::getFile( _argumentVector[ 1 ], false, false );
+
+        if ( !l_file ) {
+            llvm::errs() << "ERROR: " << l_file.getError().message() << "\n";
+
+            goto EXIT;
+        }
+
+        const llvm::MemoryBuffer& l_buffer = **l_file;
+        const auto* l_header = reinterpret_cast< const dump::Header* >(
+            l_buffer.getBufferStart() );
+
+        if ( ( l_buffer.getBufferSize() < sizeof( dump::Header ) ) ||
+             ( llvm::StringRef( l_header->magic, sizeof( l_header->magic ) ) !=
+               llvm::StringRef( dump::g_magic, sizeof( dump::g_magic ) ) ) ||
+             ( l_header->version != dump::g_version ) ||
+             ( l_header->sectionCount >
+               ( ( l_buffer.getBufferSize() - sizeof( dump::Header ) ) /
+                 sizeof( dump::Section ) ) ) ) {
+            llvm::errs() << "ERROR: Not a dump file or unsupported version\n";
+
+            goto EXIT;
+        }
+
+        const llvm::ArrayRef< char > l_strings =
+            getSection< char >( l_buffer, dump::SectionKind::strings );
+
+        // Everything by default
+        std::vector< llvm::StringRef > l_parts;
+
+        for ( int l_argumentIndex = 2; l_argumentIndex < _argumentCount;
+              l_argumentIndex++ ) {
+            l_parts.emplace_back( _argumentVector[ l_argumentIndex ] );
+        }
+
+        if ( l_parts.empty() ) {
+            l_parts = { "ast", "tokens-before", "tokens-after" };
+        }
+
+        for ( const llvm::StringRef l_part : l_parts ) {
+            if ( l_part == "ast" ) {
+                printAst(
+                    l_strings,
+                    getSection< dump::Node >( l_buffer,
+                                              dump::SectionKind::nodes ),
+                    getSection< dump::InternalNode >(
+                        l_buffer, dump::SectionKind::internalNodes ),
+                    llvm::outs() );
+
+            } else if ( l_part == "tokens-before" ) {
+                printTokens( l_strings,
+                             getSection< dump::Token >(
+                                 l_buffer, dump::SectionKind::tokensBefore ),
+                             llvm::outs() );
+
+            } else if ( l_part == "tokens-after" ) {
+                printTokens( l_strings,
+                             getSection< dump::Token >(
+                                 l_buffer, dump::SectionKind::tokensAfter ),
+                             llvm::outs() );
+
+            } else {
+                llvm::errs() << "ERROR: Unknown part '" << l_part << "'\n";
+
+                goto EXIT;
+            }
+        }
+
+        l_returnValue = true;
+    }
+
+EXIT:
+    return ( ( l_returnValue ) ? ( 0 ) : ( 1 ) );
+}
@@ -0,0 +1,371 @@
+#include "expansion_cache.hpp"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include "arguments_parse.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+// Expansion cache file layout, native byte order:
+// Header
+// Entry + key + replacement text, count times
+constexpr char g_expansionCacheMagic[ 4 ] = { 'C', 'X', 'E', '\0' };
+// Bumped whenever file layout changes
+constexpr uint32_t g_expansionCacheVersion = 2;
+
+struct ExpansionCacheHeader {
+    char magic[ 4 ];
+    uint32_t version;
+    // Of executable which wrote cache, see getBuildStamp
+    uint8_t buildStamp[ 20 ];
+    uint32_t useCounter;
+    uint32_t count;
+};
+
+// SHA1 of size and modification time of running executable, so cache of
+// other build, possibly expanding differently for same key, is not used.
+// Zero if executable can not be found, cache is used then.
+static auto getBuildStamp() -> const std::array< uint8_t, 20 >& {
+    traceEnter();
+
+    static const std::array< uint8_t, 20 > l_buildStamp = [] {
+        std::array< uint8_t, 20 > l_returnValue = {};
+
+        const std::string l_executablePath =
+            llvm::sys::fs::getMainExecutable( nullptr, nullptr );
+        llvm::sys::fs::file_status l_status;
+
+        if ( ( !l_executablePath.empty() ) &&
+             ( !llvm::sys::fs::status( l_executablePath, l_status ) ) ) {
+            std::string l_stamp;
+            llvm::raw_string_ostream l_stampStringStream( l_stamp );
+
+            l_stampStringStream << l_status.getSize() << " "
+                                << l_status.getLastModificationTime()
+                                       .time_since_epoch()
+                                       .count();
+
+            l_stampStringStream.flush();
+
+            l_returnValue = llvm::SHA1::hash(
+                llvm::arrayRefFromStringRef( l_stamp ) );
+
+        } else {
+            logWarning( "Executable not found, expansion cache is not tied "
+                        "to build" );
+        }
+
+        return ( l_returnValue );
+    }();
+
+    traceExit();
+
+    return ( l_buildStamp );
+}
+
+struct ExpansionCacheEntry {
+    uint32_t keySize;
+    uint32_t replacementTextSize;
+    uint32_t lastUse;
+};
+
+auto ExpansionCache::load( const std::string& _filePath ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    llvm::ErrorOr< std::unique_ptr< llvm::MemoryBuffer > > l_file =
+        llvm::MemoryBuffer::getFile( _filePath, false, false );
+
+    if ( !l_file ) {
+        if ( l_file.getError() != std::errc::no_such_file_or_directory ) {
+            logError( l_file.getError().message() );
+
+            l_returnValue = false;
+        }
+
+        goto EXIT;
+    }
+
+    {
+        llvm::StringRef l_data = ( *l_file )->getBuffer();
+
+        ExpansionCacheHeader l_header;
+
+        if ( l_data.size() < sizeof( l_header ) ) {
+            goto EXIT;
+        }
+
+        std::memcpy( &l_header, l_data.data(), sizeof( l_header ) );
+
+        l_data = l_data.drop_front( sizeof( l_header ) );
+
+        if ( ( std::memcmp( l_header.magic, g_expansionCacheMagic,
+                            sizeof( l_header.magic ) ) != 0 ) ||
+             ( l_header.version != g_expansionCacheVersion ) ||
+             ( std::memcmp( l_header.buildStamp, getBuildStamp().data(),
+                            sizeof( l_header.buildStamp ) ) != 0 ) ) {
+            logWarning( "Expansion cache of other version or build; "
+                        "ignoring" );
+
+            goto EXIT;
+        }
+
+        _useCounter = std::max( _useCounter, l_header.useCounter );
+
+        for ( uint32_t l_entryIndex = 0; l_entryIndex < l_header.count;
+              l_entryIndex++ ) {
+            ExpansionCacheEntry l_entry;
+
+            if ( l_data.size() < sizeof( l_entry ) ) {
+                logWarning( "Expansion cache is truncated" );
+
+                break;
+            }
+
+            std::memcpy( &l_entry, l_data.data(), sizeof( l_entry ) );
+
+            l_data = l_data.drop_front( sizeof( l_entry ) );
+
+            if ( ( l_data.size() < l_entry.keySize ) ||
+                 ( ( l_data.size() - l_entry.keySize ) <
+                   l_entry.replacementTextSize ) ) {
+                logWarning( "Expansion cache is truncated" );
+
+                break;
+            }
+
+            const llvm::StringRef l_key = l_data.take_front( l_entry.keySize );
+            const llvm::StringRef l_replacementText =
+                l_data.substr( l_entry.keySize, l_entry.replacementTextSize );
+
+            l_data = l_data.drop_front( l_entry.keySize +
+                                        l_entry.replacementTextSize );
+
+            // Entries of this run win
+            _expansions.try_emplace(
+                l_key, Expansion{ l_replacementText.str(), l_entry.lastUse } );
+        }
+
+        logVariable( _expansions.size() );
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto ExpansionCache::save( const std::string& _filePath ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    llvm::SmallString< 256 > l_temporaryFilePath;
+
+    prune( g_entryLimit );
+
+    // Written next to cache file and renamed over it
+    {
+        int l_fileDescriptor = -1;
+
+        const std::error_code l_errorCode = llvm::sys::fs::createUniqueFile(
+            ( _filePath + "-%%%%%%%%.tmp" ), l_fileDescriptor,
+            l_temporaryFilePath );
+
+        if ( l_errorCode ) {
+            logError( l_errorCode.message() );
+
+            goto EXIT;
+        }
+
+        llvm::raw_fd_ostream l_outputFile( l_fileDescriptor, true );
+
+        ExpansionCacheHeader l_header;
+
+        std::memcpy( l_header.magic, g_expansionCacheMagic,
+                     sizeof( l_header.magic ) );
+        l_header.version = g_expansionCacheVersion;
+        std::memcpy( l_header.buildStamp, getBuildStamp().data(),
+                     sizeof( l_header.buildStamp ) );
+        l_header.useCounter = _useCounter;
+        l_header.count = static_cast< uint32_t >( _expansions.size() );
+
+        l_outputFile.write( reinterpret_cast< const char* >( &l_header ),
+                            sizeof( l_header ) );
+
+        for ( const auto& l_expansion : _expansions ) {
+            const ExpansionCacheEntry l_entry = {
+                static_cast< uint32_t >( l_expansion.getKey().size() ),
+                static_cast< uint32_t >(
+                    l_expansion.getValue().replacementText.size() ),
+                l_expansion.getValue().lastUse };
+
+            l_outputFile.write( reinterpret_cast< const char* >( &l_entry ),
+                                sizeof( l_entry ) );
+
+            l_outputFile << l_expansion.getKey()
+                         << l_expansion.getValue().replacementText;
+        }
+
+        l_outputFile.close();
+
+        if ( l_outputFile.has_error() ) {
+            logError( l_outputFile.error().message() );
+
+            l_outputFile.clear_error();
+
+            llvm::sys::fs::remove( l_temporaryFilePath );
+
+            goto EXIT;
+        }
+    }
+
+    {
+        const std::error_code l_errorCode =
+            llvm::sys::fs::rename( l_temporaryFilePath, _filePath );
+
+        l_returnValue = !( l_errorCode );
+
+        if ( !l_returnValue ) {
+            logError( l_errorCode.message() );
+
+            llvm::sys::fs::remove( l_temporaryFilePath );
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto ExpansionCache::find( const llvm::StringRef _key )
+    -> const std::string* {
+    traceEnter();
+
+    const std::string* l_returnValue = nullptr;
+
+    const auto l_iterator = _expansions.find( _key );
+
+    if ( l_iterator != _expansions.end() ) {
+        l_iterator->second.lastUse = ++_useCounter;
+
+        l_returnValue = &( l_iterator->second.replacementText );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void ExpansionCache::store( const llvm::StringRef _key,
+                            const llvm::StringRef _replacementText ) {
+    traceEnter();
+
+    _expansions[ _key ] = { _replacementText.str(), ++_useCounter };
+
+    // Drop quarter at once, not entry per store
+    if ( _expansions.size() > g_entryLimit ) {
+        prune( ( g_entryLimit / 4 ) * 3 );
+    }
+
+    traceExit();
+}
+
+void ExpansionCache::prune( const size_t _entryCount ) {
+    traceEnter();
+
+    if ( _expansions.size() <= _entryCount ) {
+        goto EXIT;
+    }
+
+    {
+        std::vector< uint32_t > l_lastUses;
+
+        l_lastUses.reserve( _expansions.size() );
+
+        for ( const auto& l_expansion : _expansions ) {
+            l_lastUses.push_back( l_expansion.getValue().lastUse );
+        }
+
+        // Entry count most recently used are kept
+        std::nth_element( l_lastUses.begin(),
+                          ( l_lastUses.end() - _entryCount ),
+                          l_lastUses.end() );
+
+        const uint32_t l_oldestKeptUse = *( l_lastUses.end() - _entryCount );
+
+        for ( auto l_iterator = _expansions.begin();
+              l_iterator != _expansions.end(); ) {
+            auto l_current = l_iterator++;
+
+            if ( l_current->second.lastUse < l_oldestKeptUse ) {
+                _expansions.erase( l_current );
+            }
+        }
+
+        logVariable( _expansions.size() );
+    }
+
+EXIT:
+    traceExit();
+}
+
+auto getExpansionCache() -> ExpansionCache* {
+    traceEnter();
+
+    static ExpansionCache l_expansionCache;
+
+    ExpansionCache* l_returnValue =
+        ( ( ( g_isIncrementalRun ) || ( !g_expansionCacheFilePath.empty() ) )
+              ? ( &l_expansionCache )
+              : ( nullptr ) );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto buildExpansionKey( const llvm::ArrayRef< llvm::StringRef > _parts )
+    -> std::string {
+    traceEnter();
+
+    llvm::SHA1 l_hash;
+
+    // Options changing expansions
+    {
+        std::string l_options;
+        llvm::raw_string_ostream l_optionsStringStream( l_options );
+
+        l_optionsStringStream << g_needResolvedLayout << " "
+                              << ( int )g_typedCallbacks << " "
+                              << g_flattenDepth << " " << g_outlineThreshold
+                              << " " << g_needNoinlineOutlined;
+
+        l_optionsStringStream.flush();
+
+        l_hash.update( l_options );
+    }
+
+    for ( const llvm::StringRef l_part : _parts ) {
+        l_hash.update( llvm::StringRef( "\0", 1 ) );
+        l_hash.update( l_part );
+    }
+
+    const std::string l_returnValue = llvm::toHex( l_hash.final(), true );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Replacement texts of intrinsic calls, kept by incremental session and
+// persisted between runs in expansion cache file.
+// Expansion depends only on structural hashes of declarations it reads,
+// callback name, pointer-ness and base expression (plus indentation and
+// options), so editing anything else, e.g. adding unrelated function to
+// header, keeps it cached.
+class ExpansionCache {
+public:
+    // Least recently used expansions over this are dropped
+    static constexpr size_t g_entryLimit = 65536;
+
+    // Missing file or file of other version is not an error
+    auto load( const std::string& _filePath ) -> bool;
+
+    // File is replaced at once, so concurrent runs can not corrupt it
+    auto save( const std::string& _filePath ) -> bool;
+
+    // nullptr if not cached
+    auto find( const llvm::StringRef _key ) -> const std::string*;
+
+    void store( const llvm::StringRef _key,
+                const llvm::StringRef _replacementText );
+
+private:
+    void prune( size_t _entryCount );
+
+    struct Expansion {
+        std::string replacementText;
+        // Use counter value of last lookup/ store
+        uint32_t lastUse = 0;
+    };
+
+    llvm::StringMap< Expansion > _expansions;
+    uint32_t _useCounter = 0;
+};
+
+// Process wide cache, nullptr unless running incremental session or with
+// expansion cache file
+auto getExpansionCache() -> ExpansionCache*;
+
+// Key of expansion depending on parts, covers options affecting expansions
+auto buildExpansionKey( const llvm::ArrayRef< llvm::StringRef > _parts )
+    -> std::string;
@@ -0,0 +1,140 @@
+#include "field_flattener.hpp"
+
+#include "parallel_match.hpp"
+#include "trace.hpp"
+
+FieldFlattener::FieldFlattener( clang::ASTContext& _context,
+                                RecordLayoutCache& _recordLayoutCache,
+                                bool _needResolvedLayout,
+                                unsigned _depthLimit )
+    : _context( _context ),
+      _recordLayoutCache( _recordLayoutCache ),
+      _needResolvedLayout( _needResolvedLayout ),
+      _depthLimit( _depthLimit ) {
+    traceEnter();
+
+    traceExit();
+}
+
+auto FieldFlattener::flatten( const clang::RecordDecl* _record )
+    -> std::vector< FlatField > {
+    traceEnter();
+
+    const auto l_handlerStateLock = lockHandlerState();
+
+    _fields.clear();
+
+    flattenRecord( _record, "", 0, _needResolvedLayout, 0 );
+
+    traceExit();
+
+    return ( std::move( _fields ) );
+}
+
+void FieldFlattener::flattenRecord( const clang::RecordDecl* _record,
+                                    const std::string& _prefix,
+                                    uint64_t _offset,
+                                    bool _isResolved,
+                                    unsigned _depth ) {
+    traceEnter();
+
+    const RecordLayoutCache::RecordLayout* l_recordLayout =
+        ( ( _isResolved ) ? ( _recordLayoutCache.get( _context, _record ) )
+                          : ( nullptr ) );
+
+    for ( const clang::FieldDecl* l_field : _record->fields() ) {
+        if ( l_field->isUnnamedBitField() ) {
+            continue;
+        }
+
+        const RecordLayoutCache::FieldLayout* l_fieldLayout =
+            ( ( l_recordLayout )
+                  ? ( &( l_recordLayout->fields[ l_field->getFieldIndex() ] ) )
+                  : ( nullptr ) );
+
+        // Bit-fields and incomplete fields are left to C compiler
+        const bool l_isFieldResolved =
+            ( ( l_fieldLayout ) && ( !l_fieldLayout->isBitField ) &&
+              ( l_fieldLayout->size > 0 ) );
+        const uint64_t l_fieldOffset =
+            ( ( l_isFieldResolved ) ? ( _offset + l_fieldLayout->offset )
+                                    : ( 0 ) );
+
+        // Members of anonymous struct/ union are accessed as members of
+        // enclosing record, do not count as nesting level
+        if ( l_field->isAnonymousStructOrUnion() ) {
+            if ( _depthLimit > 0 ) {
+                flattenRecord( l_field->getType()->getAsRecordDecl(), _prefix,
+                               l_fieldOffset, l_isFieldResolved, _depth );
+            }
+
+            continue;
+        }
+
+        if ( !l_field->getIdentifier() ) {
+            continue;
+        }
+
+        const uint64_t l_fieldSize =
+            ( ( l_isFieldResolved ) ? ( l_fieldLayout->size ) : ( 0 ) );
+
+        flattenValue( l_field, ( _prefix + l_field->getNameAsString() ),
+                      l_field->getType(), l_fieldOffset, l_fieldSize,
+                      l_isFieldResolved, _depth );
+    }
+
+    traceExit();
+}
+
+void FieldFlattener::flattenValue( const clang::FieldDecl* _field,
+                                   const std::string& _name,
+                                   clang::QualType _type,
+                                   uint64_t _offset,
+                                   uint64_t _size,
+                                   bool _isResolved,
+                                   unsigned _depth ) {
+    traceEnter();
+
+    if ( ( _depth < _depthLimit ) && ( !_field->isBitField() ) ) {
+        // Nested record
+        if ( const clang::RecordDecl* l_record = _type->getAsRecordDecl() ) {
+            l_record = l_record->getDefinition();
+
+            if ( l_record ) {
+                flattenRecord( l_record, ( _name + "." ), _offset, _isResolved,
+                               ( _depth + 1 ) );
+
+                goto EXIT;
+            }
+        }
+
+        // Fixed-size array, character arrays are strings
+        if ( const clang::ConstantArrayType* l_arrayType =
+                 _context.getAsConstantArrayType( _type ) ) {
+            const clang::QualType l_elementType = l_arrayType->getElementType();
+            const uint64_t l_length = l_arrayType->getSize().getZExtValue();
+
+            if ( ( !l_elementType->isCharType() ) && ( l_length > 0 ) &&
+                 ( l_length <= g_arrayLengthLimit ) ) {
+                const uint64_t l_elementSize =
+                    _context.getTypeSizeInChars( l_elementType ).getQuantity();
+
+                for ( uint64_t l_index = 0; l_index < l_length; l_index++ ) {
+                    const std::string l_elementName =
+                        ( _name + "[" + std::to_string( l_index ) + "]" );
+
+                    flattenValue( _field, l_elementName, l_elementType,
+                                  ( _offset + ( l_index * l_elementSize ) ),
+                                  l_elementSize, _isResolved, ( _depth + 1 ) );
+                }
+
+                goto EXIT;
+            }
+        }
+    }
+
+    _fields.push_back( { _field, _name, _type, _offset, _size, _isResolved } );
+
+EXIT:
+    traceExit();
+}
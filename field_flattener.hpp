@@ -0,0 +1,61 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "record_layout.hpp"
+
+// Field passed to callback, nested fields are named by member designator
+// (e.g. "position.x", "bones[2].parent")
+struct FlatField {
+    const clang::FieldDecl* field = nullptr;
+    std::string name;
+    // Element type for array elements
+    clang::QualType type;
+    // Bytes from start of iterated record, valid if resolved
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    bool isResolved = false;
+};
+
+// Expands nested records, fixed-size arrays and anonymous structs/ unions of
+// record into single field list at rewrite time.
+// Depth limit 0 passes named top-level fields only.
+class FieldFlattener {
+public:
+    // Arrays longer than this are passed as single field
+    static constexpr uint64_t g_arrayLengthLimit = 64;
+
+    FieldFlattener( clang::ASTContext& _context,
+                    RecordLayoutCache& _recordLayoutCache,
+                    bool _needResolvedLayout,
+                    unsigned _depthLimit );
+
+    auto flatten( const clang::RecordDecl* _record )
+        -> std::vector< FlatField >;
+
+private:
+    void flattenRecord( const clang::RecordDecl* _record,
+                        const std::string& _prefix,
+                        uint64_t _offset,
+                        bool _isResolved,
+                        unsigned _depth );
+
+    void flattenValue( const clang::FieldDecl* _field,
+                       const std::string& _name,
+                       clang::QualType _type,
+                       uint64_t _offset,
+                       uint64_t _size,
+                       bool _isResolved,
+                       unsigned _depth );
+
+    clang::ASTContext& _context;
+    RecordLayoutCache& _recordLayoutCache;
+    bool _needResolvedLayout;
+    unsigned _depthLimit;
+    std::vector< FlatField > _fields;
+};
@@ -0,0 +1,977 @@
+#include "generate_serializers.hpp"
+
+#include <clang/AST/Type.h>
+#include <llvm/ADT/DenseMap.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "allocation_profile.hpp"
+#include "bundle.hpp"
+#include "common_ast_handlers.hpp"
+#include "dependencies.hpp"
+#include "log.hpp"
+#include "statistics.hpp"
+#include "trace.hpp"
+
+using namespace clang::ast_matchers;
+
+// printf/ scanf conversions of JSON field
+struct JsonFieldFormat {
+    // Empty for string and field without JSON representation
+    std::string printFormat;
+    // Argument cast, empty if not needed
+    std::string printType;
+    std::string scanFormat;
+    // Pointed type of argument cast, empty if not needed
+    std::string scanType;
+    // "true"/ "false"
+    bool isBool = false;
+    // Character array as escaped JSON string
+    bool isString = false;
+    // Non-finite value is written as null, JSON has no NaN or infinity
+    bool isFloating = false;
+};
+
+static auto getBuiltinJsonFieldFormat( const clang::BuiltinType* _builtinType )
+    -> JsonFieldFormat {
+    traceEnter();
+
+    JsonFieldFormat l_returnValue;
+
+    switch ( _builtinType->getKind() ) {
+        case clang::BuiltinType::Bool: {
+            l_returnValue = { "%s", "", "%5[a-z]", "", true, false };
+
+            break;
+        }
+
+        case clang::BuiltinType::Char_S:
+        case clang::BuiltinType::SChar: {
+            l_returnValue = { "%d", "int", "%hhd", "signed char" };
+
+            break;
+        }
+
+        case clang::BuiltinType::Char_U:
+        case clang::BuiltinType::UChar: {
+            l_returnValue = { "%u", "unsigned", "%hhu", "unsigned char" };
+
+            break;
+        }
+
+        case clang::BuiltinType::Short: {
+            l_returnValue = { "%d", "int", "%hd", "short" };
+
+            break;
+        }
+
+        case clang::BuiltinType::UShort: {
+            l_returnValue = { "%u", "unsigned", "%hu", "unsigned short" };
+
+            break;
+        }
+
+        case clang::BuiltinType::Int: {
+            l_returnValue = { "%d", "int", "%d", "int" };
+
+            break;
+        }
+
+        case clang::BuiltinType::UInt: {
+            l_returnValue = { "%u", "unsigned", "%u", "unsigned" };
+
+            break;
+        }
+
+        case clang::BuiltinType::Long: {
+            l_returnValue = { "%ld", "long", "%ld", "long" };
+
+            break;
+        }
+
+        case clang::BuiltinType::ULong: {
+            l_returnValue = { "%lu", "unsigned long", "%lu", "unsigned long" };
+
+            break;
+        }
+
+        case clang::BuiltinType::LongLong: {
+            l_returnValue = { "%lld", "long long", "%lld", "long long" };
+
+            break;
+        }
+
+        case clang::BuiltinType::ULongLong: {
+            l_returnValue = { "%llu", "unsigned long long", "%llu",
+                              "unsigned long long" };
+
+            break;
+        }
+
+        // Shortest precision to round-trip
+        case clang::BuiltinType::Float: {
+            l_returnValue = { "%.9g", "double", "%g", "float", false, false,
+                              true };
+
+            break;
+        }
+
+        case clang::BuiltinType::Double: {
+            l_returnValue = { "%.17g", "double", "%lg", "double", false, false,
+                              true };
+
+            break;
+        }
+
+        case clang::BuiltinType::LongDouble: {
+            l_returnValue = { "%.21Lg", "long double", "%Lg", "long double",
+                              false, false, true };
+
+            break;
+        }
+
+        default: {
+            break;
+        }
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+static auto getJsonFieldFormat( clang::ASTContext& _context,
+                                const clang::FieldDecl* _field )
+    -> JsonFieldFormat {
+    traceEnter();
+
+    JsonFieldFormat l_returnValue;
+
+    const clang::QualType l_fieldType = _field->getType();
+
+    if ( const clang::ConstantArrayType* l_arrayType =
+             _context.getAsConstantArrayType( l_fieldType ) ) {
+        const uint64_t l_length = l_arrayType->getSize().getZExtValue();
+
+        // Room for at least one character and null terminator
+        if ( ( l_arrayType->getElementType()->isCharType() ) &&
+             ( l_length > 1 ) ) {
+            l_returnValue.isString = true;
+        }
+
+    } else if ( const clang::EnumType* l_enumType =
+                    l_fieldType->getAs< clang::EnumType >() ) {
+        // As underlying integer type, enum is not builtin type itself
+        const clang::EnumDecl* l_enumDeclaration =
+            l_enumType->getDecl()->getDefinition();
+        const clang::BuiltinType* l_integerType =
+            ( ( ( l_enumDeclaration ) &&
+                ( !l_enumDeclaration->getIntegerType().isNull() ) )
+                  ? ( l_enumDeclaration->getIntegerType()
+                          ->getAs< clang::BuiltinType >() )
+                  : ( nullptr ) );
+
+        if ( l_integerType ) {
+            l_returnValue = getBuiltinJsonFieldFormat( l_integerType );
+        }
+
+    } else if ( const clang::BuiltinType* l_builtinType =
+                    l_fieldType->getAs< clang::BuiltinType >() ) {
+        l_returnValue = getBuiltinJsonFieldFormat( l_builtinType );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Escape text for C string literal
+static auto escapeStringLiteral( const clang::StringRef _text ) -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    l_returnValue.reserve( _text.size() );
+
+    for ( const char l_character : _text ) {
+        if ( ( l_character == '"' ) || ( l_character == '\\' ) ) {
+            l_returnValue.push_back( '\\' );
+        }
+
+        l_returnValue.push_back( l_character );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Where JSON helpers go, before serializers of first record in file having
+// them
+static llvm::DenseMap< const clang::ASTContext*, clang::SourceLocation >
+    g_jsonHelpersLocations;
+
+// Shared by JSON serializers of every record in file
+static auto buildJsonHelpersText() -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+    llvm::raw_string_ostream l_textStringStream( l_returnValue );
+
+    l_textStringStream
+        << "\n\n/* JSON helpers shared by serializers */\n"
+        << "/* Appends _size characters of _text, up to null "
+           "terminator and escaped if\n"
+        << "   _isString, counting characters which do not fit "
+           "like snprintf */\n"
+        << "static inline void c_extra_json_append( char* "
+           "_buffer, __SIZE_TYPE__ _bufferSize, __SIZE_TYPE__* "
+           "_length, const char* _text, __SIZE_TYPE__ _size, bool "
+           "_isString ) {\n"
+        << "    for ( __SIZE_TYPE__ l_index = 0; ( l_index < _size "
+           ") && ( ( !_isString ) || ( _text[ l_index ] ) ); "
+           "l_index++ ) {\n"
+        << "        const unsigned char l_character = ( unsigned "
+           "char )_text[ l_index ];\n"
+        << "        char l_escaped[ 7 ] = { ( char )l_character "
+           "};\n"
+        << "        int l_escapedSize = 1;\n\n"
+        << "        if ( ( _isString ) && ( ( l_character == '\"' "
+           ") || ( l_character == '\\\\' ) ) ) {\n"
+        << "            l_escapedSize = snprintf( l_escaped, "
+           "sizeof( l_escaped ), \"\\\\%c\", l_character );\n\n"
+        << "        } else if ( ( _isString ) && ( l_character < "
+           "0x20 ) ) {\n"
+        << "            l_escapedSize = snprintf( l_escaped, "
+           "sizeof( l_escaped ), \"\\\\u%04x\", l_character );\n"
+        << "        }\n\n"
+        << "        for ( int l_escapedIndex = 0; l_escapedIndex < "
+           "l_escapedSize; l_escapedIndex++ ) {\n"
+        << "            if ( ( *_length + 1 ) < _bufferSize ) {\n"
+        << "                _buffer[ *_length ] = l_escaped[ "
+           "l_escapedIndex ];\n"
+        << "            }\n\n"
+        << "            ( *_length )++;\n"
+        << "        }\n"
+        << "    }\n"
+        << "}\n\n"
+        << "/* Skips whitespace, then _text */\n"
+        << "static inline bool c_extra_json_expect( const "
+           "char** _cursor, const char* _text ) {\n"
+        << "    while ( ( **_cursor == ' ' ) || ( **_cursor == "
+           "'\\t' ) || ( **_cursor == '\\n' ) || ( **_cursor == "
+           "'\\r' ) ) {\n"
+        << "        ( *_cursor )++;\n"
+        << "    }\n\n"
+        << "    for ( ; *_text; _text++, ( *_cursor )++ ) {\n"
+        << "        if ( **_cursor != *_text ) {\n"
+        << "            return ( false );\n"
+        << "        }\n"
+        << "    }\n\n"
+        << "    return ( true );\n"
+        << "}\n\n"
+        << "/* Unescapes JSON string into _size characters "
+           "including null terminator,\n"
+        << "   \\u escapes as UTF-8 */\n"
+        << "static inline bool c_extra_json_read_string( "
+           "const char** _cursor, char* _string, __SIZE_TYPE__ "
+           "_size ) {\n"
+        << "    __SIZE_TYPE__ l_length = 0;\n\n"
+        << "    if ( !c_extra_json_expect( _cursor, "
+           "\"\\\"\" ) ) {\n"
+        << "        return ( false );\n"
+        << "    }\n\n"
+        << "    while ( **_cursor != '\"' ) {\n"
+        << "        unsigned l_code = ( unsigned char )*( ( "
+           "*_cursor )++ );\n"
+        << "        char l_bytes[ 3 ] = { ( char )l_code };\n"
+        << "        __SIZE_TYPE__ l_byteCount = 1;\n\n"
+        << "        if ( !l_code ) {\n"
+        << "            return ( false );\n"
+        << "        }\n\n"
+        << "        if ( l_code == '\\\\' ) {\n"
+        << "            l_code = ( unsigned char )*( ( *_cursor "
+           ")++ );\n\n"
+        << "            switch ( l_code ) {\n"
+        << "                case '\"':\n"
+        << "                case '\\\\':\n"
+        << "                case '/': {\n"
+        << "                    break;\n"
+        << "                }\n\n"
+        << "                case 'b': {\n"
+        << "                    l_code = '\\b';\n\n"
+        << "                    break;\n"
+        << "                }\n\n"
+        << "                case 'f': {\n"
+        << "                    l_code = '\\f';\n\n"
+        << "                    break;\n"
+        << "                }\n\n"
+        << "                case 'n': {\n"
+        << "                    l_code = '\\n';\n\n"
+        << "                    break;\n"
+        << "                }\n\n"
+        << "                case 'r': {\n"
+        << "                    l_code = '\\r';\n\n"
+        << "                    break;\n"
+        << "                }\n\n"
+        << "                case 't': {\n"
+        << "                    l_code = '\\t';\n\n"
+        << "                    break;\n"
+        << "                }\n\n"
+        << "                case 'u': {\n"
+        << "                    l_code = 0;\n\n"
+        << "                    for ( int l_digit = 0; l_digit < "
+           "4; l_digit++ ) {\n"
+        << "                        const char l_hex = ( char )( "
+           "*( ( *_cursor )++ ) | 0x20 );\n\n"
+        << "                        if ( ( l_hex >= '0' ) && ( "
+           "l_hex <= '9' ) ) {\n"
+        << "                            l_code = ( ( l_code << 4 ) "
+           "| ( unsigned )( l_hex - '0' ) );\n\n"
+        << "                        } else if ( ( l_hex >= 'a' ) "
+           "&& ( l_hex <= 'f' ) ) {\n"
+        << "                            l_code = ( ( l_code << 4 ) "
+           "| ( unsigned )( l_hex - 'a' + 10 ) );\n\n"
+        << "                        } else {\n"
+        << "                            return ( false );\n"
+        << "                        }\n"
+        << "                    }\n\n"
+        << "                    /* Null character and surrogate "
+           "pairs are not supported */\n"
+        << "                    if ( ( !l_code ) || ( ( l_code >= "
+           "0xD800 ) && ( l_code <= 0xDFFF ) ) ) {\n"
+        << "                        return ( false );\n"
+        << "                    }\n\n"
+        << "                    break;\n"
+        << "                }\n\n"
+        << "                default: {\n"
+        << "                    return ( false );\n"
+        << "                }\n"
+        << "            }\n\n"
+        << "            if ( l_code < 0x80 ) {\n"
+        << "                l_bytes[ 0 ] = ( char )l_code;\n\n"
+        << "            } else if ( l_code < 0x800 ) {\n"
+        << "                l_bytes[ 0 ] = ( char )( 0xC0 | ( "
+           "l_code >> 6 ) );\n"
+        << "                l_bytes[ 1 ] = ( char )( 0x80 | ( "
+           "l_code & 0x3F ) );\n"
+        << "                l_byteCount = 2;\n\n"
+        << "            } else {\n"
+        << "                l_bytes[ 0 ] = ( char )( 0xE0 | ( "
+           "l_code >> 12 ) );\n"
+        << "                l_bytes[ 1 ] = ( char )( 0x80 | ( ( "
+           "l_code >> 6 ) & 0x3F ) );\n"
+        << "                l_bytes[ 2 ] = ( char )( 0x80 | ( "
+           "l_code & 0x3F ) );\n"
+        << "                l_byteCount = 3;\n"
+        << "            }\n"
+        << "        }\n\n"
+        << "        /* Room for null terminator */\n"
+        << "        if ( ( l_length + l_byteCount ) >= _size ) {\n"
+        << "            return ( false );\n"
+        << "        }\n\n"
+        << "        __builtin_memcpy( ( _string + l_length ), "
+           "l_bytes, l_byteCount );\n\n"
+        << "        l_length += l_byteCount;\n"
+        << "    }\n\n"
+        << "    ( *_cursor )++;\n\n"
+        << "    _string[ l_length ] = '\\0';\n\n"
+        << "    return ( true );\n"
+        << "}\n";
+
+    l_textStringStream.flush();
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+GenerateSerializersHandler::GenerateSerializersHandler(
+    clang::Rewriter& _rewriter,
+    RecordLayoutCache& _recordLayoutCache )
+    : _rewriter( _rewriter ), _recordLayoutCache( _recordLayoutCache ) {
+    traceEnter();
+
+    traceExit();
+}
+
+void GenerateSerializersHandler::run(
+    const MatchFinder::MatchResult& _result ) {
+    traceEnter();
+
+    trackAllocations( generateSerializers );
+
+    using Decl = common::TypeTraits< common::RecordTag >::Decl;
+
+    const auto* l_record =
+        _result.Nodes.getNodeAs< Decl >( "serializeRecord" );
+
+    logVariable( l_record );
+
+    if ( ( !l_record ) ||
+         ( !common::hasAnnotation( l_record, "c_extra_serialize" ) ) ) {
+        goto EXIT;
+    }
+
+    addStatistic( statistic::serializedRecords );
+
+    {
+        // Annotated records are rare, whole generation holds lock
+        const auto l_handlerStateLock = lockHandlerState();
+
+        clang::ASTContext& l_context = *( _result.Context );
+
+        addSemanticDependency( l_context, l_record->getBeginLoc(), l_record );
+
+        const std::string l_elementType =
+            common::buildRecordTypeString( l_record );
+        const std::string l_name = common::buildRecordBaseName( l_record );
+
+        if ( l_name.empty() ) {
+            logError( "Serialized record has no name." );
+
+            goto EXIT;
+        }
+
+        logVariable( l_name );
+
+        const RecordLayoutCache::RecordLayout* l_recordLayout =
+            _recordLayoutCache.get( l_context, l_record );
+
+        if ( !l_recordLayout ) {
+            logError( "Serialized record '" + l_name + "' has no layout." );
+
+            goto EXIT;
+        }
+
+        for ( const RecordLayoutCache::FieldLayout& l_fieldLayout :
+              l_recordLayout->fields ) {
+            const clang::FieldDecl* l_field = l_fieldLayout.field;
+
+            if ( l_field->isUnnamedBitField() ) {
+                continue;
+            }
+
+            if ( !l_field->getIdentifier() ) {
+                logError( "Serialized record '" + l_name +
+                          "' has unnamed field; skipping" );
+
+                addStatistic( statistic::skippedDeclarations );
+
+                goto EXIT;
+            }
+
+            if ( ( !l_fieldLayout.isBitField ) &&
+                 ( l_fieldLayout.size == 0 ) ) {
+                logError( "Serialized record '" + l_name +
+                          "' has flexible array member; skipping" );
+
+                addStatistic( statistic::skippedDeclarations );
+
+                goto EXIT;
+            }
+
+            if ( l_context.getBaseElementType( l_field->getType() )
+                     ->isPointerType() ) {
+                logError( "Serialized record '" + l_name +
+                          "' has pointer field '" +
+                          l_field->getNameAsString() + "'; skipping" );
+
+                addStatistic( statistic::skippedDeclarations );
+
+                goto EXIT;
+            }
+        }
+
+        std::string l_text;
+        llvm::raw_string_ostream l_textStringStream( l_text );
+        bool l_needJsonHelpers = false;
+
+        // Binary - fields packed in declaration order, host byte order.
+        // Runs of fields without padding in between are copied at once.
+        {
+            std::string l_encodeText;
+            llvm::raw_string_ostream l_encodeStringStream( l_encodeText );
+            std::string l_decodeText;
+            llvm::raw_string_ostream l_decodeStringStream( l_decodeText );
+
+            uint64_t l_bufferOffset = 0;
+
+            const clang::FieldDecl* l_runFirstField = nullptr;
+            std::string l_runFieldNames;
+            uint64_t l_runEnd = 0;
+            uint64_t l_runSize = 0;
+
+            auto l_flushRun = [ & ]() {
+                if ( !l_runFirstField ) {
+                    return;
+                }
+
+                const clang::StringRef l_fieldName = l_runFirstField->getName();
+
+                l_encodeStringStream
+                    << "    /* " << l_runFieldNames << " */\n"
+                    << "    __builtin_memcpy( ( _buffer + " << l_bufferOffset
+                    << " ), &( _value->" << l_fieldName << " ), " << l_runSize
+                    << " );\n";
+
+                l_decodeStringStream
+                    << "    /* " << l_runFieldNames << " */\n"
+                    << "    __builtin_memcpy( ( void* )&( _value->"
+                    << l_fieldName << " ), ( _buffer + " << l_bufferOffset
+                    << " ), " << l_runSize << " );\n";
+
+                l_bufferOffset += l_runSize;
+
+                l_runFirstField = nullptr;
+                l_runFieldNames.clear();
+                l_runSize = 0;
+            };
+
+            for ( const RecordLayoutCache::FieldLayout& l_fieldLayout :
+                  l_recordLayout->fields ) {
+                const clang::FieldDecl* l_field = l_fieldLayout.field;
+
+                if ( l_field->isUnnamedBitField() ) {
+                    continue;
+                }
+
+                // Bit-fields go through temporary of declared type
+                if ( l_fieldLayout.isBitField ) {
+                    l_flushRun();
+
+                    const std::string l_fieldType =
+                        l_field->getType().getUnqualifiedType().getAsString();
+                    const uint64_t l_fieldSize =
+                        l_context.getTypeSizeInChars( l_field->getType() )
+                            .getQuantity();
+
+                    l_encodeStringStream
+                        << "    {\n"
+                        << "        " << l_fieldType
+                        << " l_value = _value->" << l_field->getName()
+                        << ";\n\n"
+                        << "        __builtin_memcpy( ( _buffer + "
+                        << l_bufferOffset << " ), &l_value, " << l_fieldSize
+                        << " );\n"
+                        << "    }\n";
+
+                    l_decodeStringStream
+                        << "    {\n"
+                        << "        " << l_fieldType << " l_value;\n\n"
+                        << "        __builtin_memcpy( &l_value, ( _buffer + "
+                        << l_bufferOffset << " ), " << l_fieldSize << " );\n\n"
+                        << "        _value->" << l_field->getName()
+                        << " = l_value;\n"
+                        << "    }\n";
+
+                    l_bufferOffset += l_fieldSize;
+
+                    continue;
+                }
+
+                if ( ( l_runFirstField ) &&
+                     ( l_fieldLayout.offset != l_runEnd ) ) {
+                    l_flushRun();
+                }
+
+                if ( !l_runFirstField ) {
+                    l_runFirstField = l_field;
+
+                } else {
+                    l_runFieldNames += ", ";
+                }
+
+                l_runFieldNames += l_field->getName();
+                l_runSize += l_fieldLayout.size;
+                l_runEnd = ( l_fieldLayout.offset + l_fieldLayout.size );
+            }
+
+            l_flushRun();
+
+            l_encodeStringStream.flush();
+            l_decodeStringStream.flush();
+
+            l_textStringStream
+                << "\n\n/* Serializers for " << l_elementType << " */\n"
+                << "static inline __SIZE_TYPE__ " << l_name
+                << "_binary_size( void ) {\n"
+                << "    return ( " << l_bufferOffset << " );\n"
+                << "}\n\n"
+                << "static inline __SIZE_TYPE__ " << l_name
+                << "_encode_binary( const " << l_elementType
+                << "* _value, unsigned char* _buffer ) {\n"
+                << l_encodeText << "\n"
+                << "    return ( " << l_bufferOffset << " );\n"
+                << "}\n\n"
+                << "static inline __SIZE_TYPE__ " << l_name
+                << "_decode_binary( " << l_elementType
+                << "* _value, const unsigned char* _buffer ) {\n"
+                << l_decodeText << "\n"
+                << "    return ( " << l_bufferOffset << " );\n"
+                << "}\n";
+
+            for ( const char* l_suffix :
+                  { "_binary_size", "_encode_binary", "_decode_binary" } ) {
+                addBundledHelper( l_context, ( l_name + l_suffix ) );
+            }
+        }
+
+        // JSON - fields appended/ scanned one by one in declaration order,
+        // strings escaped
+        {
+            std::string l_encodeText;
+            llvm::raw_string_ostream l_encodeStringStream( l_encodeText );
+            std::string l_decodeText;
+            llvm::raw_string_ostream l_decodeStringStream( l_decodeText );
+            // Temporaries and assignments for fields without address
+            std::string l_decodeDeclarations;
+            std::string l_decodeAssignments;
+
+            // Text before next value
+            std::string l_literal = "{";
+
+            const std::string l_appendCall =
+                "    c_extra_json_append( _buffer, _bufferSize, &l_length, ";
+
+            auto l_flushLiteral = [ & ]() {
+                l_encodeStringStream
+                    << l_appendCall << "\"" << escapeStringLiteral( l_literal )
+                    << "\", " << l_literal.size() << ", false );\n";
+
+                l_literal.clear();
+            };
+
+            auto l_expect = [ & ]( const std::string& _text ) {
+                l_decodeStringStream
+                    << "    if ( !c_extra_json_expect( &l_cursor, \""
+                    << escapeStringLiteral( _text ) << "\" ) ) {\n"
+                    << "        return ( false );\n"
+                    << "    }\n\n";
+            };
+
+            bool l_isFirstField = true;
+            // Fields printed/ scanned with conversion
+            bool l_hasConversions = false;
+            bool l_isSupported = true;
+
+            l_expect( "{" );
+
+            for ( const RecordLayoutCache::FieldLayout& l_fieldLayout :
+                  l_recordLayout->fields ) {
+                const clang::FieldDecl* l_field = l_fieldLayout.field;
+
+                if ( l_field->isUnnamedBitField() ) {
+                    continue;
+                }
+
+                const JsonFieldFormat l_format =
+                    getJsonFieldFormat( l_context, l_field );
+
+                if ( ( l_format.printFormat.empty() ) &&
+                     ( !l_format.isString ) ) {
+                    logWarning( "Field '" + l_field->getNameAsString() +
+                                "' of '" + l_name +
+                                "' has no JSON representation; skipping JSON "
+                                "serializers" );
+
+                    l_isSupported = false;
+
+                    break;
+                }
+
+                const std::string l_fieldName = l_field->getNameAsString();
+                const std::string l_memberAccess = ( "_value->" + l_fieldName );
+
+                if ( !l_isFirstField ) {
+                    l_literal += ",";
+
+                    l_expect( "," );
+                }
+
+                l_isFirstField = false;
+
+                l_literal += ( "\"" + l_fieldName + "\":" );
+
+                l_expect( "\"" + l_fieldName + "\"" );
+                l_expect( ":" );
+
+                if ( l_format.isString ) {
+                    l_literal += "\"";
+
+                    l_flushLiteral();
+
+                    l_encodeStringStream
+                        << l_appendCall << "( const char* )" << l_memberAccess
+                        << ", sizeof( " << l_memberAccess << " ), true );\n";
+
+                    l_literal += "\"";
+
+                    l_decodeStringStream
+                        << "    if ( !c_extra_json_read_string( &l_cursor, ( "
+                           "char* )"
+                        << l_memberAccess << ", sizeof( " << l_memberAccess
+                        << " ) ) ) {\n"
+                        << "        return ( false );\n"
+                        << "    }\n\n";
+
+                    continue;
+                }
+
+                l_flushLiteral();
+
+                l_hasConversions = true;
+
+                std::string l_scanArgument;
+
+                if ( l_format.isBool ) {
+                    l_encodeStringStream
+                        << l_appendCall << "( ( " << l_memberAccess
+                        << " ) ? \"true\" : \"false\" ), ( ( "
+                        << l_memberAccess << " ) ? 4 : 5 ), false );\n";
+
+                    l_scanArgument = ( "l_" + l_fieldName );
+                    l_decodeDeclarations +=
+                        ( "    char l_" + l_fieldName + "[ 6 ];\n" );
+                    l_decodeAssignments +=
+                        ( "    " + l_memberAccess + " = ( l_" + l_fieldName +
+                          "[ 0 ] == 't' );\n" );
+
+                } else if ( l_format.isFloating ) {
+                    l_encodeStringStream
+                        << "    if ( __builtin_isfinite( " << l_memberAccess
+                        << " ) ) {\n"
+                        << "        l_size = snprintf( l_number, sizeof( "
+                           "l_number ), \""
+                        << l_format.printFormat << "\", ( "
+                        << l_format.printType << " )" << l_memberAccess
+                        << " );\n\n"
+                        << "    } else {\n"
+                        << "        l_size = snprintf( l_number, sizeof( "
+                           "l_number ), \"null\" );\n"
+                        << "    }\n\n"
+                        << l_appendCall
+                        << "l_number, ( __SIZE_TYPE__ )l_size, false );\n";
+
+                    // null is read back as NaN
+                    l_decodeStringStream
+                        << "    l_size = 0;\n\n"
+                        << "    sscanf( l_cursor, \" null%n\", &l_size );\n\n"
+                        << "    if ( l_size ) {\n"
+                        << "        " << l_memberAccess
+                        << " = __builtin_nan( \"\" );\n\n"
+                        << "    } else if ( sscanf( l_cursor, \" "
+                        << l_format.scanFormat << "%n\", ( "
+                        << l_format.scanType << "* )&( " << l_memberAccess
+                        << " ), &l_size ) != 1 ) {\n"
+                        << "        return ( false );\n"
+                        << "    }\n\n"
+                        << "    l_cursor += l_size;\n\n";
+
+                    continue;
+
+                } else {
+                    l_encodeStringStream
+                        << "    l_size = snprintf( l_number, sizeof( l_number "
+                           "), \""
+                        << l_format.printFormat << "\", ( "
+                        << l_format.printType << " )" << l_memberAccess
+                        << " );\n"
+                        << l_appendCall
+                        << "l_number, ( __SIZE_TYPE__ )l_size, false );\n";
+
+                    if ( l_fieldLayout.isBitField ) {
+                        l_scanArgument = ( "&l_" + l_fieldName );
+                        l_decodeDeclarations +=
+                            ( "    " + l_format.scanType + " l_" +
+                              l_fieldName + ";\n" );
+                        l_decodeAssignments +=
+                            ( "    " + l_memberAccess + " = l_" + l_fieldName +
+                              ";\n" );
+
+                    } else {
+                        l_scanArgument = ( "( " + l_format.scanType + "* )&( " +
+                                           l_memberAccess + " )" );
+                    }
+                }
+
+                // Characters read are counted into l_size
+                l_decodeStringStream
+                    << "    if ( sscanf( l_cursor, \" " << l_format.scanFormat
+                    << "%n\", " << l_scanArgument << ", &l_size ) != 1 ) {\n"
+                    << "        return ( false );\n"
+                    << "    }\n\n"
+                    << "    l_cursor += l_size;\n\n";
+
+                // Word read is only known to be lowercase
+                if ( l_format.isBool ) {
+                    l_decodeStringStream
+                        << "    if ( ( __builtin_strcmp( l_" << l_fieldName
+                        << ", \"true\" ) != 0 ) && ( __builtin_strcmp( l_"
+                        << l_fieldName << ", \"false\" ) != 0 ) ) {\n"
+                        << "        return ( false );\n"
+                        << "    }\n\n";
+                }
+            }
+
+            if ( l_isSupported ) {
+                l_literal += "}";
+
+                l_flushLiteral();
+
+                l_expect( "}" );
+
+                l_encodeStringStream.flush();
+                l_decodeStringStream.flush();
+
+                l_textStringStream
+                    << "\n"
+                    << "static inline int " << l_name << "_encode_json( const "
+                    << l_elementType
+                    << "* _value, char* _buffer, __SIZE_TYPE__ _bufferSize ) "
+                       "{\n"
+                    << "    __SIZE_TYPE__ l_length = 0;\n";
+
+                if ( l_hasConversions ) {
+                    l_textStringStream << "    char l_number[ 64 ];\n"
+                                       << "    int l_size;\n";
+                }
+
+                l_textStringStream
+                    << "\n"
+                    << l_encodeText << "\n"
+                    << "    if ( _bufferSize ) {\n"
+                    << "        _buffer[ ( ( l_length < _bufferSize ) ? "
+                       "l_length : ( _bufferSize - 1 ) ) ] = '\\0';\n"
+                    << "    }\n\n"
+                    << "    return ( ( int )l_length );\n"
+                    << "}\n\n";
+
+                l_textStringStream << "static inline bool " << l_name
+                                   << "_decode_json( " << l_elementType
+                                   << "* _value, const char* _json ) {\n"
+                                   << "    const char* l_cursor = _json;\n";
+
+                if ( l_hasConversions ) {
+                    l_textStringStream << "    int l_size;\n";
+                }
+
+                l_textStringStream << l_decodeDeclarations << "\n"
+                                   << l_decodeText;
+
+                if ( !l_decodeAssignments.empty() ) {
+                    l_textStringStream << l_decodeAssignments << "\n";
+                }
+
+                l_textStringStream << "    return ( true );\n"
+                                   << "}\n";
+
+                for ( const char* l_suffix :
+                      { "_encode_json", "_decode_json" } ) {
+                    addBundledHelper( l_context, ( l_name + l_suffix ) );
+                }
+
+                l_needJsonHelpers = true;
+            }
+        }
+
+        l_textStringStream.flush();
+
+        logVariable( l_text );
+
+        common::insertAfterRecordDeclaration( _rewriter, l_record, l_text );
+
+        if ( l_needJsonHelpers ) {
+            const clang::SourceLocation l_location =
+                common::getLocationAfterRecordDeclaration(
+                    _rewriter.getSourceMgr(), _rewriter.getLangOpts(),
+                    l_record );
+
+            // Helpers are inserted once, before first serialized record
+            addSharedLocation( l_context, l_record->getBeginLoc() );
+
+            // Earliest in file, whichever worker gets there first
+            runOrDefer( [ &l_context, l_location ] {
+                const clang::SourceManager& l_sourceManager =
+                    l_context.getSourceManager();
+                clang::SourceLocation& l_helpersLocation =
+                    g_jsonHelpersLocations[ &l_context ];
+
+                if ( ( l_location.isValid() ) &&
+                     ( ( l_helpersLocation.isInvalid() ) ||
+                       ( l_sourceManager.getFileOffset( l_location ) <
+                         l_sourceManager.getFileOffset(
+                             l_helpersLocation ) ) ) ) {
+                    l_helpersLocation = l_location;
+                }
+            } );
+        }
+    }
+
+EXIT:
+    traceExit();
+}
+
+void clearJsonHelpers( const clang::ASTContext& _context ) {
+    traceEnter();
+
+    g_jsonHelpersLocations.erase( &_context );
+
+    traceExit();
+}
+
+void insertJsonHelpers( clang::ASTContext& _context,
+                        clang::Rewriter& _rewriter ) {
+    traceEnter();
+
+    const clang::SourceLocation l_location =
+        g_jsonHelpersLocations.lookup( &_context );
+
+    g_jsonHelpersLocations.erase( &_context );
+
+    if ( l_location.isInvalid() ) {
+        goto EXIT;
+    }
+
+    {
+        const std::string l_text = buildJsonHelpersText();
+
+        // Before serializers inserted at same location
+        _rewriter.InsertTextBefore( l_location, l_text );
+
+        addSharedLocation( _context, l_location );
+
+        addStatistic( statistic::bytesInserted, l_text.size() );
+
+        for ( const char* l_helper :
+              { "c_extra_json_append", "c_extra_json_expect",
+                "c_extra_json_read_string" } ) {
+            addBundledHelper( _context, l_helper );
+        }
+    }
+
+EXIT:
+    traceExit();
+}
+
+void GenerateSerializersHandler::addMatcher(
+    MatchFinder& _matcher,
+    clang::Rewriter& _rewriter,
+    RecordLayoutCache& _recordLayoutCache ) {
+    traceEnter();
+
+    auto l_handler = std::make_unique< GenerateSerializersHandler >(
+        _rewriter, _recordLayoutCache );
+
+    // Match struct definitions annotated with
+    // __attribute__((annotate("c_extra_serialize")))
+    _matcher.addMatcher(
+        recordDecl( isStruct(), isDefinition(), isExpansionInMainFile(),
+                    hasAttr( clang::attr::Annotate ) )
+            .bind( "serializeRecord" ),
+        l_handler.release() );
+
+    traceExit();
+}
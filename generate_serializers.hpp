@@ -0,0 +1,33 @@
+#pragma once
+
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include "record_layout.hpp"
+
+using namespace clang::ast_matchers;
+
+class GenerateSerializersHandler : public MatchFinder::MatchCallback {
+public:
+    GenerateSerializersHandler( clang::Rewriter& _rewriter,
+                                RecordLayoutCache& _recordLayoutCache );
+
+    void run( const MatchFinder::MatchResult& _result ) override;
+
+    static void addMatcher( MatchFinder& _matcher,
+                            clang::Rewriter& _rewriter,
+                            RecordLayoutCache& _recordLayoutCache );
+
+private:
+    clang::Rewriter& _rewriter;
+    RecordLayoutCache& _recordLayoutCache;
+};
+
+// JSON helpers are emitted once per file, before first record serialized to
+// JSON.
+// Forgets helpers of previous parse of _context.
+void clearJsonHelpers( const clang::ASTContext& _context );
+
+// Called once every record is matched
+void insertJsonHelpers( clang::ASTContext& _context,
+                        clang::Rewriter& _rewriter );
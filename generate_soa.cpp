@@ -0,0 +1,372 @@
+#include "generate_soa.hpp"
+
+#include <memory>
+
+#include "allocation_profile.hpp"
+#include "bundle.hpp"
+#include "common_ast_handlers.hpp"
+#include "dependencies.hpp"
+#include "log.hpp"
+#include "statistics.hpp"
+#include "trace.hpp"
+
+using namespace clang::ast_matchers;
+
+// Column alignment and capacity granularity in elements, so every column is
+// padded to whole cache lines/ widest vector loads
+constexpr unsigned g_soaAlignment = 64;
+
+GenerateSoaHandler::GenerateSoaHandler( clang::Rewriter& _rewriter )
+    : _rewriter( _rewriter ) {
+    traceEnter();
+
+    traceExit();
+}
+
+void GenerateSoaHandler::run( const MatchFinder::MatchResult& _result ) {
+    traceEnter();
+
+    trackAllocations( generateSoa );
+
+    using Decl = common::TypeTraits< common::RecordTag >::Decl;
+
+    const auto* l_record = _result.Nodes.getNodeAs< Decl >( "soaRecord" );
+
+    logVariable( l_record );
+
+    if ( ( !l_record ) ||
+         ( !common::hasAnnotation( l_record, "c_extra_soa" ) ) ) {
+        goto EXIT;
+    }
+
+    addStatistic( statistic::soaRecords );
+
+    {
+        // Annotated records are rare, whole generation holds lock
+        const auto l_handlerStateLock = lockHandlerState();
+
+        clang::ASTContext& l_context = *( _result.Context );
+        const clang::PrintingPolicy l_printingPolicy =
+            l_context.getPrintingPolicy();
+
+        addSemanticDependency( l_context, l_record->getBeginLoc(), l_record );
+
+        // struct name/ typedef name
+        const std::string l_elementType =
+            common::buildRecordTypeString( l_record );
+        const std::string l_name = common::buildRecordBaseName( l_record );
+
+        if ( l_name.empty() ) {
+            logError( "SoA record has no name." );
+
+            goto EXIT;
+        }
+
+        logVariable( l_name );
+
+        for ( const clang::FieldDecl* l_field : l_record->fields() ) {
+            if ( !l_field->getIdentifier() ) {
+                logError( "SoA record '" + l_name +
+                          "' has unnamed field; skipping" );
+
+                addStatistic( statistic::skippedDeclarations );
+
+                goto EXIT;
+            }
+
+            if ( l_field->getType()->isIncompleteArrayType() ) {
+                logError( "SoA record '" + l_name +
+                          "' has flexible array member; skipping" );
+
+                addStatistic( statistic::skippedDeclarations );
+
+                goto EXIT;
+            }
+
+            // Can not be addressed or sized
+            if ( l_field->isBitField() ) {
+                logError( "SoA record '" + l_name +
+                          "' has bit-field member; skipping" );
+
+                addStatistic( statistic::skippedDeclarations );
+
+                goto EXIT;
+            }
+        }
+
+        const std::string l_soaName = ( l_name + "_soa" );
+        const std::string l_soaType = ( "struct " + l_soaName );
+
+        std::string l_text;
+        llvm::raw_string_ostream l_textStringStream( l_text );
+
+        // Column element is unqualified down to array elements and through
+        // typedefs, so columns are assigned and reallocated
+        auto l_getColumnType =
+            [ & ]( const clang::FieldDecl* _field ) -> clang::QualType {
+            clang::QualType l_returnValue = _field->getType();
+
+            if ( ( l_returnValue.getCanonicalType().isConstQualified() ) ||
+                 ( l_context.getBaseElementType( l_returnValue )
+                       .isConstQualified() ) ) {
+                clang::Qualifiers l_qualifiers;
+
+                l_returnValue = l_context.getUnqualifiedArrayType(
+                    l_returnValue.getCanonicalType(), l_qualifiers );
+            }
+
+            return ( l_context.getPointerType(
+                l_returnValue.getUnqualifiedType() ) );
+        };
+
+        // Arrays and const fields of element can not be assigned
+        auto l_needsCopy = []( const clang::FieldDecl* _field ) -> bool {
+            return ( ( _field->getType()->isArrayType() ) ||
+                     ( _field->getType().isConstQualified() ) );
+        };
+
+        // Container
+        l_textStringStream << "\n\n/* Structure of arrays for " << l_elementType
+                           << " */\n"
+                           << l_soaType << " {\n"
+                           << "    __SIZE_TYPE__ count;\n"
+                           << "    __SIZE_TYPE__ capacity;\n";
+
+        for ( const clang::FieldDecl* l_field : l_record->fields() ) {
+            l_textStringStream << "    ";
+
+            l_getColumnType( l_field ).print(
+                l_textStringStream, l_printingPolicy, l_field->getName() );
+
+            l_textStringStream << ";\n";
+        }
+
+        l_textStringStream << "};\n\n";
+
+        // Free
+        l_textStringStream << "static inline void " << l_soaName << "_free( "
+                           << l_soaType << "* _soa ) {\n";
+
+        for ( const clang::FieldDecl* l_field : l_record->fields() ) {
+            l_textStringStream << "    free( ( void* )_soa->"
+                               << l_field->getName() << " );\n";
+        }
+
+        l_textStringStream << "    *_soa = ( " << l_soaType << " ){ 0 };\n"
+                           << "}\n\n";
+
+        // Allocate
+        l_textStringStream
+            << "static inline bool " << l_soaName << "_allocate( "
+            << l_soaType << "* _soa, __SIZE_TYPE__ _capacity ) {\n"
+            << "    if ( _capacity == 0 ) {\n"
+            << "        _capacity = 1;\n"
+            << "    }\n\n"
+            << "    _capacity = ( ( ( _capacity + " << ( g_soaAlignment - 1 )
+            << " ) / " << g_soaAlignment << " ) * " << g_soaAlignment
+            << " );\n\n"
+            << "    *_soa = ( " << l_soaType << " ){ 0 };\n\n";
+
+        for ( const clang::FieldDecl* l_field : l_record->fields() ) {
+            const clang::StringRef l_fieldName = l_field->getName();
+
+            l_textStringStream
+                << "    _soa->" << l_fieldName << " = aligned_alloc( "
+                << g_soaAlignment << ", ( _capacity * sizeof( *_soa->"
+                << l_fieldName << " ) ) );\n\n"
+                << "    if ( !_soa->" << l_fieldName << " ) {\n"
+                << "        " << l_soaName << "_free( _soa );\n\n"
+                << "        return ( false );\n"
+                << "    }\n\n";
+        }
+
+        l_textStringStream << "    _soa->capacity = _capacity;\n\n"
+                           << "    return ( true );\n"
+                           << "}\n\n";
+
+        // Reserve
+        l_textStringStream
+            << "static inline bool " << l_soaName << "_reserve( "
+            << l_soaType << "* _soa, __SIZE_TYPE__ _capacity ) {\n"
+            << "    " << l_soaType << " l_soa;\n\n"
+            << "    if ( _capacity <= _soa->capacity ) {\n"
+            << "        return ( true );\n"
+            << "    }\n\n"
+            << "    if ( !" << l_soaName
+            << "_allocate( &l_soa, _capacity ) ) {\n"
+            << "        return ( false );\n"
+            << "    }\n\n"
+            << "    if ( _soa->count ) {\n";
+
+        for ( const clang::FieldDecl* l_field : l_record->fields() ) {
+            const clang::StringRef l_fieldName = l_field->getName();
+
+            l_textStringStream << "        __builtin_memcpy( ( void* )l_soa."
+                               << l_fieldName << ", _soa->" << l_fieldName
+                               << ", ( _soa->count * sizeof( *_soa->"
+                               << l_fieldName << " ) ) );\n";
+        }
+
+        l_textStringStream << "    }\n\n"
+                           << "    l_soa.count = _soa->count;\n\n"
+                           << "    " << l_soaName << "_free( _soa );\n\n"
+                           << "    *_soa = l_soa;\n\n"
+                           << "    return ( true );\n"
+                           << "}\n\n";
+
+        // Gather - SoA element to AoS element
+        l_textStringStream << "static inline void " << l_soaName
+                           << "_gather( const " << l_soaType
+                           << "* _soa, __SIZE_TYPE__ _index, " << l_elementType
+                           << "* _element ) {\n";
+
+        for ( const clang::FieldDecl* l_field : l_record->fields() ) {
+            const clang::StringRef l_fieldName = l_field->getName();
+
+            if ( l_needsCopy( l_field ) ) {
+                l_textStringStream
+                    << "    __builtin_memcpy( ( void* )&( _element->"
+                    << l_fieldName << " ), &( _soa->" << l_fieldName
+                    << "[ _index ] ), sizeof( *_soa->" << l_fieldName
+                    << " ) );\n";
+
+            } else {
+                l_textStringStream << "    _element->" << l_fieldName
+                                   << " = _soa->" << l_fieldName
+                                   << "[ _index ];\n";
+            }
+        }
+
+        l_textStringStream << "}\n\n";
+
+        // Scatter - AoS element to SoA element
+        l_textStringStream << "static inline void " << l_soaName
+                           << "_scatter( " << l_soaType
+                           << "* _soa, __SIZE_TYPE__ _index, const "
+                           << l_elementType << "* _element ) {\n";
+
+        for ( const clang::FieldDecl* l_field : l_record->fields() ) {
+            const clang::StringRef l_fieldName = l_field->getName();
+
+            // Column element is never const
+            if ( l_field->getType()->isArrayType() ) {
+                l_textStringStream
+                    << "    __builtin_memcpy( &( _soa->" << l_fieldName
+                    << "[ _index ] ), &( _element->" << l_fieldName
+                    << " ), sizeof( *_soa->" << l_fieldName << " ) );\n";
+
+            } else {
+                l_textStringStream << "    _soa->" << l_fieldName
+                                   << "[ _index ] = _element->" << l_fieldName
+                                   << ";\n";
+            }
+        }
+
+        l_textStringStream << "}\n\n";
+
+        // Push, zero-initialized or freed container has no columns yet
+        l_textStringStream
+            << "static inline bool " << l_soaName << "_push( " << l_soaType
+            << "* _soa, const " << l_elementType << "* _element ) {\n"
+            << "    if ( ( _soa->count == _soa->capacity ) && ( !"
+            << l_soaName
+            << "_reserve( _soa, ( ( _soa->capacity ) ? ( _soa->capacity * 2 ) "
+               ": 1 ) ) ) ) {\n"
+            << "        return ( false );\n"
+            << "    }\n\n"
+            << "    " << l_soaName
+            << "_scatter( _soa, _soa->count, _element );\n\n"
+            << "    _soa->count++;\n\n"
+            << "    return ( true );\n"
+            << "}\n\n";
+
+        // Bulk scatter - AoS array to SoA
+        l_textStringStream
+            << "static inline bool " << l_soaName << "_from_array( "
+            << l_soaType << "* _soa, const " << l_elementType
+            << "* _elements, __SIZE_TYPE__ _count ) {\n"
+            << "    if ( !" << l_soaName
+            << "_reserve( _soa, ( _soa->count + _count ) ) ) {\n"
+            << "        return ( false );\n"
+            << "    }\n\n"
+            << "    for ( __SIZE_TYPE__ l_index = 0; l_index < _count; "
+               "l_index++ ) {\n"
+            << "        " << l_soaName
+            << "_scatter( _soa, ( _soa->count + l_index ), "
+               "&( _elements[ l_index ] ) );\n"
+            << "    }\n\n"
+            << "    _soa->count += _count;\n\n"
+            << "    return ( true );\n"
+            << "}\n\n";
+
+        // Bulk gather - SoA to AoS array of count elements
+        l_textStringStream
+            << "static inline void " << l_soaName << "_to_array( const "
+            << l_soaType << "* _soa, " << l_elementType << "* _elements ) {\n"
+            << "    for ( __SIZE_TYPE__ l_index = 0; l_index < _soa->count; "
+               "l_index++ ) {\n"
+            << "        " << l_soaName
+            << "_gather( _soa, l_index, &( _elements[ l_index ] ) );\n"
+            << "    }\n"
+            << "}\n\n";
+
+        // Column iteration
+        // callbackName(
+        //   "fieldName",
+        //   "fieldType",
+        //   alignedColumn,
+        //   count,
+        //   sizeof( *column ) );
+        l_textStringStream << "#define " << l_soaName
+                           << "_iterate_columns( _soa, _callback ) do {";
+
+        for ( const clang::FieldDecl* l_field : l_record->fields() ) {
+            const clang::StringRef l_fieldName = l_field->getName();
+
+            l_textStringStream
+                << " \\\n    _callback( \"" << l_fieldName << "\", \""
+                << l_field->getType().getAsString()
+                << "\", ( __typeof__( ( _soa )->" << l_fieldName
+                << " ) )__builtin_assume_aligned( ( _soa )->" << l_fieldName
+                << ", " << g_soaAlignment
+                << " ), ( _soa )->count, sizeof( *( _soa )->" << l_fieldName
+                << " ) );";
+        }
+
+        l_textStringStream << " \\\n} while ( 0 )\n";
+
+        l_textStringStream.flush();
+
+        logVariable( l_text );
+
+        addBundledHelper( l_context, l_soaName, true );
+
+        for ( const char* l_suffix :
+              { "_free", "_allocate", "_reserve", "_gather", "_scatter",
+                "_push", "_from_array", "_to_array", "_iterate_columns" } ) {
+            addBundledHelper( l_context, ( l_soaName + l_suffix ) );
+        }
+
+        common::insertAfterRecordDeclaration( _rewriter, l_record, l_text );
+    }
+
+EXIT:
+    traceExit();
+}
+
+void GenerateSoaHandler::addMatcher( MatchFinder& _matcher,
+                                     clang::Rewriter& _rewriter ) {
+    traceEnter();
+
+    auto l_handler = std::make_unique< GenerateSoaHandler >( _rewriter );
+
+    // Match struct definitions annotated with
+    // __attribute__((annotate("c_extra_soa")))
+    _matcher.addMatcher(
+        recordDecl( isStruct(), isDefinition(), isExpansionInMainFile(),
+                    hasAttr( clang::attr::Annotate ) )
+            .bind( "soaRecord" ),
+        l_handler.release() );
+
+    traceExit();
+}
@@ -0,0 +1,629 @@
+#include "incremental.hpp"
+
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/CompilerInvocation.h>
+#include <clang/Frontend/Utils.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+#include <clang/Serialization/PCHContainerOperations.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#if defined( __linux__ )
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "arguments_parse.hpp"
+#include "cextra_ast_consumer.hpp"
+#include "cextra_frontend.hpp"
+#include "declaration_regions.hpp"
+#include "dependencies.hpp"
+#include "log.hpp"
+#include "statistics.hpp"
+#include "trace.hpp"
+
+static auto getAbsolutePath( const std::string& _filePath ) -> std::string {
+    traceEnter();
+
+    llvm::SmallString< 256 > l_filePath( _filePath );
+
+    llvm::sys::fs::make_absolute( l_filePath );
+
+    // Same spelling as real paths of included files
+    llvm::sys::path::remove_dots( l_filePath, true );
+
+    traceExit();
+
+    return ( l_filePath.str().str() );
+}
+
+// Absolute paths besides system headers, includes of preamble are loaded from
+// it
+static auto getIncludedFiles( const clang::ASTUnit& _unit )
+    -> std::vector< std::string > {
+    traceEnter();
+
+    std::vector< std::string > l_returnValue;
+
+    const clang::SourceManager& l_sourceManager = _unit.getSourceManager();
+
+    auto l_add = [ & ]( const clang::SrcMgr::SLocEntry& _entry ) -> void {
+        if ( ( !_entry.isFile() ) ||
+             ( clang::SrcMgr::isSystem(
+                 _entry.getFile().getFileCharacteristic() ) ) ) {
+            return;
+        }
+
+        const clang::OptionalFileEntryRef l_file =
+            _entry.getFile().getContentCache().OrigEntry;
+
+        if ( l_file ) {
+            const llvm::StringRef l_realPath =
+                l_file->getFileEntry().tryGetRealPathName();
+
+            l_returnValue.push_back(
+                ( ( l_realPath.empty() )
+                      ? ( getAbsolutePath( l_file->getName().str() ) )
+                      : ( l_realPath.str() ) ) );
+        }
+    };
+
+    for ( unsigned l_index = 0;
+          l_index < l_sourceManager.local_sloc_entry_size(); l_index++ ) {
+        l_add( l_sourceManager.getLocalSLocEntry( l_index ) );
+    }
+
+    for ( unsigned l_index = 0;
+          l_index < l_sourceManager.loaded_sloc_entry_size(); l_index++ ) {
+        l_add( l_sourceManager.getLoadedSLocEntry( l_index ) );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Parsed input kept between requests
+struct TranslationUnit {
+    // Referenced by diagnostics engine of unit
+    std::shared_ptr< clang::DiagnosticOptions > diagnosticOptions;
+    std::unique_ptr< clang::ASTUnit > unit;
+    // Watched by watch session, main file too
+    std::vector< std::string > includedFiles;
+    // Handlers run only for declarations changed since previous request
+    DeclarationRegions declarationRegions;
+    // Of included files besides main file when previous request was
+    // processed, by path
+    llvm::StringMap< llvm::sys::TimePoint<> > includedFileTimes;
+};
+
+// Any included file changed or is gone since previous request
+static auto haveIncludedFilesChanged(
+    const TranslationUnit& _translationUnit ) -> bool {
+    traceEnter();
+
+    const bool l_returnValue = std::any_of(
+        _translationUnit.includedFileTimes.begin(),
+        _translationUnit.includedFileTimes.end(), []( const auto& _entry ) {
+            llvm::sys::fs::file_status l_status;
+
+            return ( ( llvm::sys::fs::status( _entry.getKey(), l_status ) ) ||
+                     ( l_status.getLastModificationTime() !=
+                       _entry.getValue() ) );
+        } );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+static void recordIncludedFileTimes( TranslationUnit& _translationUnit ) {
+    traceEnter();
+
+    const clang::ASTUnit& l_unit = *( _translationUnit.unit );
+    const llvm::StringRef l_mainFilePath =
+        getMainFilePath( l_unit.getSourceManager() );
+
+    _translationUnit.includedFileTimes.clear();
+
+    for ( const std::string& l_includedFile : getIncludedFiles( l_unit ) ) {
+        llvm::sys::fs::file_status l_status;
+
+        if ( ( l_includedFile != l_mainFilePath ) &&
+             ( !llvm::sys::fs::status( l_includedFile, l_status ) ) ) {
+            _translationUnit.includedFileTimes[ l_includedFile ] =
+                l_status.getLastModificationTime();
+        }
+    }
+
+    traceExit();
+}
+
+static auto loadTranslationUnit(
+    const clang::tooling::CompilationDatabase& _compilationDatabase,
+    const std::string& _filePath,
+    const std::shared_ptr< clang::PCHContainerOperations >&
+        _pchContainerOperations,
+    TranslationUnit& _translationUnit ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    const std::vector< clang::tooling::CompileCommand > l_compileCommands =
+        _compilationDatabase.getCompileCommands( _filePath );
+
+    if ( l_compileCommands.empty() ) {
+        logError( "No compile command for '" + _filePath + "'." );
+
+        goto EXIT;
+    }
+
+    {
+        const std::vector< std::string >& l_commandLine =
+            l_compileCommands.front().CommandLine;
+
+        // Same as tool run
+        std::vector< const char* > l_arguments = {
+            l_commandLine.front().c_str(), "-fsyntax-only" };
+
+        for ( auto l_argument = ( l_commandLine.begin() + 1 );
+              l_argument != l_commandLine.end(); l_argument++ ) {
+            l_arguments.push_back( l_argument->c_str() );
+        }
+
+        const llvm::IntrusiveRefCntPtr< llvm::vfs::FileSystem > l_fileSystem =
+            llvm::vfs::getRealFileSystem();
+
+        _translationUnit.diagnosticOptions =
+            std::make_shared< clang::DiagnosticOptions >();
+
+        const clang::IntrusiveRefCntPtr< clang::DiagnosticsEngine >
+            l_diagnostics = clang::CompilerInstance::createDiagnostics(
+                *l_fileSystem, *( _translationUnit.diagnosticOptions ) );
+
+        clang::CreateInvocationOptions l_invocationOptions;
+
+        l_invocationOptions.Diags = l_diagnostics;
+        l_invocationOptions.VFS = l_fileSystem;
+
+        std::shared_ptr< clang::CompilerInvocation > l_invocation =
+            clang::createInvocation( l_arguments, l_invocationOptions );
+
+        if ( !l_invocation ) {
+            logError( "Invalid compile command for '" + _filePath + "'." );
+
+            goto EXIT;
+        }
+
+        _translationUnit.unit = clang::ASTUnit::LoadFromCompilerInvocation(
+            std::move( l_invocation ), _pchContainerOperations,
+            _translationUnit.diagnosticOptions, l_diagnostics,
+            new clang::FileManager( clang::FileSystemOptions(), l_fileSystem ),
+            false, clang::CaptureDiagsKind::None,
+            // Precompile preamble right away, every reparse reuses it
+            1, clang::TU_Complete, false, false,
+            // Inputs are edited while session runs
+            true );
+
+        l_returnValue = !!( _translationUnit.unit );
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+static auto processRequest(
+    const clang::tooling::CompilationDatabase& _compilationDatabase,
+    const std::string& _filePath,
+    const std::shared_ptr< clang::PCHContainerOperations >&
+        _pchContainerOperations,
+    TranslationUnit& _translationUnit ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    // Before parse reads them
+    const bool l_haveIncludedFilesChanged =
+        haveIncludedFilesChanged( _translationUnit );
+
+    const PhaseStart l_parseStart = startPhase( phase::parse );
+
+    if ( !_translationUnit.unit ) {
+        if ( !loadTranslationUnit( _compilationDatabase, _filePath,
+                                   _pchContainerOperations,
+                                   _translationUnit ) ) {
+            goto EXIT;
+        }
+
+    } else if ( _translationUnit.unit->Reparse( _pchContainerOperations ) ) {
+        logError( "Reparse of '" + _filePath + "' failed." );
+
+        goto EXIT;
+    }
+
+    {
+        const clang::SourceManager& l_sourceManager =
+            _translationUnit.unit->getSourceManager();
+
+        endPhase( getMainFilePath( l_sourceManager ), phase::parse,
+                  l_parseStart );
+    }
+
+    if ( _translationUnit.unit->getDiagnostics().hasErrorOccurred() ) {
+        logError( "Processing failed due to errors." );
+
+        goto EXIT;
+    }
+
+    if ( g_isCheckOnly ) {
+        l_returnValue = true;
+
+        goto EXIT;
+    }
+
+    {
+        clang::ASTUnit& l_unit = *( _translationUnit.unit );
+        clang::ASTContext& l_context = l_unit.getASTContext();
+        DeclarationRegions& l_declarationRegions =
+            _translationUnit.declarationRegions;
+
+        // Declarations of main file parsed after preamble, matchers do not
+        // have to walk included declarations again
+        const std::vector< clang::Decl* > l_declarations(
+            l_unit.top_level_begin(), l_unit.top_level_end() );
+
+        std::optional< clang::Rewriter > l_rewriter;
+
+        auto l_run = [ & ]( const bool _canReuse ) -> bool {
+            // Only declarations changed since previous request
+            l_context.setTraversalScope( l_declarationRegions.plan(
+                l_context, l_declarations, _canReuse ) );
+
+            l_rewriter.emplace( l_unit.getSourceManager(),
+                                l_unit.getLangOpts() );
+
+            CExtraASTConsumer( *l_rewriter ).HandleTranslationUnit( l_context );
+
+            return ( l_declarationRegions.reuse( *l_rewriter ) );
+        };
+
+        if ( !l_run( !l_haveIncludedFilesChanged ) ) {
+            l_run( false );
+        }
+
+        // Dump covers reused declarations too
+        l_context.setTraversalScope( l_declarations );
+
+        l_declarationRegions.record( l_context, *l_rewriter );
+
+        l_returnValue = writeRewrittenMainFile( l_context, *l_rewriter );
+
+        recordIncludedFileTimes( _translationUnit );
+
+        // Kept by context, which next reparse may replace
+        clearSemanticDependencies( l_context );
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Answers with "ok MILLISECONDS PATH" or "error PATH" line
+static auto processInput(
+    const clang::tooling::CompilationDatabase& _compilationDatabase,
+    const std::string& _filePath,
+    const std::shared_ptr< clang::PCHContainerOperations >&
+        _pchContainerOperations,
+    TranslationUnit& _translationUnit ) -> bool {
+    traceEnter();
+
+    const auto l_start = std::chrono::steady_clock::now();
+
+    const bool l_returnValue =
+        processRequest( _compilationDatabase, _filePath,
+                        _pchContainerOperations, _translationUnit );
+
+    // Lines logged while processing come before answer
+    flushLog();
+
+    if ( l_returnValue ) {
+        const auto l_duration =
+            std::chrono::duration_cast< std::chrono::milliseconds >(
+                std::chrono::steady_clock::now() - l_start );
+
+        llvm::outs() << "ok " << l_duration.count() << " " << _filePath
+                     << "\n";
+
+    } else {
+        llvm::outs() << "error " << _filePath << "\n";
+    }
+
+    llvm::outs().flush();
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto runIncrementalSession(
+    const clang::tooling::CompilationDatabase& _compilationDatabase ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    const auto l_pchContainerOperations =
+        std::make_shared< clang::PCHContainerOperations >();
+
+    // By absolute path
+    llvm::StringMap< TranslationUnit > l_translationUnits;
+
+    auto l_process = [ & ]( const std::string& _request ) -> void {
+        const std::string l_filePath = getAbsolutePath( _request );
+
+        l_returnValue = ( processInput( _compilationDatabase, l_filePath,
+                                        l_pchContainerOperations,
+                                        l_translationUnits[ l_filePath ] ) &&
+                          l_returnValue );
+    };
+
+    // Parse and precompile preambles before first request
+    for ( const std::string& l_source : g_sources ) {
+        l_process( l_source );
+    }
+
+    {
+        std::string l_request;
+
+        while ( std::getline( std::cin, l_request ) ) {
+            if ( l_request.empty() ) {
+                continue;
+            }
+
+            l_process( l_request );
+        }
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+#if defined( __linux__ )
+
+// Saved files are gathered for after first change before processing, editors
+// write file in several steps
+constexpr std::chrono::milliseconds g_watchSettleInterval( 10 );
+
+auto runWatchSession(
+    const clang::tooling::CompilationDatabase& _compilationDatabase ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    const auto l_pchContainerOperations =
+        std::make_shared< clang::PCHContainerOperations >();
+
+    // By absolute path
+    llvm::StringMap< TranslationUnit > l_translationUnits;
+
+    // Paths of inputs by included file
+    llvm::StringMap< llvm::StringSet<> > l_dependents;
+
+    // By watch descriptor
+    llvm::DenseMap< int, std::string > l_watchedDirectories;
+    llvm::StringSet<> l_directories;
+
+    const int l_inotify = inotify_init1( IN_CLOEXEC );
+
+    if ( l_inotify == -1 ) {
+        logError( std::string( "Can not watch inputs: " ) +
+                  std::strerror( errno ) );
+
+        goto EXIT;
+    }
+
+    {
+        auto l_watch = [ & ]( const std::string& _filePath ) -> void {
+            // Editors save by renaming new file over old one, which drops
+            // watch of file itself
+            const std::string l_directory =
+                llvm::sys::path::parent_path( _filePath ).str();
+
+            if ( !l_directories.insert( l_directory ).second ) {
+                return;
+            }
+
+            const int l_watchDescriptor =
+                inotify_add_watch( l_inotify, l_directory.c_str(),
+                                   ( IN_CLOSE_WRITE | IN_MOVED_TO ) );
+
+            if ( l_watchDescriptor == -1 ) {
+                logError( "Can not watch '" + l_directory +
+                          "': " + std::strerror( errno ) );
+
+            } else {
+                l_watchedDirectories[ l_watchDescriptor ] = l_directory;
+            }
+        };
+
+        auto l_process = [ & ]( const std::string& _filePath ) -> void {
+            TranslationUnit& l_translationUnit =
+                l_translationUnits[ _filePath ];
+
+            processInput( _compilationDatabase, _filePath,
+                          l_pchContainerOperations, l_translationUnit );
+
+            // Input which was never parsed is watched by itself
+            std::vector< std::string > l_includedFiles =
+                ( ( l_translationUnit.unit )
+                      ? ( getIncludedFiles( *( l_translationUnit.unit ) ) )
+                      : ( std::vector< std::string >{ _filePath } ) );
+
+            for ( const std::string& l_includedFile :
+                  l_translationUnit.includedFiles ) {
+                l_dependents[ l_includedFile ].erase( _filePath );
+            }
+
+            for ( const std::string& l_includedFile : l_includedFiles ) {
+                l_dependents[ l_includedFile ].insert( _filePath );
+
+                l_watch( l_includedFile );
+            }
+
+            l_translationUnit.includedFiles = std::move( l_includedFiles );
+        };
+
+        // Parse and precompile preambles before first change
+        for ( const std::string& l_source : g_sources ) {
+            l_process( getAbsolutePath( l_source ) );
+        }
+
+        // Paths of inputs to process once saving settles
+        llvm::StringSet<> l_changedInputs;
+        // Not moved by later changes, so steady writes can not postpone
+        // processing
+        std::chrono::steady_clock::time_point l_settleDeadline;
+
+        alignas( struct inotify_event ) char l_buffer[ 4096 ];
+
+        for ( ;; ) {
+            int l_timeout = -1;
+
+            if ( !l_changedInputs.empty() ) {
+                const auto l_remaining =
+                    std::chrono::ceil< std::chrono::milliseconds >(
+                        l_settleDeadline - std::chrono::steady_clock::now() );
+
+                if ( l_remaining.count() <= 0 ) {
+                    for ( const auto& l_input : l_changedInputs ) {
+                        l_process( l_input.getKey().str() );
+                    }
+
+                    l_changedInputs.clear();
+
+                    continue;
+                }
+
+                l_timeout = l_remaining.count();
+            }
+
+            struct pollfd l_pollRequest = { l_inotify, POLLIN, 0 };
+
+            const int l_readyCount = poll( &l_pollRequest, 1, l_timeout );
+
+            if ( l_readyCount == 0 ) {
+                continue;
+            }
+
+            const ssize_t l_size =
+                ( ( l_readyCount == -1 )
+                      ? ( -1 )
+                      : ( read( l_inotify, l_buffer, sizeof( l_buffer ) ) ) );
+
+            if ( l_size == -1 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+
+                logError( std::string( "Can not read saved files: " ) +
+                          std::strerror( errno ) );
+
+                break;
+            }
+
+            const bool l_wasSettled = l_changedInputs.empty();
+
+            for ( ssize_t l_offset = 0; l_offset < l_size; ) {
+                const auto* l_event =
+                    reinterpret_cast< const struct inotify_event* >(
+                        l_buffer + l_offset );
+
+                l_offset += ( sizeof( struct inotify_event ) + l_event->len );
+
+                // Events were dropped, any input could be affected
+                if ( l_event->mask & IN_Q_OVERFLOW ) {
+                    for ( const auto& l_translationUnit :
+                          l_translationUnits ) {
+                        l_changedInputs.insert( l_translationUnit.getKey() );
+                    }
+
+                    continue;
+                }
+
+                const auto l_directory =
+                    l_watchedDirectories.find( l_event->wd );
+
+                if ( ( !l_event->len ) ||
+                     ( l_directory == l_watchedDirectories.end() ) ) {
+                    continue;
+                }
+
+                llvm::SmallString< 256 > l_filePath( l_directory->second );
+
+                llvm::sys::path::append( l_filePath, l_event->name );
+
+                logVariable( l_filePath );
+
+                const auto l_inputs = l_dependents.find( l_filePath );
+
+                if ( l_inputs != l_dependents.end() ) {
+                    for ( const auto& l_input : l_inputs->second ) {
+                        l_changedInputs.insert( l_input.getKey() );
+                    }
+                }
+            }
+
+            if ( ( l_wasSettled ) && ( !l_changedInputs.empty() ) ) {
+                l_settleDeadline = ( std::chrono::steady_clock::now() +
+                                     g_watchSettleInterval );
+            }
+        }
+    }
+
+EXIT:
+    if ( l_inotify != -1 ) {
+        close( l_inotify );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+#else
+
+auto runWatchSession(
+    const clang::tooling::CompilationDatabase& _compilationDatabase ) -> bool {
+    traceEnter();
+
+    logError( "Watch run is supported on Linux only." );
+
+    traceExit();
+
+    return ( false );
+}
+
+#endif
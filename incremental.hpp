@@ -0,0 +1,23 @@
+#pragma once
+
+#include <clang/Tooling/CompilationDatabase.h>
+
+// Editor integration.
+// Processes inputs from arguments, then reads path of input per line from
+// standard input and processes it again like regular run, answering every
+// request with "ok MILLISECONDS PATH" or "error PATH" line on standard output.
+// Translation units stay parsed between requests: includes at beginning of
+// input are kept precompiled, so only rest of input is parsed again, and
+// handlers run only for declarations whose text or read declarations changed
+// since previous request (see DeclarationRegions), reusing their unchanged
+// expansions (see ExpansionCache).
+auto runIncrementalSession(
+    const clang::tooling::CompilationDatabase& _compilationDatabase ) -> bool;
+
+// Continuous regeneration.
+// Processes inputs from arguments like incremental session, then watches them
+// and files they include besides system headers with inotify, processing
+// every input affected by saved file again with same answer lines.
+// Runs until interrupted, false right away outside of Linux.
+auto runWatchSession(
+    const clang::tooling::CompilationDatabase& _compilationDatabase ) -> bool;
@@ -2,11 +2,15 @@
 
 #include <memory>
 
+#include "allocation_profile.hpp"
 #include "common_ast_handlers.hpp"
+#include "dependencies.hpp"
+#include "expansion_cache.hpp"
 #include "log.hpp"
+#include "statistics.hpp"
+#include "structural_hash.hpp"
 #include "trace.hpp"
-
-using namespace clang::ast_matchers;
+#include "type_id.hpp"
 
 IterateArgumentsHandler::IterateArgumentsHandler( clang::Rewriter& _rewriter )
     : _rewriter( _rewriter ) {
@@ -15,22 +19,23 @@ IterateArgumentsHandler::IterateArgumentsHandler( clang::Rewriter& _rewriter )
     traceExit();
 }
 
-void IterateArgumentsHandler::run( const MatchFinder::MatchResult& _result ) {
+void IterateArgumentsHandler::run( clang::ASTContext& _context,
+                                   const clang::CallExpr* _callingExpression,
+                                   const ScopeIndex::CallSite& _callSite ) {
     traceEnter();
 
-    const auto* l_callingExpression =
-        _result.Nodes.getNodeAs< clang::CallExpr >( "iterateArgumentsCall" );
+    trackAllocations( iterateArguments );
+
+    const clang::CallExpr* l_callingExpression = _callingExpression;
 
     logVariable( l_callingExpression );
 
-    if ( !l_callingExpression ) {
-        goto EXIT;
-    }
+    addStatistic( statistic::iterateArgumentsCalls );
 
     {
-        // 2nd argument
-        const auto* l_callbackNameLiteral =
-            _result.Nodes.getNodeAs< clang::StringLiteral >( "callbackName" );
+        // 1st argument
+        const clang::StringLiteral* l_callbackNameLiteral =
+            common::getStringLiteralArgument( l_callingExpression, 0 );
 
         logVariable( l_callbackNameLiteral );
 
@@ -43,10 +48,20 @@ void IterateArgumentsHandler::run( const MatchFinder::MatchResult& _result ) {
 
         logVariable( l_callbackName );
 
-        // 1st argument
-        const auto* l_ancestorFunctionDeclaration =
-            _result.Nodes.getNodeAs< clang::FunctionDecl >(
-                "ancestorFunctionDeclaration" );
+        // Expansion depends on enclosing function of every macro use, it can
+        // not be written into macro like by MacroCallSites
+        if ( l_callingExpression->getBeginLoc().isMacroID() ) {
+            logWarning( "Intrinsic call comes from macro expansion; left as "
+                        "is" );
+
+            addStatistic( statistic::macroCallSitesLeft );
+
+            goto EXIT;
+        }
+
+        // Enclosing function, tracked by scope index traversal
+        const clang::FunctionDecl* l_ancestorFunctionDeclaration =
+            _callSite.function;
 
         logVariable( l_ancestorFunctionDeclaration );
 
@@ -54,6 +69,19 @@ void IterateArgumentsHandler::run( const MatchFinder::MatchResult& _result ) {
             goto EXIT;
         }
 
+        addSemanticDependency( _context, l_callingExpression->getBeginLoc(),
+                               l_ancestorFunctionDeclaration );
+
+        // Everything expansion depends on, see ExpansionCache
+        const std::string l_expansionKey =
+            ( ( getExpansionCache() )
+                  ? ( buildExpansionKey(
+                        { "iterate_arguments",
+                          buildStructuralHash( _context,
+                                               l_ancestorFunctionDeclaration ),
+                          l_callbackName } ) )
+                  : ( "" ) );
+
         const std::string l_replacementText = common::buildReplacementText(
             _rewriter, l_callingExpression,
             l_ancestorFunctionDeclaration->parameters(),
@@ -76,6 +104,8 @@ void IterateArgumentsHandler::run( const MatchFinder::MatchResult& _result ) {
                     if ( l_argumentName.empty() ) {
                         logWarning( "Argument has no name; skipping" );
 
+                        addStatistic( statistic::skippedDeclarations );
+
                         goto EXIT;
                     }
 
@@ -100,6 +130,9 @@ void IterateArgumentsHandler::run( const MatchFinder::MatchResult& _result ) {
 
                     logVariable( l_argumentName );
 
+                    const TypeId l_argumentTypeId =
+                        getTypeId( _context, _argumentDeclaration->getType() );
+
                     const std::string l_argumentReference =
                         ( "&(" + l_argumentName + ")" );
 
@@ -108,16 +141,23 @@ void IterateArgumentsHandler::run( const MatchFinder::MatchResult& _result ) {
                     //   "argumentType",
                     //   sizeof( argumentName );
                     _replacementTextStringStream
-                        << _indent << l_callbackName << "("
-                        << "\"" << l_argumentName << "\", "
-                        << "\"" << l_argumentTypeString << "\", "
+                        << _indent
+                        << buildTypedCallbackName( l_callbackName,
+                                                   l_argumentTypeId )
+                        << "(" << "\"" << l_argumentName << "\", "
+                        << buildTypedCallbackTypeArgument( l_argumentTypeString,
+                                                           l_argumentTypeId )
+                        << ", "
                         << l_argumentReference << ", " << "sizeof("
                         << l_argumentName << ")" << ");\n";
+
+                    addStatistic( statistic::argumentCalls );
                 }
 
             EXIT:
                 traceExit();
-            } );
+            },
+            l_expansionKey );
 
         logVariable( l_replacementText );
 
@@ -129,19 +169,22 @@ EXIT:
     traceExit();
 }
 
-void IterateArgumentsHandler::addMatcher( MatchFinder& _matcher,
-                                          clang::Rewriter& _rewriter ) {
+void IterateArgumentsHandler::addCallSiteHandler( ScopeIndex& _scopeIndex,
+                                                  clang::Rewriter& _rewriter ) {
     traceEnter();
 
-    auto l_handler = std::make_unique< IterateArgumentsHandler >( _rewriter );
+    auto l_handler = std::make_shared< IterateArgumentsHandler >( _rewriter );
+
+    // Calls to iterate_arguments("callback") are passed together with their
+    // enclosing function by scope index traversal instead of hasAncestor(),
+    // which builds parent map and climbs it on every match
+    _scopeIndex.trackCall(
+        "iterate_arguments",
+        [ l_handler ]( clang::ASTContext& _context,
+                       const clang::CallExpr* _callingExpression,
+                       const ScopeIndex::CallSite& _callSite ) {
+            l_handler->run( _context, _callingExpression, _callSite );
+        } );
 
-    // Match calls to iterate_arguments("callback")
-    _matcher.addMatcher(
-        callExpr(
-            callee( functionDecl( hasName( "iterate_arguments" ) ) ),
-            hasAncestor( functionDecl().bind( "ancestorFunctionDeclaration" ) ),
-            hasArgument( 0, stringLiteral().bind( "callbackName" ) ) )
-            .bind( "iterateArgumentsCall" ),
-        l_handler.release() );
     traceExit();
 }
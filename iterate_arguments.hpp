@@ -1,17 +1,20 @@
 #pragma once
 
-#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/AST/ASTContext.h>
 #include <clang/Rewrite/Core/Rewriter.h>
 
-using namespace clang::ast_matchers;
+#include "scope_index.hpp"
 
-class IterateArgumentsHandler : public MatchFinder::MatchCallback {
+class IterateArgumentsHandler {
 public:
     IterateArgumentsHandler( clang::Rewriter& _rewriter );
 
-    void run( const MatchFinder::MatchResult& _result ) override;
+    void run( clang::ASTContext& _context,
+              const clang::CallExpr* _callingExpression,
+              const ScopeIndex::CallSite& _callSite );
 
-    static void addMatcher( MatchFinder& _matcher, clang::Rewriter& _rewriter );
+    static void addCallSiteHandler( ScopeIndex& _scopeIndex,
+                                    clang::Rewriter& _rewriter );
 
 private:
     clang::Rewriter& _rewriter;
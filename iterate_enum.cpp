@@ -1,15 +1,27 @@
 #include "iterate_enum.hpp"
 
+#include <iterator>
 #include <memory>
+#include <vector>
 
+#include "allocation_profile.hpp"
 #include "common_ast_handlers.hpp"
+#include "dependencies.hpp"
+#include "expansion_cache.hpp"
 #include "log.hpp"
+#include "statistics.hpp"
+#include "structural_hash.hpp"
 #include "trace.hpp"
 
 using namespace clang::ast_matchers;
 
-IterateEnumHandler::IterateEnumHandler( clang::Rewriter& _rewriter )
-    : _rewriter( _rewriter ) {
+IterateEnumHandler::IterateEnumHandler(
+    clang::Rewriter& _rewriter,
+    MacroCallSites& _macroCallSites,
+    OutlinedExpansions& _outlinedExpansions )
+    : _rewriter( _rewriter ),
+      _macroCallSites( _macroCallSites ),
+      _outlinedExpansions( _outlinedExpansions ) {
     traceEnter();
 
     traceExit();
@@ -18,6 +30,30 @@ IterateEnumHandler::IterateEnumHandler( clang::Rewriter& _rewriter )
 void IterateEnumHandler::run( const MatchFinder::MatchResult& _result ) {
     traceEnter();
 
+    trackAllocations( iterateEnum );
+
+    addStatistic( statistic::iterateEnumCalls );
+
+    const auto* l_callingExpression =
+        _result.Nodes.getNodeAs< clang::CallExpr >( "iterateEnumCall" );
+
+    // Helpers of calls from macro expansions are named in call order
+    if ( ( l_callingExpression ) &&
+         ( l_callingExpression->getBeginLoc().isMacroID() ) ) {
+        runOrDefer( [ this, _result ] { expand( _result ); } );
+
+    } else {
+        expand( _result );
+    }
+
+    traceExit();
+}
+
+void IterateEnumHandler::expand( const MatchFinder::MatchResult& _result ) {
+    traceEnter();
+
+    trackAllocations( iterateEnum );
+
     auto [ l_callingExpression, l_qualifierType, l_originalDeclaration,
            l_baseExpressionText, l_pointerPassed, l_callbackName ] =
         common::inferCallbackArgumentContext< common::EnumTag >(
@@ -30,6 +66,10 @@ void IterateEnumHandler::run( const MatchFinder::MatchResult& _result ) {
                 return ( true );
             } );
 
+    addSemanticDependency( *( _result.Context ),
+                           l_callingExpression->getBeginLoc(),
+                           l_originalDeclaration );
+
     {
         // Underlying integer type of enum
         const clang::QualType l_originalDeclarationUnderlyingQualifierType =
@@ -40,9 +80,7 @@ void IterateEnumHandler::run( const MatchFinder::MatchResult& _result ) {
 
         logVariable( l_enumUnderlyingType );
 
-        const std::string l_replacementText = common::buildReplacementText(
-            _rewriter, l_callingExpression,
-            l_originalDeclaration->enumerators(),
+        const auto l_buildEnumeratorCall =
             [ & ](
                 const clang::EnumConstantDecl* _enumeratorConstantDeclaration,
                 llvm::raw_string_ostream& _replacementTextStringStream,
@@ -63,6 +101,8 @@ void IterateEnumHandler::run( const MatchFinder::MatchResult& _result ) {
                         logWarning(
                             "Enumerator constant has no name; skipping" );
 
+                        addStatistic( statistic::skippedDeclarations );
+
                         goto EXIT;
                     }
 
@@ -91,16 +131,71 @@ void IterateEnumHandler::run( const MatchFinder::MatchResult& _result ) {
                         << "(" << l_enumUnderlyingType << ")"
                         << l_enumeratorConstantValueAsString << ", "
                         << "sizeof(" << l_enumUnderlyingType << ")" << ");\n";
+
+                    addStatistic( statistic::enumeratorCalls );
                 }
 
             EXIT:
                 traceExit();
-            } );
-
-        logVariable( l_replacementText );
-
-        common::replaceText( _rewriter, l_callingExpression,
-                             l_replacementText );
+            };
+
+        // Enumerators do not depend on base expression, helper of call from
+        // macro expansion ignores its parameter, see MacroCallSites
+        if ( l_callingExpression->getBeginLoc().isMacroID() ) {
+            _macroCallSites.add( *( _result.Context ), l_callingExpression,
+                                 l_callbackName,
+                                 common::buildIndentedText(
+                                     l_originalDeclaration->enumerators(),
+                                     l_buildEnumeratorCall, "    " ) );
+
+        } else {
+            const std::vector< std::string > l_calledNames(
+                std::distance( l_originalDeclaration->enumerator_begin(),
+                               l_originalDeclaration->enumerator_end() ),
+                l_callbackName.str() );
+
+            // Shared expansion function, see --outline
+            const bool l_isOutlined = _outlinedExpansions.add(
+                *( _result.Context ), _rewriter, l_callingExpression,
+                l_callbackName, l_calledNames, [ & ]() -> std::string {
+                    traceEnter();
+
+                    const std::string l_returnValue =
+                        common::buildIndentedText(
+                            l_originalDeclaration->enumerators(),
+                            l_buildEnumeratorCall, "    " );
+
+                    traceExit();
+
+                    return ( l_returnValue );
+                } );
+
+            if ( !l_isOutlined ) {
+                // Everything expansion depends on, see ExpansionCache
+                const std::string l_expansionKey =
+                    ( ( getExpansionCache() )
+                          ? ( buildExpansionKey(
+                                { "iterate_enum",
+                                  buildStructuralHash( *( _result.Context ),
+                                                       l_originalDeclaration ),
+                                  l_callbackName,
+                                  ( ( l_pointerPassed ) ? ( "pointer" )
+                                                        : ( "value" ) ),
+                                  l_baseExpressionText } ) )
+                          : ( "" ) );
+
+                const std::string l_replacementText =
+                    common::buildReplacementText(
+                        _rewriter, l_callingExpression,
+                        l_originalDeclaration->enumerators(),
+                        l_buildEnumeratorCall, l_expansionKey );
+
+                logVariable( l_replacementText );
+
+                common::replaceText( _rewriter, l_callingExpression,
+                                     l_replacementText );
+            }
+        }
     }
 
 EXIT:
@@ -108,10 +203,13 @@ EXIT:
 }
 
 void IterateEnumHandler::addMatcher( MatchFinder& _matcher,
-                                     clang::Rewriter& _rewriter ) {
+                                     clang::Rewriter& _rewriter,
+                                     MacroCallSites& _macroCallSites,
+                                     OutlinedExpansions& _outlinedExpansions ) {
     traceEnter();
 
-    auto l_handler = std::make_unique< IterateEnumHandler >( _rewriter );
+    auto l_handler = std::make_unique< IterateEnumHandler >(
+        _rewriter, _macroCallSites, _outlinedExpansions );
 
     // Match calls to iterate_enum(&enum, "callback")
     _matcher.addMatcher(
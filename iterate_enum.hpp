@@ -3,16 +3,28 @@
 #include <clang/ASTMatchers/ASTMatchFinder.h>
 #include <clang/Rewrite/Core/Rewriter.h>
 
+#include "macro_call_sites.hpp"
+#include "outlined_expansions.hpp"
+
 using namespace clang::ast_matchers;
 
 class IterateEnumHandler : public MatchFinder::MatchCallback {
 public:
-    IterateEnumHandler( clang::Rewriter& _rewriter );
+    IterateEnumHandler( clang::Rewriter& _rewriter,
+                        MacroCallSites& _macroCallSites,
+                        OutlinedExpansions& _outlinedExpansions );
 
     void run( const MatchFinder::MatchResult& _result ) override;
 
-    static void addMatcher( MatchFinder& _matcher, clang::Rewriter& _rewriter );
+    static void addMatcher( MatchFinder& _matcher,
+                            clang::Rewriter& _rewriter,
+                            MacroCallSites& _macroCallSites,
+                            OutlinedExpansions& _outlinedExpansions );
 
 private:
+    void expand( const MatchFinder::MatchResult& _result );
+
     clang::Rewriter& _rewriter;
+    MacroCallSites& _macroCallSites;
+    OutlinedExpansions& _outlinedExpansions;
 };
@@ -0,0 +1,193 @@
+#include "iterate_scope.hpp"
+
+#include <memory>
+
+#include "allocation_profile.hpp"
+#include "common_ast_handlers.hpp"
+#include "dependencies.hpp"
+#include "expansion_cache.hpp"
+#include "log.hpp"
+#include "statistics.hpp"
+#include "structural_hash.hpp"
+#include "trace.hpp"
+#include "type_id.hpp"
+
+IterateScopeHandler::IterateScopeHandler( clang::Rewriter& _rewriter,
+                                          ScopeIndex& _scopeIndex )
+    : _rewriter( _rewriter ), _scopeIndex( _scopeIndex ) {
+    traceEnter();
+
+    traceExit();
+}
+
+void IterateScopeHandler::run( clang::ASTContext& _context,
+                               const clang::CallExpr* _callingExpression,
+                               const ScopeIndex::CallSite& _callSite ) {
+    traceEnter();
+
+    trackAllocations( iterateScope );
+
+    const clang::CallExpr* l_callingExpression = _callingExpression;
+
+    logVariable( l_callingExpression );
+
+    addStatistic( statistic::iterateScopeCalls );
+
+    {
+        // 1st argument
+        const clang::StringLiteral* l_callbackNameLiteral =
+            common::getStringLiteralArgument( l_callingExpression, 0 );
+
+        logVariable( l_callbackNameLiteral );
+
+        if ( !l_callbackNameLiteral ) {
+            goto EXIT;
+        }
+
+        const clang::StringRef l_callbackName =
+            l_callbackNameLiteral->getString();
+
+        logVariable( l_callbackName );
+
+        // Expansion depends on scope of every macro use, it can not be
+        // written into macro like by MacroCallSites
+        if ( l_callingExpression->getBeginLoc().isMacroID() ) {
+            logWarning( "Intrinsic call comes from macro expansion; left as "
+                        "is" );
+
+            addStatistic( statistic::macroCallSitesLeft );
+
+            goto EXIT;
+        }
+
+        if ( _callSite.scope < 0 ) {
+            logError( "Call is not inside of a function body." );
+
+            goto EXIT;
+        }
+
+        const std::vector< const clang::VarDecl* > l_visibleVariables =
+            _scopeIndex.getVisibleVariables( _callSite );
+
+        for ( const clang::VarDecl* l_variable : l_visibleVariables ) {
+            addSemanticDependency(
+                _context, l_callingExpression->getBeginLoc(), l_variable );
+        }
+
+        // Everything expansion depends on, see ExpansionCache
+        std::string l_expansionKey;
+
+        if ( getExpansionCache() ) {
+            std::vector< std::string > l_variableHashes;
+
+            for ( const clang::VarDecl* l_variable : l_visibleVariables ) {
+                l_variableHashes.push_back(
+                    buildStructuralHash( _context, l_variable ) );
+            }
+
+            std::vector< llvm::StringRef > l_parts = { "iterate_scope",
+                                                       l_callbackName };
+
+            l_parts.insert( l_parts.end(), l_variableHashes.begin(),
+                            l_variableHashes.end() );
+
+            l_expansionKey = buildExpansionKey( l_parts );
+        }
+
+        const std::string l_replacementText = common::buildReplacementText(
+            _rewriter, l_callingExpression, l_visibleVariables,
+            [ & ]( const clang::VarDecl* _variableDeclaration,
+                   llvm::raw_string_ostream& _replacementTextStringStream,
+                   const clang::StringRef _indentation ) {
+                traceEnter();
+
+                if ( !_variableDeclaration ) {
+                    goto EXIT;
+                }
+
+                {
+                    const std::string l_variableName =
+                        _variableDeclaration->getNameAsString();
+
+                    logVariable( l_variableName );
+
+                    if ( l_variableName.empty() ) {
+                        logWarning( "Variable has no name; skipping" );
+
+                        addStatistic( statistic::skippedDeclarations );
+
+                        goto EXIT;
+                    }
+
+                    // Address of register variable can not be taken
+                    if ( _variableDeclaration->getStorageClass() ==
+                         clang::SC_Register ) {
+                        logWarning( "Variable is register; skipping" );
+
+                        addStatistic( statistic::skippedDeclarations );
+
+                        goto EXIT;
+                    }
+
+                    const std::string l_variableTypeString =
+                        common::buildUnderlyingTypeString(
+                            _variableDeclaration->getType() );
+
+                    logVariable( l_variableTypeString );
+
+                    const TypeId l_variableTypeId =
+                        getTypeId( _context, _variableDeclaration->getType() );
+
+                    // callbackName(
+                    //   "variableName",
+                    //   "variableType",
+                    //   &( variableName ),
+                    //   sizeof( variableName ) );
+                    _replacementTextStringStream
+                        << _indentation
+                        << buildTypedCallbackName( l_callbackName,
+                                                   l_variableTypeId )
+                        << "(" << "\"" << l_variableName << "\", "
+                        << buildTypedCallbackTypeArgument( l_variableTypeString,
+                                                           l_variableTypeId )
+                        << ", "
+                        << "&(" << l_variableName << "), " << "sizeof("
+                        << l_variableName << ")" << ");\n";
+
+                    addStatistic( statistic::variableCalls );
+                }
+
+            EXIT:
+                traceExit();
+            },
+            l_expansionKey );
+
+        logVariable( l_replacementText );
+
+        common::replaceText( _rewriter, l_callingExpression,
+                             l_replacementText );
+    }
+
+EXIT:
+    traceExit();
+}
+
+void IterateScopeHandler::addCallSiteHandler( ScopeIndex& _scopeIndex,
+                                              clang::Rewriter& _rewriter ) {
+    traceEnter();
+
+    auto l_handler =
+        std::make_shared< IterateScopeHandler >( _rewriter, _scopeIndex );
+
+    // Calls to iterate_scope("callback") are passed together with their
+    // innermost scope by scope index traversal
+    _scopeIndex.trackCall(
+        "iterate_scope",
+        [ l_handler ]( clang::ASTContext& _context,
+                       const clang::CallExpr* _callingExpression,
+                       const ScopeIndex::CallSite& _callSite ) {
+            l_handler->run( _context, _callingExpression, _callSite );
+        } );
+
+    traceExit();
+}
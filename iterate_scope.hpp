@@ -0,0 +1,22 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include "scope_index.hpp"
+
+class IterateScopeHandler {
+public:
+    IterateScopeHandler( clang::Rewriter& _rewriter, ScopeIndex& _scopeIndex );
+
+    void run( clang::ASTContext& _context,
+              const clang::CallExpr* _callingExpression,
+              const ScopeIndex::CallSite& _callSite );
+
+    static void addCallSiteHandler( ScopeIndex& _scopeIndex,
+                                    clang::Rewriter& _rewriter );
+
+private:
+    clang::Rewriter& _rewriter;
+    ScopeIndex& _scopeIndex;
+};
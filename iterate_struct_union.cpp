@@ -1,16 +1,32 @@
 #include "iterate_struct_union.hpp"
 
 #include <memory>
+#include <vector>
 
+#include "allocation_profile.hpp"
+#include "arguments_parse.hpp"
 #include "common_ast_handlers.hpp"
+#include "dependencies.hpp"
+#include "expansion_cache.hpp"
+#include "field_flattener.hpp"
+#include "layout_report.hpp"
 #include "log.hpp"
+#include "statistics.hpp"
+#include "structural_hash.hpp"
 #include "trace.hpp"
+#include "type_id.hpp"
 
 using namespace clang::ast_matchers;
 
 IterateStructUnionHandler::IterateStructUnionHandler(
-    clang::Rewriter& _rewriter )
-    : _rewriter( _rewriter ) {
+    clang::Rewriter& _rewriter,
+    RecordLayoutCache& _recordLayoutCache,
+    MacroCallSites& _macroCallSites,
+    OutlinedExpansions& _outlinedExpansions )
+    : _rewriter( _rewriter ),
+      _recordLayoutCache( _recordLayoutCache ),
+      _macroCallSites( _macroCallSites ),
+      _outlinedExpansions( _outlinedExpansions ) {
     traceEnter();
 
     traceExit();
@@ -19,6 +35,31 @@ IterateStructUnionHandler::IterateStructUnionHandler(
 void IterateStructUnionHandler::run( const MatchFinder::MatchResult& _result ) {
     traceEnter();
 
+    trackAllocations( iterateStructUnion );
+
+    addStatistic( statistic::iterateStructUnionCalls );
+
+    const auto* l_callingExpression =
+        _result.Nodes.getNodeAs< clang::CallExpr >( "iterateStructUnionCall" );
+
+    // Helpers of calls from macro expansions are named in call order
+    if ( ( l_callingExpression ) &&
+         ( l_callingExpression->getBeginLoc().isMacroID() ) ) {
+        runOrDefer( [ this, _result ] { expand( _result ); } );
+
+    } else {
+        expand( _result );
+    }
+
+    traceExit();
+}
+
+void IterateStructUnionHandler::expand(
+    const MatchFinder::MatchResult& _result ) {
+    traceEnter();
+
+    trackAllocations( iterateStructUnion );
+
     auto [ l_callingExpression, l_recordQualifierType,
            l_recordOriginalDeclaration, l_baseExpressionText, l_pointerPassed,
            l_callbackName ] =
@@ -54,48 +95,107 @@ void IterateStructUnionHandler::run( const MatchFinder::MatchResult& _result ) {
 
     logVariable( l_recordTypeString );
 
-    const std::string l_replacementText = common::buildReplacementText(
-        _rewriter, l_callingExpression, l_recordOriginalDeclaration->fields(),
-        [ & ]( const clang::FieldDecl* _fieldDeclaration,
-               llvm::raw_string_ostream& _replacementTextStringStream,
-               const clang::StringRef _indentation ) {
-            traceEnter();
-
-            if ( ( !_fieldDeclaration ) ||
-                 ( _fieldDeclaration->isUnnamedBitField() ) ||
-                 ( !_fieldDeclaration->getIdentifier() ) ) {
-                goto EXIT;
+    const bool l_needLayout = ( ( g_needResolvedLayout ) ||
+                                ( !g_layoutReportFilePath.empty() ) ||
+                                ( !g_layoutReorderFilePath.empty() ) );
+    const RecordLayoutCache::RecordLayout* l_recordLayout =
+        ( ( l_needLayout )
+              ? ( _recordLayoutCache.get( *( _result.Context ),
+                                          l_recordOriginalDeclaration ) )
+              : ( nullptr ) );
+
+    if ( l_recordLayout ) {
+        runOrDefer( [ &l_context = *( _result.Context ), l_recordLayout ] {
+            addRecordToLayoutReport( l_context, *l_recordLayout );
+        } );
+    }
+
+    // Everything expansion depends on, see ExpansionCache
+    const std::string l_expansionKey =
+        ( ( getExpansionCache() )
+              ? ( buildExpansionKey(
+                    { "iterate_struct_union",
+                      buildStructuralHash( *( _result.Context ),
+                                           l_recordOriginalDeclaration ),
+                      l_recordTypeString, l_callbackName,
+                      ( ( l_pointerPassed ) ? ( "pointer" ) : ( "value" ) ),
+                      l_baseExpressionText } ) )
+              : ( "" ) );
+
+    // Recorded for cached text too, structural hash of record covers its
+    // nested records
+    addSemanticDependency( *( _result.Context ),
+                           l_callingExpression->getBeginLoc(),
+                           l_recordOriginalDeclaration );
+
+    // Cached text replaces call before fields are flattened.
+    // Helpers, shared expansion functions and nested records recorded as
+    // semantic dependencies need flattened fields.
+    const std::string l_cachedReplacementText =
+        ( ( ( l_callingExpression->getBeginLoc().isMacroID() ) ||
+            ( g_outlineThreshold ) || ( g_needSemanticDependencies ) )
+              ? ( "" )
+              : ( common::findCachedReplacementText(
+                    _rewriter, l_callingExpression, l_expansionKey ) ) );
+
+    if ( !l_cachedReplacementText.empty() ) {
+        common::replaceText( _rewriter, l_callingExpression,
+                             l_cachedReplacementText );
+
+        goto EXIT;
+    }
+
+    {
+        // Offsets/ sizes resolved at rewrite time instead of by C compiler,
+        // nested fields expanded up to --flatten-depth
+        const std::vector< FlatField > l_flatFields =
+            FieldFlattener( *( _result.Context ), _recordLayoutCache,
+                            g_needResolvedLayout, g_flattenDepth )
+                .flatten( l_recordOriginalDeclaration );
+
+        // Records of expanded nested fields
+        for ( const FlatField& l_flatField : l_flatFields ) {
+            if ( l_flatField.field ) {
+                addSemanticDependency( *( _result.Context ),
+                                       l_callingExpression->getBeginLoc(),
+                                       l_flatField.field->getParent() );
             }
+        }
 
-            {
-                std::string l_fieldName = _fieldDeclaration->getNameAsString();
+        // Fields are read through base expression of call, or through parameter
+        // of helper/ shared expansion function, see l_buildFunctionBody
+        clang::StringRef l_memberBase = l_baseExpressionText;
+        bool l_isMemberBasePointer = l_pointerPassed;
 
-                logVariable( l_fieldName );
+        const auto l_buildFieldCall =
+            [ & ]( const FlatField& _flatField,
+                   llvm::raw_string_ostream& _replacementTextStringStream,
+                   const clang::StringRef _indentation ) {
+                traceEnter();
 
-                if ( l_fieldName.empty() ) {
-                    logWarning( "Record has no name; skipping" );
+                // Member designator
+                const std::string& l_fieldName = _flatField.name;
 
-                    goto EXIT;
-                }
+                logVariable( l_fieldName );
 
-                std::string l_fieldType =
-                    _fieldDeclaration->getType().getAsString();
+                std::string l_fieldType = _flatField.type.getAsString();
 
                 logVariable( l_fieldType );
 
+                const TypeId l_fieldTypeId =
+                    getTypeId( *( _result.Context ), _flatField.type );
+
                 std::string l_memberAccess;
 
                 // Build member access
                 {
-                    const std::string l_baseExpressionTextString =
-                        l_baseExpressionText.str();
+                    const std::string l_memberBaseString = l_memberBase.str();
 
                     l_memberAccess =
-                        ( ( l_pointerPassed )
-                              ? ( "(" + l_baseExpressionTextString + ")->" +
+                        ( ( l_isMemberBasePointer )
+                              ? ( "(" + l_memberBaseString + ")->" +
                                   l_fieldName )
-                              : ( l_baseExpressionTextString + "." +
-                                  l_fieldName ) );
+                              : ( l_memberBaseString + "." + l_fieldName ) );
                 }
 
                 const std::string l_fieldReference =
@@ -110,32 +210,103 @@ void IterateStructUnionHandler::run( const MatchFinder::MatchResult& _result ) {
                 //   __builtin_offsetof( structType, field ),
                 //   sizeof( ( ( structType* )0 )->field ) );
                 _replacementTextStringStream
-                    << _indentation << l_callbackName << "(" << "\""
-                    << l_fieldName << "\", \"" << l_fieldType << "\", "
-                    << l_fieldReference << ", "
-                    << "__builtin_offsetof(" << l_recordTypeString << ", "
-                    << l_fieldName << "), "
-                    << "sizeof(((" << l_recordTypeString << "*)0)->"
-                    << l_fieldName << ")" << ");\n";
-            }
+                    << _indentation
+                    << buildTypedCallbackName( l_callbackName, l_fieldTypeId )
+                    << "(" << "\"" << l_fieldName << "\", "
+                    << buildTypedCallbackTypeArgument( l_fieldType,
+                                                       l_fieldTypeId )
+                    << ", " << l_fieldReference << ", ";
+
+                // Bit-fields and incomplete fields are left to C compiler
+                if ( _flatField.isResolved ) {
+                    // (__SIZE_TYPE__)fieldOffset,
+                    // (__SIZE_TYPE__)fieldSize
+                    _replacementTextStringStream
+                        << "(__SIZE_TYPE__)" << _flatField.offset << ", "
+                        << "(__SIZE_TYPE__)" << _flatField.size;
+
+                } else {
+                    _replacementTextStringStream
+                        << "__builtin_offsetof(" << l_recordTypeString << ", "
+                        << l_fieldName << "), "
+                        << "sizeof(((" << l_recordTypeString << "*)0)->"
+                        << l_fieldName << ")";
+                }
+
+                _replacementTextStringStream << ");\n";
+
+                addStatistic( statistic::fieldCalls );
+
+                traceExit();
+            };
+
+        // Body of function taking pointer to record as "_value"
+        const auto l_buildFunctionBody = [ & ]() -> std::string {
+            traceEnter();
+
+            l_memberBase = "_value";
+            l_isMemberBasePointer = true;
+
+            const std::string l_returnValue = common::buildIndentedText(
+                l_flatFields, l_buildFieldCall, "    " );
 
-        EXIT:
             traceExit();
-        } );
 
-    logVariable( l_replacementText );
+            return ( l_returnValue );
+        };
+
+        // Helper of call from macro expansion, see MacroCallSites
+        if ( l_callingExpression->getBeginLoc().isMacroID() ) {
+            _macroCallSites.add( *( _result.Context ), l_callingExpression,
+                                 l_callbackName, l_buildFunctionBody() );
+
+            goto EXIT;
+        }
+
+        {
+            std::vector< std::string > l_calledNames;
+
+            l_calledNames.reserve( l_flatFields.size() );
+
+            for ( const FlatField& l_flatField : l_flatFields ) {
+                l_calledNames.push_back( buildTypedCallbackName(
+                    l_callbackName,
+                    getTypeId( *( _result.Context ), l_flatField.type ) ) );
+            }
+
+            // Shared expansion function, see --outline
+            if ( !_outlinedExpansions.add( *( _result.Context ), _rewriter,
+                                           l_callingExpression, l_callbackName,
+                                           l_calledNames,
+                                           l_buildFunctionBody ) ) {
+                const std::string l_replacementText =
+                    common::buildReplacementText(
+                        _rewriter, l_callingExpression, l_flatFields,
+                        l_buildFieldCall, l_expansionKey );
+
+                logVariable( l_replacementText );
+
+                common::replaceText( _rewriter, l_callingExpression,
+                                     l_replacementText );
+            }
+        }
 
-    common::replaceText( _rewriter, l_callingExpression, l_replacementText );
+    }
 
 EXIT:
     traceExit();
 }
 
-void IterateStructUnionHandler::addMatcher( MatchFinder& _matcher,
-                                            clang::Rewriter& _rewriter ) {
+void IterateStructUnionHandler::addMatcher(
+    MatchFinder& _matcher,
+    clang::Rewriter& _rewriter,
+    RecordLayoutCache& _recordLayoutCache,
+    MacroCallSites& _macroCallSites,
+    OutlinedExpansions& _outlinedExpansions ) {
     traceEnter();
 
-    auto l_handler = std::make_unique< IterateStructUnionHandler >( _rewriter );
+    auto l_handler = std::make_unique< IterateStructUnionHandler >(
+        _rewriter, _recordLayoutCache, _macroCallSites, _outlinedExpansions );
 
     // Match calls to:
     // iterate_struct(&struct, "callback")
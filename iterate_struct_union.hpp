@@ -3,16 +3,32 @@
 #include <clang/ASTMatchers/ASTMatchFinder.h>
 #include <clang/Rewrite/Core/Rewriter.h>
 
+#include "macro_call_sites.hpp"
+#include "outlined_expansions.hpp"
+#include "record_layout.hpp"
+
 using namespace clang::ast_matchers;
 
 class IterateStructUnionHandler : public MatchFinder::MatchCallback {
 public:
-    IterateStructUnionHandler( clang::Rewriter& _rewriter );
+    IterateStructUnionHandler( clang::Rewriter& _rewriter,
+                               RecordLayoutCache& _recordLayoutCache,
+                               MacroCallSites& _macroCallSites,
+                               OutlinedExpansions& _outlinedExpansions );
 
     void run( const MatchFinder::MatchResult& _result ) override;
 
-    static void addMatcher( MatchFinder& _matcher, clang::Rewriter& _rewriter );
+    static void addMatcher( MatchFinder& _matcher,
+                            clang::Rewriter& _rewriter,
+                            RecordLayoutCache& _recordLayoutCache,
+                            MacroCallSites& _macroCallSites,
+                            OutlinedExpansions& _outlinedExpansions );
 
 private:
+    void expand( const MatchFinder::MatchResult& _result );
+
     clang::Rewriter& _rewriter;
+    RecordLayoutCache& _recordLayoutCache;
+    MacroCallSites& _macroCallSites;
+    OutlinedExpansions& _outlinedExpansions;
 };
@@ -0,0 +1,193 @@
+#include "jobserver.hpp"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined( __linux__ )
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "log.hpp"
+#include "trace.hpp"
+
+// Milliseconds between checks whether token is still needed
+constexpr int g_jobTokenPollInterval = 20;
+
+#if defined( __linux__ )
+
+// Own non-blocking descriptor reading and writing tokens, -1 if there is no
+// usable jobserver.
+// Inherited pipe is reopened, as making shared descriptor non-blocking would
+// change it for make too.
+static auto openJobserver() -> int {
+    traceEnter();
+
+    int l_returnValue = -1;
+
+    const char* l_makeFlags = std::getenv( "MAKEFLAGS" );
+
+    if ( !l_makeFlags ) {
+        goto EXIT;
+    }
+
+    {
+        llvm::StringRef l_authorization;
+        llvm::SmallVector< llvm::StringRef > l_words;
+
+        llvm::StringRef( l_makeFlags ).split( l_words, ' ', -1, false );
+
+        // Last one wins, --jobserver-fds is used by make before 4.2
+        for ( llvm::StringRef l_word : l_words ) {
+            if ( ( l_word.consume_front( "--jobserver-auth=" ) ) ||
+                 ( l_word.consume_front( "--jobserver-fds=" ) ) ) {
+                l_authorization = l_word;
+            }
+        }
+
+        logVariable( l_authorization );
+
+        if ( l_authorization.empty() ) {
+            goto EXIT;
+        }
+
+        std::string l_path;
+
+        if ( l_authorization.consume_front( "fifo:" ) ) {
+            l_path = l_authorization.str();
+
+        } else {
+            // R,W
+            int l_readFile = -1;
+
+            if ( ( l_authorization.split( ',' ).first.getAsInteger(
+                     10, l_readFile ) ) ||
+                 ( fcntl( l_readFile, F_GETFD ) == -1 ) ) {
+                // Recipe is not marked recursive (+), so descriptors are not
+                // inherited
+                log( "Jobserver descriptors are not inherited; jobserver is "
+                     "not used" );
+
+                goto EXIT;
+            }
+
+            l_path = ( "/proc/self/fd/" + std::to_string( l_readFile ) );
+        }
+
+        l_returnValue =
+            open( l_path.c_str(), ( O_RDWR | O_NONBLOCK | O_CLOEXEC ) );
+
+        if ( l_returnValue == -1 ) {
+            log( "Can not open jobserver '" + l_path +
+                 "': " + std::strerror( errno ) + "; jobserver is not used" );
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+#else
+
+static auto openJobserver() -> int {
+    traceEnter();
+
+    traceExit();
+
+    return ( -1 );
+}
+
+#endif
+
+// Opened once
+static auto getJobserver() -> int {
+    traceEnter();
+
+    static const int l_jobserver = openJobserver();
+
+    traceExit();
+
+    return ( l_jobserver );
+}
+
+auto hasJobserver() -> bool {
+    traceEnter();
+
+    const bool l_returnValue = ( getJobserver() != -1 );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto acquireJobToken( char& _token, const std::function< bool() >& _isNeeded )
+    -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+#if defined( __linux__ )
+    const int l_jobserver = getJobserver();
+
+    if ( l_jobserver == -1 ) {
+        goto EXIT;
+    }
+
+    while ( _isNeeded() ) {
+        if ( read( l_jobserver, &_token, 1 ) == 1 ) {
+            l_returnValue = true;
+
+            break;
+        }
+
+        const int l_error = errno;
+
+        // Taken by other process first
+        if ( ( l_error != EAGAIN ) && ( l_error != EWOULDBLOCK ) &&
+             ( l_error != EINTR ) ) {
+            logError( std::string( "Can not read jobserver token: " ) +
+                      std::strerror( l_error ) );
+
+            break;
+        }
+
+        // Woken up by token, need is checked again on timeout
+        struct pollfd l_pollRequest = { l_jobserver, POLLIN, 0 };
+
+        poll( &l_pollRequest, 1, g_jobTokenPollInterval );
+    }
+
+EXIT:
+#endif
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void releaseJobToken( const char _token ) {
+    traceEnter();
+
+#if defined( __linux__ )
+    const int l_jobserver = getJobserver();
+
+    // Pipe has room for every token there is
+    while ( write( l_jobserver, &_token, 1 ) != 1 ) {
+        if ( errno != EINTR ) {
+            logError( std::string( "Jobserver token lost: " ) +
+                      std::strerror( errno ) );
+
+            break;
+        }
+    }
+#endif
+
+    traceExit();
+}
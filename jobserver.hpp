@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+
+// Client of GNU make/ Ninja jobserver named by --jobserver-auth (fifo:PATH or
+// R,W pipe descriptors) in MAKEFLAGS, so --jobs workers share -j of build.
+// Process runs on implicit token it was started with, every further thread
+// running at once holds one token.
+// Without usable jobserver tokens are never needed, workers run freely.
+
+auto hasJobserver() -> bool;
+
+// Waits for token while _isNeeded returns true, false if it stopped being
+// needed or jobserver failed
+auto acquireJobToken( char& _token, const std::function< bool() >& _isNeeded )
+    -> bool;
+
+// Token byte is given back as read
+void releaseJobToken( const char _token );
@@ -0,0 +1,279 @@
+#include "layout_report.hpp"
+
+#include <clang/AST/Attr.h>
+#include <llvm/ADT/MapVector.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <string>
+
+#include "arguments_parse.hpp"
+#include "common_ast_handlers.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+struct LayoutReportEntry {
+    std::string report;
+    // Empty if reordering does not reduce size
+    std::string reorderedDefinition;
+};
+
+// Keyed by record location, records from shared headers are reported once
+static llvm::MapVector< std::string, LayoutReportEntry > g_layoutReportEntries;
+
+static void buildReport( const RecordLayoutCache::RecordLayout& _layout,
+                         const RecordLayoutCache::SuggestedLayout& _suggested,
+                         const clang::StringRef _recordName,
+                         const clang::StringRef _recordLocation,
+                         llvm::raw_ostream& _stream ) {
+    traceEnter();
+
+    size_t l_crossingFieldsAmount = 0;
+
+    _stream << _recordName << " (" << _recordLocation << ")\n"
+            << "    size: " << _layout.size
+            << ", alignment: " << _layout.alignment
+            << ", padding: " << _layout.paddingSize << ", cache lines: "
+            << ( ( _layout.size + RecordLayoutCache::g_cacheLineSize - 1 ) /
+                 RecordLayoutCache::g_cacheLineSize )
+            << "\n"
+            << "    "
+            << llvm::format( "%-8s %-8s %s", "offset", "size", "field" )
+            << "\n";
+
+    // Fields interleaved with padding holes in offset order
+    {
+        auto l_paddingHole = _layout.paddingHoles.begin();
+
+        for ( const RecordLayoutCache::FieldLayout& l_fieldLayout :
+              _layout.fields ) {
+            while ( ( l_paddingHole != _layout.paddingHoles.end() ) &&
+                    ( l_paddingHole->offset <= l_fieldLayout.offset ) ) {
+                _stream << "    "
+                        << llvm::format( "%-8llu %-8llu %s",
+                                         l_paddingHole->offset,
+                                         l_paddingHole->size, "<padding>" )
+                        << "\n";
+
+                l_paddingHole++;
+            }
+
+            _stream << "    "
+                    << llvm::format( "%-8llu %-8llu ", l_fieldLayout.offset,
+                                     l_fieldLayout.size )
+                    << ( ( l_fieldLayout.field->getIdentifier() )
+                             ? ( l_fieldLayout.field->getName() )
+                             : ( "<unnamed>" ) );
+
+            if ( l_fieldLayout.isBitField ) {
+                _stream << " : " << l_fieldLayout.field->getBitWidthValue();
+            }
+
+            if ( l_fieldLayout.isCrossingCacheLine ) {
+                _stream << " <crosses cache line>";
+
+                l_crossingFieldsAmount++;
+            }
+
+            _stream << "\n";
+        }
+
+        for ( ; l_paddingHole != _layout.paddingHoles.end(); l_paddingHole++ ) {
+            _stream << "    "
+                    << llvm::format( "%-8llu %-8llu %s", l_paddingHole->offset,
+                                     l_paddingHole->size, "<tail padding>" )
+                    << "\n";
+        }
+    }
+
+    if ( l_crossingFieldsAmount > 0 ) {
+        _stream << "    " << l_crossingFieldsAmount
+                << " field(s) straddle " << RecordLayoutCache::g_cacheLineSize
+                << " byte cache lines\n";
+    }
+
+    if ( !_suggested.isReorderable ) {
+        _stream << "    suggested order: not reorderable\n";
+
+    } else if ( _suggested.size >= _layout.size ) {
+        _stream << "    suggested order: already minimal\n";
+
+    } else {
+        _stream << "    suggested order:";
+
+        for ( const RecordLayoutCache::FieldLayout* l_fieldLayout :
+              _suggested.fields ) {
+            _stream << " " << l_fieldLayout->field->getName();
+        }
+
+        _stream << " (" << _suggested.size << " bytes, saves "
+                << ( _layout.size - _suggested.size ) << ")\n";
+    }
+
+    _stream << "\n";
+
+    traceExit();
+}
+
+static void buildReorderedDefinition(
+    clang::ASTContext& _context,
+    const RecordLayoutCache::RecordLayout& _layout,
+    const RecordLayoutCache::SuggestedLayout& _suggested,
+    const clang::StringRef _recordLocation,
+    llvm::raw_ostream& _stream ) {
+    traceEnter();
+
+    const clang::RecordDecl* l_record = _layout.record;
+    const clang::PrintingPolicy l_printingPolicy =
+        _context.getPrintingPolicy();
+    const clang::TypedefNameDecl* l_typedefDeclaration =
+        ( ( l_record->getIdentifier() )
+              ? ( nullptr )
+              : ( l_record->getTypedefNameForAnonDecl() ) );
+
+    _stream << "/* " << _recordLocation << ": " << _layout.size << " -> "
+            << _suggested.size << " bytes */\n";
+
+    if ( l_typedefDeclaration ) {
+        _stream << "typedef ";
+    }
+
+    _stream << l_record->getKindName();
+
+    if ( l_record->getIdentifier() ) {
+        _stream << " " << l_record->getName();
+    }
+
+    _stream << " {\n";
+
+    for ( const RecordLayoutCache::FieldLayout* l_fieldLayout :
+          _suggested.fields ) {
+        const clang::FieldDecl* l_field = l_fieldLayout->field;
+
+        _stream << "    ";
+
+        l_field->getType().print( _stream, l_printingPolicy,
+                                  l_field->getName() );
+
+        if ( l_field->hasAttr< clang::AlignedAttr >() ) {
+            _stream << " __attribute__((aligned(" << l_fieldLayout->alignment
+                    << ")))";
+        }
+
+        _stream << ";\n";
+    }
+
+    _stream << "}";
+
+    if ( l_record->hasAttr< clang::AlignedAttr >() ) {
+        _stream << " __attribute__((aligned(" << _layout.alignment << ")))";
+    }
+
+    if ( l_typedefDeclaration ) {
+        _stream << " " << l_typedefDeclaration->getName();
+    }
+
+    _stream << ";\n\n";
+
+    traceExit();
+}
+
+void addRecordToLayoutReport( clang::ASTContext& _context,
+                              const RecordLayoutCache::RecordLayout& _layout ) {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+    const std::string l_recordLocation =
+        l_sourceManager
+            .getExpansionLoc( _layout.record->getLocation() )
+            .printToString( l_sourceManager );
+
+    if ( g_layoutReportEntries.count( l_recordLocation ) ) {
+        goto EXIT;
+    }
+
+    {
+        LayoutReportEntry& l_entry = g_layoutReportEntries[ l_recordLocation ];
+
+        const RecordLayoutCache::SuggestedLayout l_suggested =
+            RecordLayoutCache::suggestLayout( _layout );
+        const std::string l_recordName =
+            common::buildRecordTypeString( _layout.record );
+
+        logVariable( l_recordName );
+
+        {
+            llvm::raw_string_ostream l_reportStringStream( l_entry.report );
+
+            buildReport( _layout, l_suggested, l_recordName,
+                         l_recordLocation, l_reportStringStream );
+        }
+
+        if ( ( l_suggested.isReorderable ) &&
+             ( l_suggested.size < _layout.size ) ) {
+            llvm::raw_string_ostream l_definitionStringStream(
+                l_entry.reorderedDefinition );
+
+            buildReorderedDefinition( _context, _layout, l_suggested,
+                                      l_recordLocation,
+                                      l_definitionStringStream );
+        }
+    }
+
+EXIT:
+    traceExit();
+}
+
+static auto writeLayoutReportPart(
+    const clang::StringRef _filePath,
+    std::string LayoutReportEntry::* _part ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    std::error_code l_errorCode;
+
+    // "-" is standard output
+    llvm::raw_fd_ostream l_outputFile( _filePath, l_errorCode,
+                                       llvm::sys::fs::OF_Text );
+
+    l_returnValue = !( l_errorCode );
+
+    if ( !l_returnValue ) {
+        logError( l_errorCode.message() );
+
+        goto EXIT;
+    }
+
+    for ( const auto& [ l_recordLocation, l_entry ] : g_layoutReportEntries ) {
+        l_outputFile << l_entry.*_part;
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto writeLayoutReport() -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    if ( !g_layoutReportFilePath.empty() ) {
+        l_returnValue = writeLayoutReportPart( g_layoutReportFilePath,
+                                               &LayoutReportEntry::report );
+    }
+
+    if ( !g_layoutReorderFilePath.empty() ) {
+        l_returnValue = ( writeLayoutReportPart(
+                              g_layoutReorderFilePath,
+                              &LayoutReportEntry::reorderedDefinition ) &&
+                          l_returnValue );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+
+#include "record_layout.hpp"
+
+// Process wide layout report of every record resolved by iterate_struct/
+// iterate_union/ iterate_struct_union, deduplicated across translation units.
+void addRecordToLayoutReport( clang::ASTContext& _context,
+                              const RecordLayoutCache::RecordLayout& _layout );
+
+// Write padding/ cache line report and reordered definitions to paths from
+// arguments
+auto writeLayoutReport() -> bool;
@@ -0,0 +1,227 @@
+#include "log.hpp"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// Bytes of lines buffered by thread before they are written
+constexpr size_t g_logBufferLimit = 65536;
+
+// Held while buffer is written to sink
+static std::mutex g_logSinkMutex;
+// Threads that logged anything, numbered in order of their first line
+static std::atomic< unsigned > g_loggingThreadCount = 0;
+
+// NOTE: Functions here are not traced, tracing writes log
+
+static auto getLevelName( const logLevel _level ) -> const char* {
+    const char* l_returnValue = "";
+
+    switch ( _level ) {
+        case logLevel::trace: {
+            l_returnValue = "trace";
+
+            break;
+        }
+
+        case logLevel::debug: {
+            l_returnValue = "debug";
+
+            break;
+        }
+
+        case logLevel::info: {
+            l_returnValue = "info";
+
+            break;
+        }
+
+        case logLevel::warning: {
+            l_returnValue = "warning";
+
+            break;
+        }
+
+        case logLevel::error: {
+            l_returnValue = "error";
+
+            break;
+        }
+    }
+
+    return ( l_returnValue );
+}
+
+// --log-file, nullptr if not requested or can not be opened.
+// Caller holds sink lock.
+static auto getLogFile() -> llvm::raw_fd_ostream* {
+    static std::unique_ptr< llvm::raw_fd_ostream > l_logFile;
+    static bool l_isOpened = false;
+
+    if ( ( !l_isOpened ) && ( !g_logFilePath.empty() ) ) {
+        l_isOpened = true;
+
+        std::error_code l_errorCode;
+
+        l_logFile = std::make_unique< llvm::raw_fd_ostream >(
+            g_logFilePath, l_errorCode, llvm::sys::fs::OF_Append );
+
+        if ( l_errorCode ) {
+            llvm::errs() << "ERROR: Can not open log file '" << g_logFilePath
+                         << "': " << l_errorCode.message() << "\n";
+
+            l_logFile.reset();
+        }
+    }
+
+    return ( l_logFile.get() );
+}
+
+static void formatLine( llvm::raw_ostream& _stream,
+                        const logLevel _level,
+                        const LogLocation& _location,
+                        const llvm::StringRef _message,
+                        const unsigned _threadIndex ) {
+    if ( g_logFormat == logFormat::json ) {
+        // {"level":"...","thread":0,"function":"...","file":"...","line":0,
+        // "message":"..."}
+        llvm::json::OStream l_json( _stream );
+
+        l_json.object( [ & ] {
+            l_json.attribute( "level", getLevelName( _level ) );
+            l_json.attribute( "thread", _threadIndex );
+            l_json.attribute( "function", _location.function );
+            l_json.attribute( "file", _location.fileName );
+            l_json.attribute( "line", _location.line );
+            l_json.attribute( "message",
+                              ( ( llvm::json::isUTF8( _message ) )
+                                    ? ( _message.str() )
+                                    : ( llvm::json::fixUTF8( _message ) ) ) );
+        } );
+
+        _stream << "\n";
+
+    } else {
+        switch ( _level ) {
+            // TRACE: Entering "function"
+            case logLevel::trace: {
+                _stream << "TRACE: " << _message << " \""
+                        << _location.function << "\"\n";
+
+                break;
+            }
+
+            // DEBUG: file:line | variable = 'value'
+            case logLevel::debug: {
+                _stream << "DEBUG: " << _location.fileName << ":"
+                        << _location.line << " | " << _message << "\n";
+
+                break;
+            }
+
+            case logLevel::info: {
+                _stream << "INFO: " << _message << "\n";
+
+                break;
+            }
+
+            case logLevel::warning: {
+                _stream << "WARNING: " << _message << "\n";
+
+                break;
+            }
+
+            // ERROR: "function" file:line | message
+            case logLevel::error: {
+                _stream << "ERROR: \"" << _location.function << "\" "
+                        << _location.fileName << ":" << _location.line
+                        << " | " << _message << "\n";
+
+                break;
+            }
+        }
+    }
+}
+
+class LogBuffer {
+public:
+    LogBuffer() : _threadIndex( g_loggingThreadCount++ ) {}
+
+    ~LogBuffer() { flush(); }
+
+    void append( const logLevel _level,
+                 const LogLocation& _location,
+                 const llvm::StringRef _message ) {
+        const bool l_isUrgent = ( _level >= logLevel::warning );
+
+        {
+            llvm::raw_string_ostream l_textStringStream(
+                ( l_isUrgent ) ? ( _urgentText ) : ( _text ) );
+
+            formatLine( l_textStringStream, _level, _location, _message,
+                        _threadIndex );
+        }
+
+        if ( ( l_isUrgent ) || ( _text.size() >= g_logBufferLimit ) ) {
+            flush();
+        }
+    }
+
+    // Lines logged before warning/ error are written before it
+    void flush() {
+        if ( ( _text.empty() ) && ( _urgentText.empty() ) ) {
+            return;
+        }
+
+        {
+            const std::lock_guard< std::mutex > l_sinkLock( g_logSinkMutex );
+
+            llvm::raw_fd_ostream* l_logFile = getLogFile();
+
+            if ( l_logFile ) {
+                *l_logFile << _text << _urgentText;
+
+                l_logFile->flush();
+
+            } else {
+                if ( !_text.empty() ) {
+                    llvm::outs() << _text;
+
+                    llvm::outs().flush();
+                }
+
+                llvm::errs() << _urgentText;
+            }
+        }
+
+        _text.clear();
+        _urgentText.clear();
+    }
+
+private:
+    // Trace/ debug/ info lines
+    std::string _text;
+    // Warning/ error line, written right away
+    std::string _urgentText;
+    unsigned _threadIndex;
+};
+
+// Created on first line of thread, written when thread ends
+static auto getLogBuffer() -> LogBuffer& {
+    static thread_local LogBuffer l_logBuffer;
+
+    return ( l_logBuffer );
+}
+
+void writeLog( const logLevel _level,
+               const LogLocation& _location,
+               const llvm::StringRef _message ) {
+    getLogBuffer().append( _level, _location, _message );
+}
+
+void flushLog() {
+    getLogBuffer().flush();
+}
@@ -1,67 +1,135 @@
 #pragma once
 
+#include <llvm/ADT/StringRef.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "arguments_parse.hpp"
 #include "common.hpp"
 
-#define LOG_INFO_PREFIX "INFO: "
-#define LOG_WARNING_PREFIX "WARNING: "
-#define LOG_ERROR_PREFIX "ERROR: "
+// Levels below LOG_LEVEL are compiled out, so their calls cost nothing, e.g.
+// -DLOG_LEVEL=2 removes tracing and variable dumps. Errors are always kept.
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_ERROR 4
 
-// TODO: Decide on this
-// Function file:line | message
-#define LOG_ERROR_FORMAT                                               \
-    "\"" << __PRETTY_FUNCTION__ << "\"" << " " << __FILE_NAME__ << ":" \
-         << __LINE__ << " | "
+#if !defined( LOG_LEVEL )
+#define LOG_LEVEL LOG_LEVEL_TRACE
+#endif
 
-#define log( _message )                                              \
-    do {                                                             \
-        if ( g_isVerboseRun ) {                                      \
-            llvm::outs() << LOG_INFO_PREFIX << ( _message ) << "\n"; \
-        }                                                            \
+enum class logLevel : uint8_t {
+    trace = LOG_LEVEL_TRACE,
+    // Variable dumps
+    debug = LOG_LEVEL_DEBUG,
+    info = LOG_LEVEL_INFO,
+    warning = LOG_LEVEL_WARNING,
+    error = LOG_LEVEL_ERROR,
+};
+
+struct LogLocation {
+    const char* function;
+    const char* fileName;
+    unsigned line;
+};
+
+#define LOG_LOCATION \
+    ( LogLocation{ __PRETTY_FUNCTION__, __FILE_NAME__, __LINE__ } )
+
+// Line is appended to buffer of calling thread, see --log-format.
+// Buffer is written at once when it fills, when its thread ends or when
+// warning/ error is logged, so lines of --jobs workers never interleave and
+// nothing logged before error is lost.
+// Text lines go to standard output, warnings/ errors to standard error, or
+// every line goes to --log-file if given.
+void writeLog( const logLevel _level,
+               const LogLocation& _location,
+               const llvm::StringRef _message );
+
+// Write buffer of calling thread
+void flushLog();
+
+#if ( LOG_LEVEL <= LOG_LEVEL_INFO )
+#define log( _message )                                         \
+    do {                                                        \
+        if ( g_isVerboseRun ) {                                 \
+            writeLog( logLevel::info, LOG_LOCATION, _message ); \
+        }                                                       \
+    } while ( 0 )
+#else
+#define log( _message ) \
+    do {                \
     } while ( 0 )
+#endif
 
-#define logWarning( _message )                                          \
-    do {                                                                \
-        if ( g_needWarningsAsErrors ) {                                 \
-            logError( _message );                                       \
-        } else if ( !g_isQuietRun ) {                                   \
-            llvm::errs() << LOG_WARNING_PREFIX << ( _message ) << "\n"; \
-        }                                                               \
+#if ( LOG_LEVEL <= LOG_LEVEL_WARNING )
+#define logWarning( _message )                                     \
+    do {                                                           \
+        if ( g_needWarningsAsErrors ) {                            \
+            logError( _message );                                  \
+        } else if ( !g_isQuietRun ) {                              \
+            writeLog( logLevel::warning, LOG_LOCATION, _message ); \
+        }                                                          \
     } while ( 0 )
+#else
+#define logWarning( _message )          \
+    do {                                \
+        if ( g_needWarningsAsErrors ) { \
+            logError( _message );       \
+        }                               \
+    } while ( 0 )
+#endif
 
-#define logError( _message ) \
-    llvm::errs() << LOG_ERROR_PREFIX LOG_ERROR_FORMAT << ( _message ) << "\n";
+#define logError( _message )                                 \
+    do {                                                     \
+        writeLog( logLevel::error, LOG_LOCATION, _message ); \
+    } while ( 0 )
 
-#define logVariable( _variable )                                            \
-    do {                                                                    \
-        if ( g_isVerboseRun ) {                                             \
-            _logVariable( LOG_INFO_PREFIX __FILE_NAME__                     \
-                          ":" MACRO_TO_STRING( __LINE__ ) " | " #_variable, \
-                          _variable );                                      \
-        }                                                                   \
+#if ( LOG_LEVEL <= LOG_LEVEL_DEBUG )
+#define logVariable( _variable )                                     \
+    do {                                                             \
+        if ( g_isVerboseRun ) {                                      \
+            std::string l_logMessage;                                \
+            llvm::raw_string_ostream l_logMessageStringStream(       \
+                l_logMessage );                                      \
+            _logVariable( l_logMessageStringStream, #_variable,      \
+                          _variable );                               \
+            writeLog( logLevel::debug, LOG_LOCATION,                 \
+                      l_logMessageStringStream.str() );              \
+        }                                                            \
+    } while ( 0 )
+#else
+#define logVariable( _variable ) \
+    do {                         \
     } while ( 0 )
+#endif
 
 template < typename T >
-void _logVariable( const char* _variableName, const T& _value ) {
-    llvm::outs() << _variableName << " = '" << _value << "'\n";
+void _logVariable( llvm::raw_ostream& _stream,
+                   const char* _variableName,
+                   const T& _value ) {
+    _stream << _variableName << " = '" << _value << "'";
 }
 
 // NOTE: Overload for vector
 template < typename T >
-void _logVariable( const char* _variableName,
+void _logVariable( llvm::raw_ostream& _stream,
+                   const char* _variableName,
                    const std::vector< T >& _vector ) {
-    llvm::outs() << _variableName << " = [";
+    _stream << _variableName << " = [";
 
     for ( size_t l_elementIndex = 0; l_elementIndex < _vector.size();
           ++l_elementIndex ) {
-        llvm::outs() << _vector[ l_elementIndex ];
+        _stream << _vector[ l_elementIndex ];
 
         if ( ( l_elementIndex + 1 ) < _vector.size() ) {
-            llvm::outs() << ", ";
+            _stream << ", ";
         }
     }
 
-    llvm::outs() << "]\n";
+    _stream << "]";
 }
@@ -0,0 +1,339 @@
+#include "macro_call_sites.hpp"
+
+#include <clang/Basic/CharInfo.h>
+#include <clang/Lex/Lexer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+
+#include "bundle.hpp"
+#include "common_ast_handlers.hpp"
+#include "dependencies.hpp"
+#include "log.hpp"
+#include "statistics.hpp"
+#include "trace.hpp"
+
+// Call written at _offset, through closing parenthesis, and its first
+// argument. False if call is not closed or has no second argument.
+static auto scanCallText( const llvm::StringRef _buffer,
+                          const size_t _offset,
+                          llvm::StringRef& _callText,
+                          llvm::StringRef& _firstArgument ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    size_t l_position = _offset;
+    size_t l_firstArgumentBegin = 0;
+    size_t l_firstArgumentEnd = 0;
+    size_t l_depth = 0;
+    char l_quote = '\0';
+
+    while ( ( l_position < _buffer.size() ) &&
+            ( clang::isAsciiIdentifierContinue( _buffer[ l_position ] ) ) ) {
+        l_position++;
+    }
+
+    // Line continuations of macro definition included
+    while ( ( l_position < _buffer.size() ) &&
+            ( ( clang::isWhitespace( _buffer[ l_position ] ) ) ||
+              ( _buffer[ l_position ] == '\\' ) ) ) {
+        l_position++;
+    }
+
+    if ( ( l_position == _buffer.size() ) ||
+         ( _buffer[ l_position ] != '(' ) ) {
+        goto EXIT;
+    }
+
+    l_firstArgumentBegin = ( l_position + 1 );
+
+    for ( ; l_position < _buffer.size(); l_position++ ) {
+        const char l_character = _buffer[ l_position ];
+
+        if ( l_quote ) {
+            if ( l_character == '\\' ) {
+                l_position++;
+
+            } else if ( l_character == l_quote ) {
+                l_quote = '\0';
+            }
+
+            continue;
+        }
+
+        if ( ( l_character == '"' ) || ( l_character == '\'' ) ) {
+            l_quote = l_character;
+
+        } else if ( l_character == '(' ) {
+            l_depth++;
+
+        } else if ( l_character == ')' ) {
+            l_depth--;
+
+            if ( l_depth == 0 ) {
+                l_returnValue = true;
+
+                break;
+            }
+
+        } else if ( ( l_character == ',' ) && ( l_depth == 1 ) &&
+                    ( !l_firstArgumentEnd ) ) {
+            l_firstArgumentEnd = l_position;
+        }
+    }
+
+    l_returnValue = ( ( l_returnValue ) && ( l_firstArgumentEnd ) );
+
+    if ( !l_returnValue ) {
+        goto EXIT;
+    }
+
+    _callText = _buffer.slice( _offset, ( l_position + 1 ) );
+    _firstArgument =
+        _buffer.slice( l_firstArgumentBegin, l_firstArgumentEnd ).trim();
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void MacroCallSites::add( clang::ASTContext& _context,
+                          const clang::CallExpr* _callingExpression,
+                          const clang::StringRef _callbackName,
+                          const std::string& _helperBody ) {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+
+    const clang::FunctionDecl* l_intrinsic =
+        _callingExpression->getDirectCallee();
+    const clang::SourceLocation l_location =
+        l_sourceManager.getSpellingLoc( _callingExpression->getBeginLoc() );
+
+    // Selection at call site depends on every use of macro
+    addSharedLocation( _context, _callingExpression->getBeginLoc() );
+
+    if ( ( !l_intrinsic ) ||
+         ( !l_sourceManager.isWrittenInMainFile( l_location ) ) ) {
+        logWarning( "Intrinsic call written in macro of other file; left as "
+                    "is" );
+
+        // Counted as left by rewrite
+        _callSites.insert( { l_location.getRawEncoding(), CallSite() } );
+
+        goto EXIT;
+    }
+
+    {
+        const clang::Decl* l_topLevelDeclaration =
+            _topLevelDeclarations.find( l_sourceManager, _callingExpression );
+        const clang::SourceLocation l_insertLocation =
+            ( ( l_topLevelDeclaration )
+                  ? ( l_sourceManager.getExpansionLoc(
+                        l_topLevelDeclaration->getBeginLoc() ) )
+                  : ( clang::SourceLocation() ) );
+
+        if ( ( l_insertLocation.isInvalid() ) ||
+             ( !l_sourceManager.isWrittenInMainFile( l_insertLocation ) ) ) {
+            logWarning( "Macro with intrinsic call is used outside of main "
+                        "file; left as is" );
+
+            // Counted as left by rewrite, unless other use is expanded
+            _callSites.insert( { l_location.getRawEncoding(), CallSite() } );
+
+            goto EXIT;
+        }
+
+        CallSite& l_callSite = _callSites[ l_location.getRawEncoding() ];
+
+        if ( l_callSite.location.isInvalid() ) {
+            l_callSite.location = l_location;
+            l_callSite.intrinsicName = l_intrinsic->getNameAsString();
+            l_callSite.callbackName = _callbackName.str();
+            l_callSite.insertLocation = l_insertLocation;
+
+        } else if ( l_sourceManager.isBeforeInTranslationUnit(
+                        l_insertLocation, l_callSite.insertLocation ) ) {
+            l_callSite.insertLocation = l_insertLocation;
+        }
+
+        if ( l_callSite.callbackName != _callbackName ) {
+            logWarning( "Macro passes different callbacks to intrinsic; left "
+                        "as is" );
+
+            l_callSite.isValid = false;
+        }
+
+        // Pointer to iterated type, arrays decay
+        clang::QualType l_parameterType =
+            _callingExpression->getArg( 0 )->IgnoreParenImpCasts()->getType();
+
+        if ( l_parameterType->isArrayType() ) {
+            l_parameterType = _context.getArrayDecayedType( l_parameterType );
+        }
+
+        const clang::QualType l_pointeeType = l_parameterType->getPointeeType();
+
+        // Named by typedef or tag
+        const clang::NamedDecl* l_typeDeclaration = nullptr;
+
+        if ( const auto* l_typedefType =
+                 l_pointeeType->getAs< clang::TypedefType >() ) {
+            l_typeDeclaration = l_typedefType->getDecl();
+
+        } else if ( const clang::TagDecl* l_tagDeclaration =
+                        l_pointeeType->getAsTagDecl() ) {
+            l_typeDeclaration = l_tagDeclaration->getCanonicalDecl();
+        }
+
+        if ( ( !l_typeDeclaration ) ||
+             ( l_typeDeclaration->getName().empty() ) ) {
+            logWarning( "Macro passes unnamed type to intrinsic; left as is" );
+
+            l_callSite.isValid = false;
+
+            goto EXIT;
+        }
+
+        l_callSite.typeLocations.push_back( l_sourceManager.getExpansionLoc(
+            l_typeDeclaration->getLocation() ) );
+
+        // Compatible types can not be both selected by _Generic
+        void* l_typeKey =
+            _context.getCanonicalType( l_parameterType ).getAsOpaquePtr();
+
+        if ( l_callSite.helpers.count( l_typeKey ) ) {
+            goto EXIT;
+        }
+
+        // c_extra_intrinsic_line_column_index
+        const std::string l_helperName =
+            ( "c_extra_" + l_callSite.intrinsicName + "_" +
+              std::to_string(
+                  l_sourceManager.getSpellingLineNumber( l_location ) ) +
+              "_" +
+              std::to_string(
+                  l_sourceManager.getSpellingColumnNumber( l_location ) ) +
+              "_" + std::to_string( l_callSite.helpers.size() ) );
+
+        logVariable( l_helperName );
+
+        l_callSite.helpers[ l_typeKey ] = Helper{
+            l_helperName, ( l_pointeeType.getAsString() + "*" ), _helperBody };
+    }
+
+EXIT:
+    traceExit();
+}
+
+void MacroCallSites::rewrite( clang::ASTContext& _context,
+                              clang::Rewriter& _rewriter ) {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+
+    for ( const auto& l_entry : _callSites ) {
+        const CallSite& l_callSite = l_entry.second;
+
+        if ( ( !l_callSite.isValid ) || ( l_callSite.location.isInvalid() ) ) {
+            addStatistic( statistic::macroCallSitesLeft );
+
+            continue;
+        }
+
+        // Selection names every type where first helper is inserted
+        if ( !std::all_of( l_callSite.typeLocations.begin(),
+                           l_callSite.typeLocations.end(),
+                           [ & ]( const clang::SourceLocation _location ) {
+                               return ( l_sourceManager
+                                            .isBeforeInTranslationUnit(
+                                                _location,
+                                                l_callSite.insertLocation ) );
+                           } ) ) {
+            logWarning( "Type passed to intrinsic in macro is declared after "
+                        "first use of macro; left as is" );
+
+            addStatistic( statistic::macroCallSitesLeft );
+
+            continue;
+        }
+
+        llvm::StringRef l_callText;
+        llvm::StringRef l_firstArgument;
+
+        const std::pair< clang::FileID, unsigned > l_fileOffset =
+            l_sourceManager.getDecomposedLoc( l_callSite.location );
+
+        if ( !scanCallText(
+                 l_sourceManager.getBufferData( l_fileOffset.first ),
+                 l_fileOffset.second, l_callText, l_firstArgument ) ) {
+            logWarning( "Intrinsic call in macro is not closed; left as is" );
+
+            addStatistic( statistic::macroCallSitesLeft );
+
+            continue;
+        }
+
+        logVariable( l_callText );
+
+        const unsigned l_intrinsicNameLength = clang::Lexer::MeasureTokenLength(
+            l_callSite.location, l_sourceManager, _context.getLangOpts() );
+
+        std::string l_helpers;
+        std::string l_selection;
+
+        {
+            llvm::raw_string_ostream l_helpersStringStream( l_helpers );
+            llvm::raw_string_ostream l_selectionStringStream( l_selection );
+
+            // Written on one line, as it may be in macro definition
+            l_selectionStringStream << "_Generic((" << l_firstArgument << ")";
+
+            for ( const auto& l_helper : l_callSite.helpers ) {
+                const Helper& l_helperValue = l_helper.second;
+
+                // Rest of arguments of intrinsic are ignored.
+                // static inline __attribute__((always_inline)) void
+                // helper(type* _value, ...) {
+                //     callbackName(...);
+                // }
+                l_helpersStringStream
+                    << "static inline __attribute__((always_inline)) void\n"
+                    << l_helperValue.name << "("
+                    << l_helperValue.parameterType << " _value, ...) {\n"
+                    << "    (void)_value;\n"
+                    << l_helperValue.body << "}\n\n";
+
+                l_selectionStringStream << ", " << l_helperValue.parameterType
+                                        << ": " << l_helperValue.name;
+
+                addBundledHelper( _context, l_helperValue.name );
+            }
+
+            l_selectionStringStream
+                << ", default: "
+                << l_callText.take_front( l_intrinsicNameLength ) << ")";
+
+            l_helpersStringStream.flush();
+            l_selectionStringStream.flush();
+        }
+
+        logVariable( l_selection );
+
+        _rewriter.InsertTextAfter( l_callSite.insertLocation, l_helpers );
+        _rewriter.ReplaceText( l_callSite.location, l_intrinsicNameLength,
+                               l_selection );
+
+        addSharedLocation( _context, l_callSite.insertLocation );
+        addSharedLocation( _context, l_callSite.location );
+
+        addStatistic( statistic::macroCallSites );
+        addStatistic( statistic::bytesReplaced, l_intrinsicNameLength );
+        addStatistic( statistic::bytesInserted,
+                      ( l_helpers.size() + l_selection.size() ) );
+    }
+
+    traceExit();
+}
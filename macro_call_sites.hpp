@@ -0,0 +1,64 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Expr.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+#include <llvm/ADT/MapVector.h>
+
+#include <string>
+
+#include "top_level_declarations.hpp"
+
+// Per translation unit intrinsic calls coming from macro expansions.
+// Expansion can not replace call where macro is used, as macro may do more
+// than call, and can not replace call where it is written, as every use of
+// macro may pass other type.
+// So every type call is expanded for gets its specialized helper, inserted
+// before first use, and intrinsic is replaced where it is written (macro
+// definition or macro argument) by _Generic selection of helpers, keeping
+// arguments:
+// iterate_struct( _value, cb ) ->
+// _Generic( ( _value ), struct a*: helper_0, struct b*: helper_1,
+//           default: iterate_struct )( _value, cb )
+// Uses of macro with type never expanded for (other file, skipped body, call
+// not expanded) select intrinsic itself.
+class MacroCallSites {
+public:
+    MacroCallSites( const TopLevelDeclarations& _topLevelDeclarations )
+        : _topLevelDeclarations( _topLevelDeclarations ) {}
+
+    // Expansion of call, reading through pointer parameter "_value"
+    void add( clang::ASTContext& _context,
+              const clang::CallExpr* _callingExpression,
+              const clang::StringRef _callbackName,
+              const std::string& _helperBody );
+
+    // Insert helpers and rewrite calls, after every handler ran
+    void rewrite( clang::ASTContext& _context, clang::Rewriter& _rewriter );
+
+private:
+    struct Helper {
+        std::string name;
+        // Pointer type of first argument
+        std::string parameterType;
+        std::string body;
+    };
+
+    struct CallSite {
+        // Where intrinsic name is written, invalid if no use was expanded
+        clang::SourceLocation location;
+        std::string intrinsicName;
+        std::string callbackName;
+        // Before top level declaration of first use
+        clang::SourceLocation insertLocation;
+        // Every named type must be declared before insert location
+        llvm::SmallVector< clang::SourceLocation, 4 > typeLocations;
+        // Different callbacks or unnamed types, left as is
+        bool isValid = true;
+        // By canonical type
+        llvm::MapVector< void*, Helper > helpers;
+    };
+
+    const TopLevelDeclarations& _topLevelDeclarations;
+    llvm::MapVector< clang::SourceLocation::UIntTy, CallSite > _callSites;
+};
@@ -4,8 +4,16 @@
 #include <clang/Tooling/Tooling.h>
 #include <llvm/TargetParser/Host.h>
 
+#include "allocation_profile.hpp"
 #include "arguments_parse.hpp"
+#include "bundle.hpp"
 #include "cextra_frontend.hpp"
+#include "expansion_cache.hpp"
+#include "incremental.hpp"
+#include "layout_report.hpp"
+#include "prescan.hpp"
+#include "shared_file_system.hpp"
+#include "statistics.hpp"
 #include "llvm/Option/Option.h"
 #include "trace.hpp"
 
@@ -102,13 +110,20 @@ auto main( int _argumentCount, char* _argumentVector[] ) -> int {
             goto EXIT;
         }
 
+        startAllocationTracking();
+
         if ( g_needDefaultSystemIncludePaths ) {
+            const PhaseStart l_driverProbeStart =
+                startPhase( phase::driverProbe );
+
             std::vector< std::string > l_defaultSystemIncludes =
                 getDefaultSystemIncludesFromDriver();
 
             g_compileArguments.insert( g_compileArguments.end(),
                                        l_defaultSystemIncludes.begin(),
                                        l_defaultSystemIncludes.end() );
+
+            endPhase( "", phase::driverProbe, l_driverProbeStart );
         }
 
         // TODO: Enable on verbose
@@ -124,26 +139,67 @@ auto main( int _argumentCount, char* _argumentVector[] ) -> int {
             log( l_compileArgumentsAsString );
         }
 
+        if ( !g_expansionCacheFilePath.empty() ) {
+            getExpansionCache()->load( g_expansionCacheFilePath );
+        }
+
         clang::tooling::FixedCompilationDatabase l_compilationDatabase(
             g_compilationSourceDirectory, g_compileArguments );
-        clang::tooling::ClangTool l_tool( l_compilationDatabase, g_sources );
-
-        auto l_actionFactory =
-            ( ( g_isCheckOnly )
-                  ? ( clang::tooling::newFrontendActionFactory<
-                        clang::SyntaxOnlyAction >() )
-                  // TODO: #repeat, #regexp
-                  // TODO: iterate_struct, iterate_enum, iterate_union,
-                  // iterate_arguments, iterate_annotation, iterate_scope
-                  // TODO: constinit, consteval, constexpr
-                  : ( clang::tooling::newFrontendActionFactory<
-                        CExtraFrontendAction >() ) );
-
-        l_returnValue = ( l_tool.run( l_actionFactory.get() ) == 0 );
+
+        // Inputs mentioning no intrinsic are not parsed
+        const bool l_isPassedThrough =
+            ( ( g_passthroughMode == passthroughMode::none ) ||
+              ( passThroughSources( g_sources ) ) );
+
+        if ( g_isIncrementalRun ) {
+            l_returnValue = runIncrementalSession( l_compilationDatabase );
+
+        } else if ( g_isWatchRun ) {
+            l_returnValue = runWatchSession( l_compilationDatabase );
+
+        } else if ( !g_sources.empty() ) {
+            // Headers are looked up and read once for all inputs
+            clang::tooling::ClangTool l_tool(
+                l_compilationDatabase, g_sources,
+                std::make_shared< clang::PCHContainerOperations >(),
+                createSharedFileSystem() );
+
+            auto l_actionFactory =
+                ( ( g_isCheckOnly )
+                      ? ( clang::tooling::newFrontendActionFactory<
+                            clang::SyntaxOnlyAction >() )
+                      // TODO: #repeat, #regexp
+                      // TODO: iterate_annotation
+                      // TODO: constinit, consteval, constexpr
+                      : ( clang::tooling::newFrontendActionFactory<
+                            CExtraFrontendAction >() ) );
+
+            l_returnValue = ( l_tool.run( l_actionFactory.get() ) == 0 );
+        }
+
+        l_returnValue = ( l_isPassedThrough && l_returnValue );
+
+        l_returnValue = ( writeLayoutReport() && l_returnValue );
+
+        if ( !g_isDryRun ) {
+            l_returnValue = ( writeBundle() && l_returnValue );
+        }
+
+        if ( !g_expansionCacheFilePath.empty() ) {
+            l_returnValue =
+                ( getExpansionCache()->save( g_expansionCacheFilePath ) &&
+                  l_returnValue );
+        }
+
+        l_returnValue = ( writeStatistics() && l_returnValue );
+        l_returnValue = ( writeProfile() && l_returnValue );
     }
 
 EXIT:
     traceExit();
 
+    // Rest of buffered lines of main thread
+    flushLog();
+
     return ( ( l_returnValue ) ? ( 0 ) : ( 1 ) );
 }
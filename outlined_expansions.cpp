@@ -0,0 +1,247 @@
+#include "outlined_expansions.hpp"
+
+#include <clang/Lex/Lexer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdint>
+
+#include "arguments_parse.hpp"
+#include "bundle.hpp"
+#include "common_ast_handlers.hpp"
+#include "dependencies.hpp"
+#include "log.hpp"
+#include "parallel_match.hpp"
+#include "statistics.hpp"
+#include "trace.hpp"
+
+// Whether every name is function declared at file scope
+static auto areFunctions( clang::ASTContext& _context,
+                          const llvm::ArrayRef< std::string > _names )
+    -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    for ( const std::string& l_name : _names ) {
+        const clang::DeclContextLookupResult l_lookupResult =
+            _context.getTranslationUnitDecl()->lookup(
+                clang::DeclarationName( &( _context.Idents.get( l_name ) ) ) );
+
+        if ( ( l_lookupResult.empty() ) ||
+             ( !llvm::isa< clang::FunctionDecl >( l_lookupResult.front() ) ) ) {
+            l_returnValue = false;
+
+            break;
+        }
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto OutlinedExpansions::add( clang::ASTContext& _context,
+                              clang::Rewriter& _rewriter,
+                              const clang::CallExpr* _callingExpression,
+                              const clang::StringRef _callbackName,
+                              const llvm::ArrayRef< std::string > _calledNames,
+                              const llvm::function_ref< std::string() >
+                                  _buildBody ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+
+    if ( ( !g_outlineThreshold ) ||
+         ( _calledNames.size() < g_outlineThreshold ) ||
+         ( !_callingExpression->getDirectCallee() ) ) {
+        goto EXIT;
+    }
+
+    {
+        // Identifiers, decayed types and source buffers are created lazily
+        auto l_handlerStateLock = lockHandlerState();
+
+        if ( !areFunctions( _context, _calledNames ) ) {
+            goto EXIT;
+        }
+
+        const clang::Expr* l_firstArgument = _callingExpression->getArg( 0 );
+
+        // Pointer to iterated type, arrays decay
+        clang::QualType l_parameterType =
+            l_firstArgument->IgnoreParenImpCasts()->getType();
+
+        if ( l_parameterType->isArrayType() ) {
+            l_parameterType = _context.getArrayDecayedType( l_parameterType );
+        }
+
+        const clang::QualType l_pointeeType = l_parameterType->getPointeeType();
+
+        // Named by typedef or tag at file scope
+        const clang::NamedDecl* l_typeDeclaration = nullptr;
+
+        if ( const auto* l_typedefType =
+                 l_pointeeType->getAs< clang::TypedefType >() ) {
+            l_typeDeclaration = l_typedefType->getDecl();
+
+        } else if ( const clang::TagDecl* l_tagDeclaration =
+                        l_pointeeType->getAsTagDecl() ) {
+            l_typeDeclaration = l_tagDeclaration;
+        }
+
+        if ( ( !l_typeDeclaration ) ||
+             ( l_typeDeclaration->getName().empty() ) ||
+             ( !l_typeDeclaration->getDeclContext()->isFileContext() ) ) {
+            goto EXIT;
+        }
+
+        // Written in macro argument is empty
+        bool l_isInvalid = false;
+
+        const clang::StringRef l_firstArgumentText =
+            clang::Lexer::getSourceText(
+                clang::CharSourceRange::getTokenRange(
+                    l_firstArgument->getSourceRange() ),
+                l_sourceManager, _context.getLangOpts(), &l_isInvalid );
+
+        if ( ( l_isInvalid ) || ( l_firstArgumentText.empty() ) ) {
+            goto EXIT;
+        }
+
+        const clang::Decl* l_topLevelDeclaration =
+            _topLevelDeclarations.find( l_sourceManager, _callingExpression );
+        const clang::SourceLocation l_insertLocation =
+            ( ( l_topLevelDeclaration )
+                  ? ( l_sourceManager.getExpansionLoc(
+                        l_topLevelDeclaration->getBeginLoc() ) )
+                  : ( clang::SourceLocation() ) );
+
+        if ( ( l_insertLocation.isInvalid() ) ||
+             ( !l_sourceManager.isWrittenInMainFile( l_insertLocation ) ) ) {
+            goto EXIT;
+        }
+
+        const std::string l_intrinsicName =
+            _callingExpression->getDirectCallee()->getNameAsString();
+
+        const std::string l_key =
+            ( l_intrinsicName + ":" + _callbackName.str() + ":" +
+              std::to_string( reinterpret_cast< uintptr_t >(
+                  _context.getCanonicalType( l_parameterType )
+                      .getAsOpaquePtr() ) ) );
+
+        Function l_function;
+
+        l_function.description =
+            ( l_intrinsicName + "(" + l_pointeeType.getAsString() + "*, " +
+              _callbackName.str() + ")" );
+        l_function.parameterType = ( l_pointeeType.getAsString() + "*" );
+        l_function.insertLocation = l_insertLocation;
+
+        l_handlerStateLock.unlock();
+
+        // Body is built once, by whichever worker reaches key first
+        {
+            std::unique_lock< std::mutex > l_bodiesLock( _bodiesMutex );
+
+            if ( !_bodies.contains( l_key ) ) {
+                l_bodiesLock.unlock();
+
+                std::string l_body = _buildBody();
+
+                l_bodiesLock.lock();
+
+                _bodies.try_emplace( l_key, std::move( l_body ) );
+            }
+        }
+
+        // Name depends on every other outlined call
+        addSharedLocation( _context, _callingExpression->getBeginLoc() );
+
+        // Named and first use found in call order
+        runOrDefer( [ this, &_rewriter, _callingExpression, l_key,
+                      l_intrinsicName, l_function,
+                      l_firstArgumentText = l_firstArgumentText.str() ] {
+            auto [ l_iterator, l_isInserted ] =
+                _functions.insert( { l_key, l_function } );
+
+            Function& l_namedFunction = l_iterator->second;
+
+            if ( l_isInserted ) {
+                // c_extra_outlined_intrinsic_index
+                l_namedFunction.name =
+                    ( "c_extra_outlined_" + l_intrinsicName + "_" +
+                      std::to_string( _functions.size() - 1 ) );
+
+                {
+                    const std::lock_guard< std::mutex > l_bodiesLock(
+                        _bodiesMutex );
+
+                    l_namedFunction.body = _bodies.lookup( l_key );
+                }
+
+                logVariable( l_namedFunction.name );
+
+            } else if ( _rewriter.getSourceMgr().isBeforeInTranslationUnit(
+                            l_function.insertLocation,
+                            l_namedFunction.insertLocation ) ) {
+                l_namedFunction.insertLocation = l_function.insertLocation;
+            }
+
+            // functionName(firstArgument);
+            common::replaceText( _rewriter, _callingExpression,
+                                 ( l_namedFunction.name + "(" +
+                                   l_firstArgumentText + ");" ) );
+        } );
+
+        addStatistic( statistic::outlinedCalls );
+
+        l_returnValue = true;
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void OutlinedExpansions::insert( clang::ASTContext& _context,
+                                 clang::Rewriter& _rewriter ) {
+    traceEnter();
+
+    const char* l_attributes =
+        ( ( g_needNoinlineOutlined ) ? ( "static __attribute__((noinline))" )
+                                     : ( "static inline" ) );
+
+    for ( const auto& l_entry : _functions ) {
+        const Function& l_function = l_entry.second;
+
+        std::string l_text;
+        llvm::raw_string_ostream l_textStringStream( l_text );
+
+        // // intrinsic(type*, callbackName)
+        // static inline void functionName(type* _value) {
+        //     callbackName(...);
+        // }
+        l_textStringStream << "// " << l_function.description << "\n"
+                           << l_attributes << " void " << l_function.name
+                           << "(" << l_function.parameterType
+                           << " _value) {\n"
+                           << "    (void)_value;\n"
+                           << l_function.body << "}\n\n";
+
+        l_textStringStream.flush();
+
+        _rewriter.InsertTextAfter( l_function.insertLocation, l_text );
+
+        addSharedLocation( _context, l_function.insertLocation );
+
+        addBundledHelper( _context, l_function.name );
+
+        addStatistic( statistic::bytesInserted, l_text.size() );
+    }
+
+    traceExit();
+}
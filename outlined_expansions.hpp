@@ -0,0 +1,61 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Expr.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/MapVector.h>
+#include <llvm/ADT/STLFunctionalExtras.h>
+#include <llvm/ADT/StringMap.h>
+
+#include <mutex>
+#include <string>
+
+#include "top_level_declarations.hpp"
+
+// Per translation unit expansion functions shared by calls, see --outline.
+// Every call of same intrinsic, iterated type and callback expands to same
+// text, so instead of pasting it at every call site, it is emitted once as
+// static inline (or noinline) function taking pointer to iterated value,
+// inserted before first use, and calls become calls to it.
+class OutlinedExpansions {
+public:
+    OutlinedExpansions( const TopLevelDeclarations& _topLevelDeclarations )
+        : _topLevelDeclarations( _topLevelDeclarations ) {}
+
+    // Whether intrinsic call is replaced by call of shared function, not if
+    // call stays expanded inline: expansion is smaller than --outline
+    // threshold, callback is not a function (macro may differ between calls)
+    // or iterated type can not be named at file scope.
+    // Expansion reading through pointer parameter "_value" is built once, by
+    // worker matching call, function is named and call replaced in call
+    // order.
+    auto add( clang::ASTContext& _context,
+              clang::Rewriter& _rewriter,
+              const clang::CallExpr* _callingExpression,
+              const clang::StringRef _callbackName,
+              const llvm::ArrayRef< std::string > _calledNames,
+              const llvm::function_ref< std::string() > _buildBody ) -> bool;
+
+    // Insert functions, after every handler ran
+    void insert( clang::ASTContext& _context, clang::Rewriter& _rewriter );
+
+private:
+    struct Function {
+        std::string name;
+        // "iterate_struct(asset_t*, printAsset)"
+        std::string description;
+        // Pointer type of first argument
+        std::string parameterType;
+        std::string body;
+        // Before top level declaration of first use
+        clang::SourceLocation insertLocation;
+    };
+
+    const TopLevelDeclarations& _topLevelDeclarations;
+    // By intrinsic, callback and canonical type, in naming order
+    llvm::MapVector< std::string, Function > _functions;
+    // Of functions, by same key
+    llvm::StringMap< std::string > _bodies;
+    std::mutex _bodiesMutex;
+};
@@ -0,0 +1,199 @@
+#include "parallel_match.hpp"
+
+#include <clang/AST/RecursiveASTVisitor.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "jobserver.hpp"
+#include "log.hpp"
+#include "top_level_declarations.hpp"
+#include "trace.hpp"
+
+using DeferredActions = std::vector< std::function< void() > >;
+
+// Of partition worker is matching, nullptr on calling thread
+static thread_local DeferredActions* g_deferredActions = nullptr;
+
+static std::recursive_mutex g_handlerStateMutex;
+
+class PartitionMatcher
+    : public clang::RecursiveASTVisitor< PartitionMatcher > {
+public:
+    PartitionMatcher( clang::ast_matchers::MatchFinder& _matcher,
+                      clang::ASTContext& _context )
+        : _matcher( _matcher ), _context( _context ) {}
+
+    auto VisitCallExpr( clang::CallExpr* _callingExpression ) -> bool {
+        _matcher.match( *_callingExpression, _context );
+
+        return ( true );
+    }
+
+    auto VisitRecordDecl( clang::RecordDecl* _record ) -> bool {
+        _matcher.match( *_record, _context );
+
+        return ( true );
+    }
+
+private:
+    clang::ast_matchers::MatchFinder& _matcher;
+    clang::ASTContext& _context;
+};
+
+void matchInParallel(
+    clang::ASTContext& _context,
+    const unsigned _jobCount,
+    const std::function< void( clang::ast_matchers::MatchFinder& ) >&
+        _addMatchers ) {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+
+    const std::vector< clang::Decl* > l_declarations =
+        getMainFileDeclarations( _context );
+
+    // Declarations of partition are [ begin, end )
+    std::vector< size_t > l_partitionEnds;
+
+    {
+        const unsigned l_endOffset =
+            ( ( l_declarations.empty() )
+                  ? ( 0 )
+                  : ( l_sourceManager.getFileOffset(
+                        l_sourceManager.getExpansionLoc(
+                            l_declarations.back()->getEndLoc() ) ) ) );
+
+        for ( size_t l_declarationIndex = 0;
+              l_declarationIndex < l_declarations.size();
+              l_declarationIndex++ ) {
+            const unsigned l_offset = l_sourceManager.getFileOffset(
+                l_sourceManager.getExpansionLoc(
+                    l_declarations[ l_declarationIndex ]->getEndLoc() ) );
+
+            // Source size of partitions so far reached next share
+            if ( ( l_declarationIndex + 1 == l_declarations.size() ) ||
+                 ( ( static_cast< uint64_t >( l_offset ) * _jobCount ) >=
+                   ( static_cast< uint64_t >( l_endOffset ) *
+                     ( l_partitionEnds.size() + 1 ) ) ) ) {
+                l_partitionEnds.push_back( l_declarationIndex + 1 );
+            }
+        }
+    }
+
+    logVariable( l_partitionEnds.size() );
+
+    {
+        std::vector< DeferredActions > l_partitionActions(
+            l_partitionEnds.size() );
+        std::vector< std::thread > l_workers;
+        // Partitions are taken in order by whichever worker is free, as
+        // workers may wait for jobserver tokens
+        std::atomic< size_t > l_nextPartitionIndex = 0;
+
+        l_workers.reserve( l_partitionEnds.size() );
+
+        for ( size_t l_workerIndex = 0;
+              l_workerIndex < l_partitionEnds.size(); l_workerIndex++ ) {
+            l_workers.emplace_back( [ &, l_workerIndex ] {
+                traceEnter();
+
+                // First worker runs on token of process
+                const bool l_needsToken =
+                    ( ( l_workerIndex ) && ( hasJobserver() ) );
+                char l_token = 0;
+
+                if ( ( l_needsToken ) &&
+                     ( !acquireJobToken( l_token, [ & ] {
+                         return ( l_nextPartitionIndex.load() <
+                                  l_partitionEnds.size() );
+                     } ) ) ) {
+                    goto EXIT;
+                }
+
+                {
+                    clang::ast_matchers::MatchFinder l_matcher;
+
+                    _addMatchers( l_matcher );
+
+                    PartitionMatcher l_partitionMatcher( l_matcher, _context );
+
+                    for ( size_t l_partitionIndex = l_nextPartitionIndex++;
+                          l_partitionIndex < l_partitionEnds.size();
+                          l_partitionIndex = l_nextPartitionIndex++ ) {
+                        const size_t l_begin =
+                            ( ( l_partitionIndex )
+                                  ? ( l_partitionEnds[ l_partitionIndex - 1 ] )
+                                  : ( 0 ) );
+                        const size_t l_end =
+                            l_partitionEnds[ l_partitionIndex ];
+
+                        g_deferredActions =
+                            &( l_partitionActions[ l_partitionIndex ] );
+
+                        for ( size_t l_declarationIndex = l_begin;
+                              l_declarationIndex < l_end;
+                              l_declarationIndex++ ) {
+                            l_partitionMatcher.TraverseDecl(
+                                l_declarations[ l_declarationIndex ] );
+                        }
+                    }
+
+                    g_deferredActions = nullptr;
+
+                    if ( l_needsToken ) {
+                        releaseJobToken( l_token );
+                    }
+                }
+
+            EXIT:
+                traceExit();
+            } );
+        }
+
+        for ( std::thread& l_worker : l_workers ) {
+            l_worker.join();
+        }
+
+        for ( DeferredActions& l_actions : l_partitionActions ) {
+            for ( const std::function< void() >& l_action : l_actions ) {
+                l_action();
+            }
+        }
+    }
+
+    traceExit();
+}
+
+auto isDeferringActions() -> bool {
+    traceEnter();
+
+    const bool l_returnValue = ( g_deferredActions != nullptr );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void runOrDefer( std::function< void() > _action ) {
+    traceEnter();
+
+    if ( g_deferredActions ) {
+        g_deferredActions->push_back( std::move( _action ) );
+
+    } else {
+        _action();
+    }
+
+    traceExit();
+}
+
+auto lockHandlerState() -> std::unique_lock< std::recursive_mutex > {
+    traceEnter();
+
+    traceExit();
+
+    return ( std::unique_lock< std::recursive_mutex >( g_handlerStateMutex ) );
+}
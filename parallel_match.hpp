@@ -0,0 +1,41 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+
+#include <functional>
+#include <mutex>
+
+// Handlers of translation unit run on --jobs worker threads.
+// Main file top-level declarations are split into contiguous partitions of
+// about same source size, traversed by workers with own MatchFinder filled by
+// _addMatchers. Only calls and records are matched, as every matcher is rooted
+// at one.
+// Inside of make/ Ninja with jobserver every worker but first waits for token,
+// free workers take remaining partitions.
+// Every handler keeps to contract below, with or without --jobs:
+// - Expansion text is built on worker, without lock.
+// - State shared between workers is read and written under
+//   lockHandlerState: caches, and ASTContext/ SourceManager data computed
+//   lazily (types, sizes, layouts, file lookups, loaded source locations).
+// - Actions touching rewriter or state whose order shows in output (helper
+//   names, dependencies, reports) go through runOrDefer. They run on calling
+//   thread in partition order once every worker finishes, so output does not
+//   depend on scheduling.
+void matchInParallel(
+    clang::ASTContext& _context,
+    unsigned _jobCount,
+    const std::function< void( clang::ast_matchers::MatchFinder& ) >&
+        _addMatchers );
+
+// Whether running on worker thread of matchInParallel
+auto isDeferringActions() -> bool;
+
+// Run now, or after every worker finishes if running on worker thread
+void runOrDefer( std::function< void() > _action );
+
+// Held around state handlers share between workers: caches, reports and
+// lazily computed ASTContext/ SourceManager data (types, layouts, file
+// lookups).
+// Recursive, as cached queries nest.
+auto lockHandlerState() -> std::unique_lock< std::recursive_mutex >;
@@ -0,0 +1,162 @@
+#include "performance_counters.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#if defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "log.hpp"
+#include "trace.hpp"
+
+// In performanceCounter order
+static constexpr const char* g_performanceCounterNames[] = {
+    "cycles", "instructions", "llc_misses", "page_faults", "context_switches",
+};
+
+static_assert( ( sizeof( g_performanceCounterNames ) /
+                 sizeof( *g_performanceCounterNames ) ) ==
+                   static_cast< size_t >( performanceCounter::count ),
+               "Every performance counter needs name" );
+
+#if defined( __linux__ )
+
+struct PerformanceCounterEvent {
+    uint32_t type;
+    uint64_t config;
+};
+
+// In performanceCounter order
+static constexpr PerformanceCounterEvent g_performanceCounterEvents[] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+// -1 if counter is unavailable
+using PerformanceCounterFiles =
+    std::array< int, static_cast< size_t >( performanceCounter::count ) >;
+
+static auto openPerformanceCounters() -> PerformanceCounterFiles {
+    traceEnter();
+
+    PerformanceCounterFiles l_returnValue;
+
+    l_returnValue.fill( -1 );
+
+    // name: reason, ...
+    std::string l_unavailableCounters;
+
+    for ( size_t l_counterIndex = 0; l_counterIndex < l_returnValue.size();
+          l_counterIndex++ ) {
+        struct perf_event_attr l_attributes = {};
+
+        l_attributes.size = sizeof( l_attributes );
+        l_attributes.type = g_performanceCounterEvents[ l_counterIndex ].type;
+        l_attributes.config =
+            g_performanceCounterEvents[ l_counterIndex ].config;
+        // To scale counts of multiplexed counters
+        l_attributes.read_format = ( PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                     PERF_FORMAT_TOTAL_TIME_RUNNING );
+        // Threads started later are counted too, see --jobs
+        l_attributes.inherit = 1;
+        l_attributes.exclude_hv = 1;
+
+        int l_error = 0;
+
+        // Unprivileged process may only count user space, see
+        // perf_event_paranoid
+        for ( const bool l_isKernelExcluded : { false, true } ) {
+            l_attributes.exclude_kernel = l_isKernelExcluded;
+
+            l_returnValue[ l_counterIndex ] = static_cast< int >(
+                syscall( SYS_perf_event_open, &l_attributes, 0, -1, -1,
+                         PERF_FLAG_FD_CLOEXEC ) );
+            l_error = errno;
+
+            if ( ( l_returnValue[ l_counterIndex ] != -1 ) ||
+                 ( ( l_error != EACCES ) && ( l_error != EPERM ) ) ) {
+                break;
+            }
+        }
+
+        if ( l_returnValue[ l_counterIndex ] == -1 ) {
+            if ( !l_unavailableCounters.empty() ) {
+                l_unavailableCounters += ", ";
+            }
+
+            l_unavailableCounters +=
+                ( std::string( g_performanceCounterNames[ l_counterIndex ] ) +
+                  ": " + std::strerror( l_error ) );
+        }
+    }
+
+    if ( !l_unavailableCounters.empty() ) {
+        log( "Performance counters unavailable (" + l_unavailableCounters +
+             ")" );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+#endif
+
+auto readPerformanceCounters() -> PerformanceCounters {
+    traceEnter();
+
+    PerformanceCounters l_returnValue;
+
+#if defined( __linux__ )
+    // Opened once, counters of process
+    static const PerformanceCounterFiles l_files = openPerformanceCounters();
+
+    for ( size_t l_counterIndex = 0; l_counterIndex < l_files.size();
+          l_counterIndex++ ) {
+        if ( l_files[ l_counterIndex ] == -1 ) {
+            continue;
+        }
+
+        // value, time enabled, time running
+        uint64_t l_values[ 3 ] = {};
+
+        if ( read( l_files[ l_counterIndex ], l_values, sizeof( l_values ) ) !=
+             static_cast< ssize_t >( sizeof( l_values ) ) ) {
+            continue;
+        }
+
+        // Estimated for whole time if counter shared hardware with others
+        l_returnValue.values[ l_counterIndex ] =
+            ( ( ( l_values[ 2 ] ) && ( l_values[ 2 ] < l_values[ 1 ] ) )
+                  ? ( static_cast< uint64_t >(
+                        static_cast< double >( l_values[ 0 ] ) *
+                        ( static_cast< double >( l_values[ 1 ] ) /
+                          static_cast< double >( l_values[ 2 ] ) ) ) )
+                  : ( l_values[ 0 ] ) );
+        l_returnValue.isAvailable[ l_counterIndex ] = true;
+    }
+#endif
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto getPerformanceCounterName( const performanceCounter _counter )
+    -> const char* {
+    traceEnter();
+
+    const char* l_returnValue =
+        g_performanceCounterNames[ static_cast< size_t >( _counter ) ];
+
+    traceExit();
+
+    return ( l_returnValue );
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Hardware/ software counters read around phases, see --profile detailed
+enum class performanceCounter : uint8_t {
+    cycles,
+    instructions,
+    // Last level cache, on most processors
+    cacheMisses,
+    pageFaults,
+    contextSwitches,
+    count,
+};
+
+struct PerformanceCounters {
+    std::array< uint64_t, static_cast< size_t >( performanceCounter::count ) >
+        values = {};
+    // Not supported by kernel/ hardware or not permitted, e.g. in container
+    // without perf_event_open
+    std::array< bool, static_cast< size_t >( performanceCounter::count ) >
+        isAvailable = {};
+};
+
+// Counts of process since counters were opened by first call, including
+// threads started after it (--jobs workers) once they end.
+// Unavailable counters are left out, every counter is unavailable outside of
+// Linux.
+auto readPerformanceCounters() -> PerformanceCounters;
+
+auto getPerformanceCounterName( const performanceCounter _counter )
+    -> const char*;
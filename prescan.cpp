@@ -0,0 +1,388 @@
+#include "prescan.hpp"
+
+#include <clang/Lex/Lexer.h>
+#include <clang/Lex/MacroInfo.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdio>
+#include <cstring>
+
+#if defined( __linux__ )
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include "arguments_parse.hpp"
+#include "cextra_frontend.hpp"
+#include "dependencies.hpp"
+#include "log.hpp"
+#include "statistics.hpp"
+#include "trace.hpp"
+
+// Every intrinsic name starts with it
+constexpr const char* g_intrinsicPrefix = "iterate_";
+// Every annotation starts with it
+constexpr const char* g_annotationPrefix = "c_extra_";
+
+static auto contains( const llvm::StringRef _text,
+                      const llvm::StringRef _needle ) -> bool {
+    traceEnter();
+
+    // C library memmem is vectorized, unlike byte loop
+    const bool l_returnValue =
+        ( ( !_needle.empty() ) &&
+          ( memmem( _text.data(), _text.size(), _needle.data(),
+                    _needle.size() ) ) );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto mentionsIntrinsics( const llvm::StringRef _text ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = ( ( contains( _text, g_intrinsicPrefix ) ) ||
+                           ( contains( _text, g_annotationPrefix ) ) );
+
+    for ( const std::string& l_intrinsicMacro : g_intrinsicMacros ) {
+        if ( l_returnValue ) {
+            break;
+        }
+
+        l_returnValue = contains( _text, l_intrinsicMacro );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// Shares data blocks on copy-on-write file systems, false if not supported
+static auto reflinkFile( const std::string& _inputPath,
+                         const std::string& _outputPath ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = false;
+
+#if defined( __linux__ ) && defined( FICLONE )
+    {
+        const int l_inputFileDescriptor =
+            open( _inputPath.c_str(), ( O_RDONLY | O_CLOEXEC ) );
+
+        if ( l_inputFileDescriptor < 0 ) {
+            goto EXIT;
+        }
+
+        const int l_outputFileDescriptor =
+            open( _outputPath.c_str(),
+                  ( O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC ), 0644 );
+
+        if ( l_outputFileDescriptor >= 0 ) {
+            l_returnValue = ( ioctl( l_outputFileDescriptor, FICLONE,
+                                     l_inputFileDescriptor ) == 0 );
+
+            close( l_outputFileDescriptor );
+        }
+
+        close( l_inputFileDescriptor );
+    }
+
+EXIT:
+#endif
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+static auto passThroughFile( const std::string& _inputPath,
+                             const std::string& _outputPath,
+                             const llvm::MemoryBuffer& _input ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    std::error_code l_errorCode;
+
+    if ( g_needOnlyPrintResult ) {
+        if ( g_passthroughMode != passthroughMode::skip ) {
+            flushLog();
+
+            llvm::outs() << _input.getBuffer();
+        }
+
+        goto EXIT;
+    }
+
+    // Edited in place
+    if ( ( g_isDryRun ) || ( _inputPath == _outputPath ) ) {
+        goto EXIT;
+    }
+
+    switch ( g_passthroughMode ) {
+        case passthroughMode::copy: {
+            if ( !reflinkFile( _inputPath, _outputPath ) ) {
+                l_errorCode = llvm::sys::fs::copy_file( _inputPath,
+                                                        _outputPath );
+            }
+
+            break;
+        }
+
+        case passthroughMode::link: {
+            llvm::sys::fs::remove( _outputPath );
+
+            // Across file systems
+            if ( llvm::sys::fs::create_hard_link( _inputPath, _outputPath ) ) {
+                l_errorCode = llvm::sys::fs::copy_file( _inputPath,
+                                                        _outputPath );
+            }
+
+            break;
+        }
+
+        case passthroughMode::none:
+        case passthroughMode::skip: {
+            break;
+        }
+    }
+
+    l_returnValue = !( l_errorCode );
+
+    if ( !l_returnValue ) {
+        logError( l_errorCode.message() );
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto passThroughSources( std::vector< std::string >& _sources ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    std::vector< std::string > l_remainingSources;
+    size_t l_passedThroughCount = 0;
+
+    for ( const std::string& l_source : _sources ) {
+        // Mapped for large inputs
+        llvm::ErrorOr< std::unique_ptr< llvm::MemoryBuffer > > l_input =
+            llvm::MemoryBuffer::getFile( l_source, false, false );
+
+        // Unreadable input is reported by regular processing
+        if ( ( !l_input ) ||
+             ( mentionsIntrinsics( ( *l_input )->getBuffer() ) ) ) {
+            l_remainingSources.push_back( l_source );
+
+            continue;
+        }
+
+        // Same path regular processing writes to
+        llvm::SmallString< FILENAME_MAX > l_inputPath;
+        llvm::SmallString< FILENAME_MAX > l_outputPath;
+
+        if ( ( llvm::sys::fs::real_path( l_source, l_inputPath ) ) ||
+             ( !buildOutputPath( l_inputPath, l_outputPath ) ) ) {
+            l_remainingSources.push_back( l_source );
+
+            continue;
+        }
+
+        l_returnValue =
+            ( passThroughFile( l_inputPath.str().str(),
+                               l_outputPath.str().str(), **l_input ) &&
+              l_returnValue );
+
+        if ( ( ( g_needDepfile ) || ( g_needSemanticDependencies ) ) &&
+             ( !g_isDryRun ) ) {
+            l_returnValue = ( writePassthroughDependencyFiles( l_inputPath,
+                                                               l_outputPath ) &&
+                              l_returnValue );
+        }
+
+        l_passedThroughCount++;
+    }
+
+    logVariable( l_passedThroughCount );
+
+    addStatistic( statistic::passedThroughInputs, l_passedThroughCount );
+
+    _sources = std::move( l_remainingSources );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto isIntrinsicName( const llvm::StringRef _name,
+                      const llvm::StringSet<>& _intrinsicMacros ) -> bool {
+    traceEnter();
+
+    const bool l_returnValue = ( ( _name.starts_with( g_intrinsicPrefix ) ) ||
+                                 ( _intrinsicMacros.count( _name ) ) );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+IntrinsicMacroCollector::IntrinsicMacroCollector(
+    llvm::StringSet<>& _intrinsicMacros )
+    : _intrinsicMacros( _intrinsicMacros ) {
+    traceEnter();
+
+    for ( const std::string& l_intrinsicMacro : g_intrinsicMacros ) {
+        _intrinsicMacros.insert( l_intrinsicMacro );
+    }
+
+    traceExit();
+}
+
+void IntrinsicMacroCollector::MacroDefined(
+    const clang::Token& _macroNameToken,
+    const clang::MacroDirective* _macroDirective ) {
+    traceEnter();
+
+    const clang::MacroInfo* l_macroInfo = _macroDirective->getMacroInfo();
+    const llvm::StringRef l_macroName =
+        _macroNameToken.getIdentifierInfo()->getName();
+
+    for ( const clang::Token& l_token : l_macroInfo->tokens() ) {
+        const clang::IdentifierInfo* l_identifierInfo =
+            l_token.getIdentifierInfo();
+
+        if ( !l_identifierInfo ) {
+            continue;
+        }
+
+        if ( isIntrinsicName( l_identifierInfo->getName(),
+                              _intrinsicMacros ) ) {
+            addIntrinsicMacro( l_macroName );
+
+            break;
+        }
+
+        // Macro used may be defined later
+        _usingMacros[ l_identifierInfo->getName() ].emplace_back(
+            l_macroName );
+    }
+
+    traceExit();
+}
+
+void IntrinsicMacroCollector::addIntrinsicMacro( const llvm::StringRef _name ) {
+    traceEnter();
+
+    std::vector< std::string > l_names = { _name.str() };
+
+    while ( !l_names.empty() ) {
+        const std::string l_name = std::move( l_names.back() );
+
+        l_names.pop_back();
+
+        if ( !_intrinsicMacros.insert( l_name ).second ) {
+            continue;
+        }
+
+        auto l_usingMacros = _usingMacros.find( l_name );
+
+        if ( l_usingMacros == _usingMacros.end() ) {
+            continue;
+        }
+
+        for ( std::string& l_usingMacro : l_usingMacros->second ) {
+            l_names.emplace_back( std::move( l_usingMacro ) );
+        }
+
+        _usingMacros.erase( l_usingMacros );
+    }
+
+    traceExit();
+}
+
+auto mayFunctionBodyMentionIntrinsics(
+    const clang::SourceManager& _sourceManager,
+    const clang::LangOptions& _langOptions,
+    const clang::SourceLocation _declarationEnd,
+    const llvm::StringSet<>& _intrinsicMacros ) -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    if ( ( _declarationEnd.isInvalid() ) || ( _declarationEnd.isMacroID() ) ) {
+        goto EXIT;
+    }
+
+    {
+        const auto [ l_fileId, l_offset ] =
+            _sourceManager.getDecomposedLoc( _declarationEnd );
+
+        bool l_isInvalid = false;
+
+        const llvm::StringRef l_buffer =
+            _sourceManager.getBufferData( l_fileId, &l_isInvalid );
+
+        if ( l_isInvalid ) {
+            goto EXIT;
+        }
+
+        // From last token of declarator, through parameter declarations and
+        // attributes, up to closing brace of body
+        clang::Lexer l_lexer( _sourceManager.getLocForStartOfFile( l_fileId ),
+                              _langOptions, l_buffer.begin(),
+                              ( l_buffer.begin() + l_offset ), l_buffer.end() );
+
+        clang::Token l_token;
+        size_t l_braceDepth = 0;
+
+        for ( ;; ) {
+            const bool l_isEndOfFile = l_lexer.LexFromRawLexer( l_token );
+
+            // Braces in inactive branch would unbalance body
+            if ( ( l_token.is( clang::tok::hash ) ) &&
+                 ( l_token.isAtStartOfLine() ) ) {
+                break;
+            }
+
+            if ( ( l_token.is( clang::tok::raw_identifier ) ) &&
+                 ( isIntrinsicName( l_token.getRawIdentifier(),
+                                    _intrinsicMacros ) ) ) {
+                break;
+            }
+
+            if ( l_token.is( clang::tok::l_brace ) ) {
+                l_braceDepth++;
+
+            } else if ( l_token.is( clang::tok::r_brace ) ) {
+                if ( !l_braceDepth ) {
+                    break;
+                }
+
+                l_braceDepth--;
+
+                if ( !l_braceDepth ) {
+                    l_returnValue = false;
+
+                    break;
+                }
+            }
+
+            if ( l_isEndOfFile ) {
+                break;
+            }
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <clang/Basic/LangOptions.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Lex/PPCallbacks.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+
+#include <string>
+#include <vector>
+
+// Whether raw bytes of input mention intrinsic ("iterate_"), annotation
+// ("c_extra_") or macro from --intrinsic-macro.
+// Comments and string literals are not skipped, false positive only costs
+// regular processing.
+auto mentionsIntrinsics( const llvm::StringRef _text ) -> bool;
+
+// Inputs mentioning no intrinsic are passed through to their output path, as
+// requested by --passthrough, and removed from sources, without building
+// compiler instance for them
+auto passThroughSources( std::vector< std::string >& _sources ) -> bool;
+
+// Intrinsic ("iterate_" prefixed) or macro expanding to intrinsic call
+auto isIntrinsicName( const llvm::StringRef _name,
+                      const llvm::StringSet<>& _intrinsicMacros ) -> bool;
+
+// Collects macros expanding to intrinsic calls while preprocessing, directly
+// or through other macros, defined before or after them, starting with
+// --intrinsic-macro
+class IntrinsicMacroCollector : public clang::PPCallbacks {
+public:
+    IntrinsicMacroCollector( llvm::StringSet<>& _intrinsicMacros );
+
+    void MacroDefined( const clang::Token& _macroNameToken,
+                       const clang::MacroDirective* _macroDirective ) override;
+
+private:
+    // Marks macro and macros using it
+    void addIntrinsicMacro( const llvm::StringRef _name );
+
+    llvm::StringSet<>& _intrinsicMacros;
+    // Identifier -> macros not known to be intrinsic, whose body uses it
+    llvm::StringMap< std::vector< std::string > > _usingMacros;
+};
+
+// Whether body of function declared up to _declarationEnd, not parsed yet,
+// mentions intrinsic or intrinsic macro, see --skip-function-bodies.
+// Raw tokens are scanned, so body with preprocessor directives or written in
+// macro is always assumed to mention one.
+auto mayFunctionBodyMentionIntrinsics(
+    const clang::SourceManager& _sourceManager,
+    const clang::LangOptions& _langOptions,
+    const clang::SourceLocation _declarationEnd,
+    const llvm::StringSet<>& _intrinsicMacros ) -> bool;
@@ -0,0 +1,236 @@
+#include "record_layout.hpp"
+
+#include <clang/AST/RecordLayout.h>
+
+#include <algorithm>
+#include <string>
+
+#include "log.hpp"
+#include "parallel_match.hpp"
+#include "trace.hpp"
+
+auto RecordLayoutCache::get( clang::ASTContext& _context,
+                             const clang::RecordDecl* _record )
+    -> const RecordLayout* {
+    traceEnter();
+
+    const RecordLayout* l_returnValue = nullptr;
+
+    const auto l_handlerStateLock = lockHandlerState();
+
+    if ( !_record ) {
+        goto EXIT;
+    }
+
+    _record = _record->getDefinition();
+
+    if ( ( !_record ) || ( _record->isInvalidDecl() ) ) {
+        goto EXIT;
+    }
+
+    {
+        std::unique_ptr< RecordLayout >& l_cachedLayout = _layouts[ _record ];
+
+        if ( l_cachedLayout ) {
+            l_returnValue = l_cachedLayout.get();
+
+            goto EXIT;
+        }
+
+        const clang::ASTRecordLayout& l_astRecordLayout =
+            _context.getASTRecordLayout( _record );
+        const uint64_t l_characterWidth = _context.getCharWidth();
+
+        auto l_layout = std::make_unique< RecordLayout >();
+
+        l_layout->record = _record;
+        l_layout->size = l_astRecordLayout.getSize().getQuantity();
+        l_layout->alignment = l_astRecordLayout.getAlignment().getQuantity();
+
+        // End of already laid out storage
+        uint64_t l_endInBits = 0;
+
+        auto l_addPaddingHole = [ & ]( const uint64_t _beginInBits,
+                                       const uint64_t _endInBits ) {
+            const uint64_t l_begin =
+                ( ( _beginInBits + l_characterWidth - 1 ) / l_characterWidth );
+            const uint64_t l_end = ( _endInBits / l_characterWidth );
+
+            if ( l_end > l_begin ) {
+                l_layout->paddingHoles.push_back(
+                    { l_begin, ( l_end - l_begin ) } );
+                l_layout->paddingSize += ( l_end - l_begin );
+            }
+        };
+
+        for ( const clang::FieldDecl* l_field : _record->fields() ) {
+            FieldLayout l_fieldLayout;
+
+            const clang::QualType l_fieldType = l_field->getType();
+            uint64_t l_sizeInBits = 0;
+
+            l_fieldLayout.field = l_field;
+            l_fieldLayout.offsetInBits =
+                l_astRecordLayout.getFieldOffset( l_field->getFieldIndex() );
+            l_fieldLayout.offset =
+                ( l_fieldLayout.offsetInBits / l_characterWidth );
+            l_fieldLayout.isBitField = l_field->isBitField();
+
+            if ( ( !l_fieldType->isIncompleteArrayType() ) &&
+                 ( l_fieldType->isConstantSizeType() ) ) {
+                l_fieldLayout.size =
+                    _context.getTypeSizeInChars( l_fieldType ).getQuantity();
+                l_fieldLayout.alignment =
+                    _context.getDeclAlign( l_field ).getQuantity();
+                l_sizeInBits = ( l_fieldLayout.size * l_characterWidth );
+
+            } else if ( l_fieldType->isIncompleteArrayType() ) {
+                // Flexible array member
+                l_fieldLayout.alignment =
+                    _context
+                        .getTypeAlignInChars(
+                            _context.getBaseElementType( l_fieldType ) )
+                        .getQuantity();
+            }
+
+            if ( l_fieldLayout.isBitField ) {
+                l_sizeInBits = l_field->getBitWidthValue();
+            }
+
+            if ( l_sizeInBits > 0 ) {
+                const uint64_t l_firstByte =
+                    ( l_fieldLayout.offsetInBits / l_characterWidth );
+                const uint64_t l_lastByte =
+                    ( ( l_fieldLayout.offsetInBits + l_sizeInBits - 1 ) /
+                      l_characterWidth );
+
+                l_fieldLayout.isCrossingCacheLine =
+                    ( ( l_firstByte / g_cacheLineSize ) !=
+                      ( l_lastByte / g_cacheLineSize ) );
+            }
+
+            // Union members all start at 0, only tail padding is possible
+            if ( ( !_record->isUnion() ) &&
+                 ( l_fieldLayout.offsetInBits > l_endInBits ) ) {
+                l_addPaddingHole( l_endInBits, l_fieldLayout.offsetInBits );
+            }
+
+            l_endInBits = std::max( l_endInBits, ( l_fieldLayout.offsetInBits +
+                                                   l_sizeInBits ) );
+
+            l_layout->fields.push_back( l_fieldLayout );
+        }
+
+        // Tail padding
+        l_addPaddingHole( l_endInBits, ( l_layout->size * l_characterWidth ) );
+
+        // Layout defects
+        if ( g_isVerboseRun ) {
+            std::string l_message;
+            llvm::raw_string_ostream l_messageStringStream( l_message );
+
+            l_messageStringStream << "Layout of '" << _record->getName()
+                                  << "': " << l_layout->size << " bytes, "
+                                  << l_layout->paddingSize
+                                  << " bytes of padding";
+
+            for ( const PaddingHole& l_paddingHole : l_layout->paddingHoles ) {
+                l_messageStringStream << ", hole at " << l_paddingHole.offset
+                                      << " of " << l_paddingHole.size;
+            }
+
+            for ( const FieldLayout& l_fieldLayout : l_layout->fields ) {
+                if ( l_fieldLayout.isCrossingCacheLine ) {
+                    l_messageStringStream
+                        << ", '" << l_fieldLayout.field->getName()
+                        << "' crosses cache line";
+                }
+            }
+
+            l_messageStringStream.flush();
+
+            log( l_message );
+        }
+
+        l_cachedLayout = std::move( l_layout );
+        l_returnValue = l_cachedLayout.get();
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto RecordLayoutCache::suggestLayout( const RecordLayout& _layout )
+    -> SuggestedLayout {
+    traceEnter();
+
+    SuggestedLayout l_returnValue;
+
+    const FieldLayout* l_flexibleArrayMember = nullptr;
+
+    if ( ( _layout.record->isUnion() ) ||
+         ( _layout.record->hasAttr< clang::PackedAttr >() ) ) {
+        goto EXIT;
+    }
+
+    for ( const FieldLayout& l_fieldLayout : _layout.fields ) {
+        if ( ( l_fieldLayout.isBitField ) ||
+             ( !l_fieldLayout.field->getIdentifier() ) ||
+             ( l_fieldLayout.alignment == 0 ) ) {
+            l_returnValue.fields.clear();
+
+            goto EXIT;
+        }
+
+        // Flexible array member has to stay last
+        if ( l_fieldLayout.size == 0 ) {
+            l_flexibleArrayMember = &l_fieldLayout;
+
+            continue;
+        }
+
+        l_returnValue.fields.push_back( &l_fieldLayout );
+    }
+
+    std::stable_sort(
+        l_returnValue.fields.begin(), l_returnValue.fields.end(),
+        []( const FieldLayout* _left, const FieldLayout* _right ) -> bool {
+            if ( _left->alignment != _right->alignment ) {
+                return ( _left->alignment > _right->alignment );
+            }
+
+            return ( _left->size > _right->size );
+        } );
+
+    if ( l_flexibleArrayMember ) {
+        l_returnValue.fields.push_back( l_flexibleArrayMember );
+    }
+
+    // Lay fields out in suggested order
+    {
+        auto l_alignTo = []( const uint64_t _value,
+                             const uint64_t _alignment ) -> uint64_t {
+            return ( ( ( _value + _alignment - 1 ) / _alignment ) *
+                     _alignment );
+        };
+
+        uint64_t l_offset = 0;
+
+        for ( const FieldLayout* l_fieldLayout : l_returnValue.fields ) {
+            l_offset = ( l_alignTo( l_offset, l_fieldLayout->alignment ) +
+                         l_fieldLayout->size );
+        }
+
+        l_returnValue.size =
+            l_alignTo( l_offset, std::max< uint64_t >( _layout.alignment, 1 ) );
+    }
+
+    l_returnValue.isReorderable = true;
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
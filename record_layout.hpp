@@ -0,0 +1,67 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <llvm/ADT/DenseMap.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Per translation unit cache of resolved record layouts.
+// Every record is resolved through ASTContext::getASTRecordLayout once, field
+// offsets/ sizes and layout defects are then reused by every handler.
+class RecordLayoutCache {
+public:
+    static constexpr uint64_t g_cacheLineSize = 64;
+
+    struct FieldLayout {
+        const clang::FieldDecl* field = nullptr;
+        uint64_t offsetInBits = 0;
+        // Bytes, 0 if size is unknown (flexible array member)
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint64_t alignment = 0;
+        bool isBitField = false;
+        bool isCrossingCacheLine = false;
+    };
+
+    // Bytes
+    struct PaddingHole {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    struct RecordLayout {
+        const clang::RecordDecl* record = nullptr;
+        // Bytes
+        uint64_t size = 0;
+        uint64_t alignment = 0;
+        uint64_t paddingSize = 0;
+        // In field index order
+        std::vector< FieldLayout > fields;
+        // Includes tail padding
+        std::vector< PaddingHole > paddingHoles;
+    };
+
+    // Field order minimizing record size
+    struct SuggestedLayout {
+        bool isReorderable = false;
+        std::vector< const FieldLayout* > fields;
+        // Bytes
+        uint64_t size = 0;
+    };
+
+    // nullptr if record has no complete valid definition
+    auto get( clang::ASTContext& _context, const clang::RecordDecl* _record )
+        -> const RecordLayout*;
+
+    // Fields sorted by decreasing alignment, then size.
+    // Unions, packed records and records with bit-fields or unnamed fields are
+    // not reorderable.
+    static auto suggestLayout( const RecordLayout& _layout ) -> SuggestedLayout;
+
+private:
+    llvm::DenseMap< const clang::RecordDecl*, std::unique_ptr< RecordLayout > >
+        _layouts;
+};
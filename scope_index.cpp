@@ -0,0 +1,201 @@
+#include "scope_index.hpp"
+
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <llvm/ADT/StringSet.h>
+
+#include <algorithm>
+
+#include "log.hpp"
+#include "top_level_declarations.hpp"
+#include "trace.hpp"
+
+class ScopeIndexBuilder
+    : public clang::RecursiveASTVisitor< ScopeIndexBuilder > {
+public:
+    ScopeIndexBuilder( ScopeIndex& _index, clang::ASTContext& _context )
+        : _index( _index ), _context( _context ) {}
+
+    auto TraverseFunctionDecl( clang::FunctionDecl* _functionDeclaration )
+        -> bool {
+        if ( !_functionDeclaration->doesThisDeclarationHaveABody() ) {
+            return ( true );
+        }
+
+        const clang::FunctionDecl* l_previousFunction = _currentFunction;
+        const int l_previousScope = _currentScope;
+
+        _currentFunction = _functionDeclaration;
+        _currentScope = -1;
+
+        const bool l_returnValue =
+            RecursiveASTVisitor::TraverseFunctionDecl( _functionDeclaration );
+
+        _currentFunction = l_previousFunction;
+        _currentScope = l_previousScope;
+
+        return ( l_returnValue );
+    }
+
+    auto TraverseCompoundStmt( clang::CompoundStmt* _compoundStatement )
+        -> bool {
+        return ( traverseScope( [ & ] {
+            return ( RecursiveASTVisitor::TraverseCompoundStmt(
+                _compoundStatement ) );
+        } ) );
+    }
+
+    // Variables declared in for-init are only visible inside the loop
+    auto TraverseForStmt( clang::ForStmt* _forStatement ) -> bool {
+        return ( traverseScope( [ & ] {
+            return ( RecursiveASTVisitor::TraverseForStmt( _forStatement ) );
+        } ) );
+    }
+
+    auto VisitVarDecl( clang::VarDecl* _variableDeclaration ) -> bool {
+        if ( ( _currentScope >= 0 ) &&
+             ( _variableDeclaration->isLocalVarDecl() ) ) {
+            _index._scopes[ _currentScope ].variables.push_back(
+                _variableDeclaration );
+        }
+
+        return ( true );
+    }
+
+    auto VisitCallExpr( clang::CallExpr* _callingExpression ) -> bool {
+        if ( !_currentFunction ) {
+            return ( true );
+        }
+
+        const clang::FunctionDecl* l_callee =
+            _callingExpression->getDirectCallee();
+
+        if ( ( !l_callee ) || ( !l_callee->getIdentifier() ) ) {
+            return ( true );
+        }
+
+        const auto l_iterator =
+            _index._trackedCalls.find( l_callee->getName() );
+
+        if ( l_iterator == _index._trackedCalls.end() ) {
+            return ( true );
+        }
+
+        ScopeIndex::CallSite l_callSite;
+
+        l_callSite.function = _currentFunction;
+        l_callSite.scope = _currentScope;
+        l_callSite.visibleVariables =
+            ( ( _currentScope >= 0 )
+                  ? ( _index._scopes[ _currentScope ].variables.size() )
+                  : ( 0 ) );
+
+        l_iterator->second( _context, _callingExpression, l_callSite );
+
+        return ( true );
+    }
+
+private:
+    template < typename Traverser >
+    auto traverseScope( Traverser&& _traverser ) -> bool {
+        if ( !_currentFunction ) {
+            return ( std::forward< Traverser >( _traverser )() );
+        }
+
+        ScopeIndex::Scope l_scope;
+
+        l_scope.function = _currentFunction;
+        l_scope.parent = _currentScope;
+        l_scope.visibleInParent =
+            ( ( _currentScope >= 0 )
+                  ? ( _index._scopes[ _currentScope ].variables.size() )
+                  : ( 0 ) );
+
+        _index._scopes.emplace_back( std::move( l_scope ) );
+
+        const int l_previousScope = _currentScope;
+
+        _currentScope = static_cast< int >( _index._scopes.size() - 1 );
+
+        const bool l_returnValue = std::forward< Traverser >( _traverser )();
+
+        _currentScope = l_previousScope;
+
+        return ( l_returnValue );
+    }
+
+    ScopeIndex& _index;
+    clang::ASTContext& _context;
+    const clang::FunctionDecl* _currentFunction = nullptr;
+    int _currentScope = -1;
+};
+
+void ScopeIndex::trackCall( const clang::StringRef _calleeName,
+                            CallSiteHandler _handler ) {
+    traceEnter();
+
+    _trackedCalls[ _calleeName ] = std::move( _handler );
+
+    traceExit();
+}
+
+void ScopeIndex::dispatch( clang::ASTContext& _context ) {
+    traceEnter();
+
+    if ( ( _isBuilt ) || ( _trackedCalls.empty() ) ) {
+        goto EXIT;
+    }
+
+    _isBuilt = true;
+
+    {
+        ScopeIndexBuilder l_builder( *this, _context );
+
+        for ( clang::Decl* l_declaration :
+              getMainFileDeclarations( _context ) ) {
+            l_builder.TraverseDecl( l_declaration );
+        }
+
+        logVariable( _scopes.size() );
+    }
+
+EXIT:
+    traceExit();
+}
+
+auto ScopeIndex::getVisibleVariables( const CallSite& _callSite ) const
+    -> std::vector< const clang::VarDecl* > {
+    traceEnter();
+
+    std::vector< const clang::VarDecl* > l_returnValue;
+
+    llvm::StringSet<> l_seenNames;
+    int l_scopeIndex = _callSite.scope;
+    size_t l_visibleVariables = _callSite.visibleVariables;
+
+    // Innermost to outermost, so inner declarations shadow outer ones
+    while ( l_scopeIndex >= 0 ) {
+        const Scope& l_scope = _scopes[ l_scopeIndex ];
+
+        for ( size_t l_variableIndex = l_visibleVariables;
+              l_variableIndex > 0; --l_variableIndex ) {
+            const clang::VarDecl* l_variable =
+                l_scope.variables[ l_variableIndex - 1 ];
+
+            if ( ( !l_variable->getIdentifier() ) ||
+                 ( !l_seenNames.insert( l_variable->getName() ).second ) ) {
+                continue;
+            }
+
+            l_returnValue.push_back( l_variable );
+        }
+
+        l_visibleVariables = l_scope.visibleInParent;
+        l_scopeIndex = l_scope.parent;
+    }
+
+    std::reverse( l_returnValue.begin(), l_returnValue.end() );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
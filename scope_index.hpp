@@ -0,0 +1,61 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/AST/Expr.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+
+#include <functional>
+#include <vector>
+
+// Per translation unit index of lexical scopes (function bodies, compound and
+// for statements).
+// Built by a single traversal over main file declarations, which keeps
+// enclosing function/ scope on a stack and hands every tracked intrinsic call
+// directly to its handler, so no parent map is ever built or climbed.
+class ScopeIndex {
+public:
+    struct Scope {
+        const clang::FunctionDecl* function = nullptr;
+        // Index of enclosing scope, -1 for outermost scope of a function
+        int parent = -1;
+        // Amount of parent scope variables declared before this scope began
+        size_t visibleInParent = 0;
+        // Variables declared directly in this scope in declaration order
+        llvm::SmallVector< const clang::VarDecl*, 4 > variables;
+    };
+
+    struct CallSite {
+        const clang::FunctionDecl* function = nullptr;
+        // Innermost scope containing the call
+        int scope = -1;
+        // Amount of innermost scope variables declared before the call
+        size_t visibleVariables = 0;
+    };
+
+    using CallSiteHandler =
+        std::function< void( clang::ASTContext& _context,
+                             const clang::CallExpr* _callingExpression,
+                             const CallSite& _callSite ) >;
+
+    // Calls to tracked names are passed to handler during traversal
+    void trackCall( const clang::StringRef _calleeName,
+                    CallSiteHandler _handler );
+
+    // Build index and dispatch tracked calls, once per translation unit
+    void dispatch( clang::ASTContext& _context );
+
+    // Variables visible at call site, outermost scope first.
+    // Only valid for call sites already reached by traversal.
+    // Shadowed variables are omitted.
+    auto getVisibleVariables( const CallSite& _callSite ) const
+        -> std::vector< const clang::VarDecl* >;
+
+private:
+    friend class ScopeIndexBuilder;
+
+    bool _isBuilt = false;
+    llvm::StringMap< CallSiteHandler > _trackedCalls;
+    std::vector< Scope > _scopes;
+};
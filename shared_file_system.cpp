@@ -0,0 +1,24 @@
+#include "shared_file_system.hpp"
+
+#include <clang/Tooling/DependencyScanning/DependencyScanningFilesystem.h>
+
+#include "trace.hpp"
+
+namespace dependencies = clang::tooling::dependencies;
+
+auto createSharedFileSystem()
+    -> llvm::IntrusiveRefCntPtr< llvm::vfs::FileSystem > {
+    traceEnter();
+
+    // Of process
+    static dependencies::DependencyScanningFilesystemSharedCache l_cache;
+
+    llvm::IntrusiveRefCntPtr< llvm::vfs::FileSystem > l_returnValue =
+        llvm::makeIntrusiveRefCnt<
+            dependencies::DependencyScanningWorkerFilesystem >(
+            l_cache, llvm::vfs::getRealFileSystem() );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+// File system over real one caching stats (found and missing files) and
+// contents for whole run, in dependency scanning style: header lookups of
+// every translation unit after first, in -isystem directories of driver and
+// default includes too, do not touch disk.
+// Cache is shared and thread-safe, returned file system is for one thread.
+// Files are not expected to change while run reads them, so incremental
+// session does not use it.
+auto createSharedFileSystem()
+    -> llvm::IntrusiveRefCntPtr< llvm::vfs::FileSystem >;
@@ -0,0 +1,493 @@
+#include "statistics.hpp"
+
+#include <llvm/ADT/MapVector.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "allocation_profile.hpp"
+#include "arguments_parse.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+// In statistic order
+static constexpr const char* g_statisticNames[] = {
+    "iterate_struct_union_calls",
+    "iterate_enum_calls",
+    "iterate_arguments_calls",
+    "iterate_scope_calls",
+    "soa_records",
+    "serialized_records",
+    "field_calls",
+    "enumerator_calls",
+    "argument_calls",
+    "variable_calls",
+    "macro_call_sites",
+    "macro_call_sites_left",
+    "outlined_calls",
+    "expansion_cache_hits",
+    "expansion_cache_misses",
+    "reused_declarations",
+    "skipped_declarations",
+    "skipped_function_bodies",
+    "passed_through_inputs",
+    "bytes_replaced",
+    "bytes_inserted",
+    "bytes_written",
+};
+
+static_assert( ( sizeof( g_statisticNames ) / sizeof( *g_statisticNames ) ) ==
+                   static_cast< size_t >( statistic::count ),
+               "Every statistic needs name" );
+
+// In phase order
+static constexpr const char* g_phaseNames[] = {
+    "driver_probe", "parse", "match", "rewrite", "write",
+};
+
+static_assert( ( sizeof( g_phaseNames ) / sizeof( *g_phaseNames ) ) ==
+                   static_cast< size_t >( phase::count ),
+               "Every phase needs name" );
+
+struct PhaseSample {
+    std::chrono::steady_clock::duration time =
+        std::chrono::steady_clock::duration();
+    // Sums of counter differences, see --profile detailed
+    PerformanceCounters counters;
+    // Times phase was timed
+    size_t count = 0;
+};
+
+using PhaseSamples =
+    std::array< PhaseSample, static_cast< size_t >( phase::count ) >;
+
+static std::array< std::atomic< uint64_t >,
+                   static_cast< size_t >( statistic::count ) >
+    g_statistics;
+
+// Few updates per input, so lock is enough
+static std::mutex g_phaseSamplesMutex;
+// In order inputs were first timed
+static llvm::MapVector< std::string, PhaseSamples > g_phaseSamples;
+
+static auto isPhaseRecorded() -> bool {
+    traceEnter();
+
+    const bool l_returnValue = ( ( !g_statisticsFilePath.empty() ) ||
+                                 ( g_profileLevel != profileLevel::none ) );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+static void addPhaseSample( PhaseSample& _total, const PhaseSample& _sample ) {
+    traceEnter();
+
+    _total.time += _sample.time;
+    _total.count += _sample.count;
+
+    for ( size_t l_counterIndex = 0;
+          l_counterIndex < _total.counters.values.size(); l_counterIndex++ ) {
+        if ( _sample.counters.isAvailable[ l_counterIndex ] ) {
+            _total.counters.values[ l_counterIndex ] +=
+                _sample.counters.values[ l_counterIndex ];
+            _total.counters.isAvailable[ l_counterIndex ] = true;
+        }
+    }
+
+    traceExit();
+}
+
+void addStatistic( const statistic _statistic, const uint64_t _amount ) {
+    // Not traced, as it is counted on every callback call
+    g_statistics[ static_cast< size_t >( _statistic ) ].fetch_add(
+        _amount, std::memory_order_relaxed );
+}
+
+auto startPhase( const phase _phase ) -> PhaseStart {
+    traceEnter();
+
+    PhaseStart l_returnValue;
+
+    setAllocationPhase( _phase );
+
+    // Counters first, so reading them is not timed
+    if ( g_profileLevel == profileLevel::detailed ) {
+        l_returnValue.counters = readPerformanceCounters();
+    }
+
+    l_returnValue.time = std::chrono::steady_clock::now();
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void endPhase( const llvm::StringRef _filePath,
+               const phase _phase,
+               const PhaseStart& _start ) {
+    traceEnter();
+
+    setAllocationPhase( phase::count );
+
+    if ( !isPhaseRecorded() ) {
+        goto EXIT;
+    }
+
+    {
+        PhaseSample l_sample;
+
+        l_sample.time = ( std::chrono::steady_clock::now() - _start.time );
+        l_sample.count = 1;
+
+        if ( g_profileLevel == profileLevel::detailed ) {
+            const PerformanceCounters l_counters = readPerformanceCounters();
+
+            for ( size_t l_counterIndex = 0;
+                  l_counterIndex < l_counters.values.size();
+                  l_counterIndex++ ) {
+                if ( ( _start.counters.isAvailable[ l_counterIndex ] ) &&
+                     ( l_counters.isAvailable[ l_counterIndex ] ) ) {
+                    l_sample.counters.values[ l_counterIndex ] =
+                        ( l_counters.values[ l_counterIndex ] -
+                          _start.counters.values[ l_counterIndex ] );
+                    l_sample.counters.isAvailable[ l_counterIndex ] = true;
+                }
+            }
+        }
+
+        const std::lock_guard< std::mutex > l_phaseSamplesLock(
+            g_phaseSamplesMutex );
+
+        PhaseSamples& l_samples = g_phaseSamples[ _filePath.str() ];
+
+        addPhaseSample( l_samples[ static_cast< size_t >( _phase ) ],
+                        l_sample );
+    }
+
+EXIT:
+    traceExit();
+}
+
+auto getPhaseName( const phase _phase ) -> const char* {
+    traceEnter();
+
+    const char* l_returnValue = g_phaseNames[ static_cast< size_t >( _phase ) ];
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto writeStatistics() -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    if ( g_statisticsFilePath.empty() ) {
+        goto EXIT;
+    }
+
+    {
+        std::error_code l_errorCode;
+
+        // "-" is standard output
+        llvm::raw_fd_ostream l_statisticsFile(
+            g_statisticsFilePath, l_errorCode, llvm::sys::fs::OF_None );
+
+        if ( l_errorCode ) {
+            logError( l_errorCode.message() );
+
+            l_returnValue = false;
+
+            goto EXIT;
+        }
+
+        // {
+        //   "counters": { "name": value, ... },
+        //   "run": { "driver_probe_ms": 0.0 },
+        //   "files": [ { "path": "...", "parse_ms": 0.0, ... }, ... ]
+        // }
+        {
+            llvm::json::OStream l_json( l_statisticsFile, 2 );
+
+            l_json.object( [ & ] {
+                l_json.attributeObject( "counters", [ & ] {
+                    for ( size_t l_statisticIndex = 0;
+                          l_statisticIndex < g_statistics.size();
+                          l_statisticIndex++ ) {
+                        l_json.attribute(
+                            g_statisticNames[ l_statisticIndex ],
+                            static_cast< int64_t >(
+                                g_statistics[ l_statisticIndex ].load(
+                                    std::memory_order_relaxed ) ) );
+                    }
+                } );
+
+                const std::lock_guard< std::mutex > l_phaseSamplesLock(
+                    g_phaseSamplesMutex );
+
+                // "name_ms": 0.0, ...
+                auto l_writePhaseTimes = [ & ]( const PhaseSamples& _phases ) {
+                    for ( size_t l_phaseIndex = 0;
+                          l_phaseIndex < _phases.size(); l_phaseIndex++ ) {
+                        if ( !_phases[ l_phaseIndex ].count ) {
+                            continue;
+                        }
+
+                        l_json.attribute(
+                            ( std::string( g_phaseNames[ l_phaseIndex ] ) +
+                              "_ms" ),
+                            std::chrono::duration< double, std::milli >(
+                                _phases[ l_phaseIndex ].time )
+                                .count() );
+                    }
+                };
+
+                if ( g_phaseSamples.count( "" ) ) {
+                    l_json.attributeObject( "run", [ & ] {
+                        l_writePhaseTimes( g_phaseSamples[ "" ] );
+                    } );
+                }
+
+                l_json.attributeArray( "files", [ & ] {
+                    for ( const auto& [ l_filePath, l_samples ] :
+                          g_phaseSamples ) {
+                        if ( l_filePath.empty() ) {
+                            continue;
+                        }
+
+                        l_json.object( [ & ] {
+                            l_json.attribute( "path", l_filePath );
+
+                            l_writePhaseTimes( l_samples );
+                        } );
+                    }
+                } );
+            } );
+        }
+
+        l_statisticsFile << "\n";
+
+        l_statisticsFile.close();
+
+        if ( l_statisticsFile.has_error() ) {
+            logError( l_statisticsFile.error().message() );
+
+            l_statisticsFile.clear_error();
+
+            l_returnValue = false;
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+// PHASE TIME_MS [CYCLES INSTRUCTIONS IPC LLC_MISSES ...]
+static void writeProfileHeader( llvm::raw_ostream& _stream ) {
+    traceEnter();
+
+    _stream << llvm::formatv( "{0,-16}{1,12}", "PHASE", "TIME_MS" );
+
+    if ( g_profileLevel == profileLevel::detailed ) {
+        for ( size_t l_counterIndex = 0;
+              l_counterIndex <
+              static_cast< size_t >( performanceCounter::count );
+              l_counterIndex++ ) {
+            _stream << llvm::formatv(
+                "{0,18}",
+                llvm::StringRef( getPerformanceCounterName(
+                                     static_cast< performanceCounter >(
+                                         l_counterIndex ) ) )
+                    .upper() );
+
+            if ( static_cast< performanceCounter >( l_counterIndex ) ==
+                 performanceCounter::instructions ) {
+                _stream << llvm::formatv( "{0,8}", "IPC" );
+            }
+        }
+    }
+
+    _stream << "\n";
+
+    traceExit();
+}
+
+// Unavailable counters are "-"
+static void writeProfileRow( llvm::raw_ostream& _stream,
+                             const llvm::StringRef _name,
+                             const PhaseSample& _sample ) {
+    traceEnter();
+
+    _stream << llvm::formatv(
+        "{0,-16}{1,12:F2}", _name,
+        std::chrono::duration< double, std::milli >( _sample.time ).count() );
+
+    if ( g_profileLevel == profileLevel::detailed ) {
+        const PerformanceCounters& l_counters = _sample.counters;
+
+        for ( size_t l_counterIndex = 0;
+              l_counterIndex < l_counters.values.size(); l_counterIndex++ ) {
+            if ( l_counters.isAvailable[ l_counterIndex ] ) {
+                _stream << llvm::formatv(
+                    "{0,18}", l_counters.values[ l_counterIndex ] );
+
+            } else {
+                _stream << llvm::formatv( "{0,18}", "-" );
+            }
+
+            if ( static_cast< performanceCounter >( l_counterIndex ) !=
+                 performanceCounter::instructions ) {
+                continue;
+            }
+
+            // Instructions per cycle, low when waiting on memory
+            const size_t l_cyclesIndex =
+                static_cast< size_t >( performanceCounter::cycles );
+
+            if ( ( l_counters.isAvailable[ l_cyclesIndex ] ) &&
+                 ( l_counters.isAvailable[ l_counterIndex ] ) &&
+                 ( l_counters.values[ l_cyclesIndex ] ) ) {
+                _stream << llvm::formatv(
+                    "{0,8:F2}",
+                    ( static_cast< double >(
+                          l_counters.values[ l_counterIndex ] ) /
+                      static_cast< double >(
+                          l_counters.values[ l_cyclesIndex ] ) ) );
+
+            } else {
+                _stream << llvm::formatv( "{0,8}", "-" );
+            }
+        }
+    }
+
+    _stream << "\n";
+
+    traceExit();
+}
+
+// Timed phases and their total
+static void writeProfileTable( llvm::raw_ostream& _stream,
+                               const PhaseSamples& _samples ) {
+    traceEnter();
+
+    PhaseSample l_total;
+
+    writeProfileHeader( _stream );
+
+    for ( size_t l_phaseIndex = 0; l_phaseIndex < _samples.size();
+          l_phaseIndex++ ) {
+        if ( !_samples[ l_phaseIndex ].count ) {
+            continue;
+        }
+
+        writeProfileRow( _stream, g_phaseNames[ l_phaseIndex ],
+                         _samples[ l_phaseIndex ] );
+
+        addPhaseSample( l_total, _samples[ l_phaseIndex ] );
+    }
+
+    writeProfileRow( _stream, "total", l_total );
+
+    traceExit();
+}
+
+auto writeProfile() -> bool {
+    traceEnter();
+
+    bool l_returnValue = true;
+
+    if ( g_profileLevel == profileLevel::none ) {
+        goto EXIT;
+    }
+
+    {
+        std::unique_ptr< llvm::raw_fd_ostream > l_profileFile;
+
+        // "-" is standard output
+        if ( !g_profileFilePath.empty() ) {
+            std::error_code l_errorCode;
+
+            l_profileFile = std::make_unique< llvm::raw_fd_ostream >(
+                g_profileFilePath, l_errorCode, llvm::sys::fs::OF_None );
+
+            if ( l_errorCode ) {
+                logError( l_errorCode.message() );
+
+                l_returnValue = false;
+
+                goto EXIT;
+            }
+        }
+
+        // Standard error by default, as result may go to standard output
+        llvm::raw_ostream& l_profileStream =
+            ( ( l_profileFile ) ? ( *l_profileFile ) : ( llvm::errs() ) );
+
+        // Lines logged while processing come before profile
+        flushLog();
+
+        const std::lock_guard< std::mutex > l_phaseSamplesLock(
+            g_phaseSamplesMutex );
+
+        // Every input summed up
+        {
+            PhaseSamples l_totals;
+
+            for ( const auto& l_entry : g_phaseSamples ) {
+                for ( size_t l_phaseIndex = 0;
+                      l_phaseIndex < l_totals.size(); l_phaseIndex++ ) {
+                    addPhaseSample( l_totals[ l_phaseIndex ],
+                                    l_entry.second[ l_phaseIndex ] );
+                }
+            }
+
+            l_profileStream << "Profile of "
+                            << ( g_phaseSamples.size() -
+                                 g_phaseSamples.count( "" ) )
+                            << " input(s)\n";
+
+            writeProfileTable( l_profileStream, l_totals );
+        }
+
+        if ( g_profileLevel == profileLevel::detailed ) {
+            for ( const auto& [ l_filePath, l_samples ] : g_phaseSamples ) {
+                if ( l_filePath.empty() ) {
+                    continue;
+                }
+
+                l_profileStream << "\n" << l_filePath << "\n";
+
+                writeProfileTable( l_profileStream, l_samples );
+            }
+        }
+
+        writeAllocationProfile( l_profileStream );
+
+        l_profileStream.flush();
+
+        if ( ( l_profileFile ) && ( l_profileFile->has_error() ) ) {
+            logError( l_profileFile->error().message() );
+
+            l_profileFile->clear_error();
+
+            l_returnValue = false;
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+
+#include <chrono>
+#include <cstdint>
+
+#include "performance_counters.hpp"
+
+// Process wide counters of what run did, written as JSON by --stats.
+// Counters are lock-free, so handlers on --jobs workers count without
+// waiting.
+enum class statistic : uint8_t {
+    // Matched calls/ records per handler
+    iterateStructUnionCalls,
+    iterateEnumCalls,
+    iterateArgumentsCalls,
+    iterateScopeCalls,
+    soaRecords,
+    serializedRecords,
+    // Callback calls built, expansions from cache are not built again
+    fieldCalls,
+    enumeratorCalls,
+    argumentCalls,
+    variableCalls,
+    // Intrinsic calls written in macros rewritten through helpers/ left as
+    // is, once per call site (per expansion for iterate_arguments/
+    // iterate_scope)
+    macroCallSites,
+    macroCallSitesLeft,
+    // Calls sharing expansion function, see --outline
+    outlinedCalls,
+    expansionCacheHits,
+    expansionCacheMisses,
+    // Top level declarations incremental/ watch run did not run handlers for
+    // again, see DeclarationRegions
+    reusedDeclarations,
+    // Fields/ arguments/ variables/ records left out with warning/ error
+    skippedDeclarations,
+    // See --skip-function-bodies
+    skippedFunctionBodies,
+    // See --passthrough
+    passedThroughInputs,
+    // Source bytes replaced by expansions
+    bytesReplaced,
+    // Bytes of expansions and generated declarations
+    bytesInserted,
+    // Bytes of written generated files
+    bytesWritten,
+    count,
+};
+
+// Phases timed per input, see --stats and --profile
+enum class phase : uint8_t {
+    // Default system include paths, once per run, not per input
+    driverProbe,
+    // Preprocessing and parsing
+    parse,
+    // Handlers, from matching to expansions
+    match,
+    // Calls from macro expansions and outlined expansions
+    rewrite,
+    // Writing generated file and dependency files
+    write,
+    count,
+};
+
+// Clock and counters at start of phase
+struct PhaseStart {
+    std::chrono::steady_clock::time_point time;
+    // Read only for --profile detailed
+    PerformanceCounters counters;
+};
+
+void addStatistic( const statistic _statistic, const uint64_t _amount = 1 );
+
+// Allocations are counted to _phase until it ends, see allocation_profile
+auto startPhase( const phase _phase ) -> PhaseStart;
+
+// Time and counters since _start are added, phase can be timed more than once
+// per input (incremental session). Empty path is run itself.
+void endPhase( const llvm::StringRef _filePath,
+               const phase _phase,
+               const PhaseStart& _start );
+
+auto getPhaseName( const phase _phase ) -> const char*;
+
+// Does nothing unless requested by arguments
+auto writeStatistics() -> bool;
+
+// Does nothing unless requested by arguments
+auto writeProfile() -> bool;
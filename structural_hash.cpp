@@ -0,0 +1,221 @@
+#include "structural_hash.hpp"
+
+#include <clang/AST/RecordLayout.h>
+#include <llvm/ADT/APSInt.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/SHA1.h>
+
+#include <mutex>
+
+#include "log.hpp"
+#include "parallel_match.hpp"
+#include "trace.hpp"
+
+static llvm::DenseMap< const clang::ASTContext*,
+                       llvm::DenseMap< const clang::Decl*, std::string > >
+    g_structuralHashes;
+static std::mutex g_structuralHashesMutex;
+
+// Separated, so adjacent parts can not run into each other
+static void hashString( llvm::SHA1& _hash, const clang::StringRef _text ) {
+    traceEnter();
+
+    _hash.update( _text );
+    _hash.update( clang::StringRef( "\0", 1 ) );
+
+    traceExit();
+}
+
+static void hashNumber( llvm::SHA1& _hash, const uint64_t _number ) {
+    traceEnter();
+
+    hashString( _hash, std::to_string( _number ) );
+
+    traceExit();
+}
+
+static void hashRecord( llvm::SHA1& _hash,
+                        const clang::ASTContext& _context,
+                        const clang::RecordDecl* _record );
+
+static void hashType( llvm::SHA1& _hash,
+                      const clang::ASTContext& _context,
+                      const clang::QualType _type ) {
+    traceEnter();
+
+    // Written type is passed to callbacks as is
+    hashString( _hash, _type.getAsString() );
+    hashString( _hash, _type.getCanonicalType().getAsString() );
+
+    // Nested records and arrays of them are expanded by value, pointed ones
+    // are not, so there is no cycle
+    if ( const auto* l_recordType = _type->getBaseElementTypeUnsafe()
+                                        ->getAs< clang::RecordType >() ) {
+        hashRecord( _hash, _context, l_recordType->getDecl() );
+
+    } else if ( const auto* l_enumType =
+                    _type->getAs< clang::EnumType >() ) {
+        hashString( _hash,
+                    l_enumType->getDecl()->getIntegerType().getAsString() );
+    }
+
+    traceExit();
+}
+
+static void hashRecord( llvm::SHA1& _hash,
+                        const clang::ASTContext& _context,
+                        const clang::RecordDecl* _record ) {
+    traceEnter();
+
+    hashString( _hash, _record->getKindName() );
+
+    // typedef struct { ... } name;
+    if ( ( !_record->getIdentifier() ) &&
+         ( _record->getTypedefNameForAnonDecl() ) ) {
+        hashString( _hash,
+                    _record->getTypedefNameForAnonDecl()->getName() );
+
+    } else {
+        hashString( _hash, _record->getName() );
+    }
+
+    const clang::RecordDecl* l_definition = _record->getDefinition();
+
+    if ( ( !l_definition ) || ( l_definition->isInvalidDecl() ) ) {
+        hashString( _hash, "incomplete" );
+
+        goto EXIT;
+    }
+
+    {
+        // Covers packing/ alignment attributes and pragmas
+        const clang::ASTRecordLayout& l_layout =
+            _context.getASTRecordLayout( l_definition );
+
+        hashNumber( _hash, l_layout.getSize().getQuantity() );
+        hashNumber( _hash, l_layout.getAlignment().getQuantity() );
+
+        for ( const clang::FieldDecl* l_field : l_definition->fields() ) {
+            hashString( _hash, l_field->getName() );
+            hashType( _hash, _context, l_field->getType() );
+            hashNumber( _hash, ( ( l_field->isBitField() )
+                                     ? ( l_field->getBitWidthValue() )
+                                     : ( 0 ) ) );
+            hashNumber( _hash,
+                        l_layout.getFieldOffset( l_field->getFieldIndex() ) );
+        }
+    }
+
+EXIT:
+    traceExit();
+}
+
+static void hashDeclaration( llvm::SHA1& _hash,
+                             const clang::ASTContext& _context,
+                             const clang::Decl* _declaration ) {
+    traceEnter();
+
+    if ( const auto* l_record =
+             llvm::dyn_cast< clang::RecordDecl >( _declaration ) ) {
+        hashRecord( _hash, _context, l_record );
+
+    } else if ( const auto* l_enum =
+                    llvm::dyn_cast< clang::EnumDecl >( _declaration ) ) {
+        hashString( _hash, "enum" );
+        hashString( _hash, l_enum->getName() );
+        hashType( _hash, _context, l_enum->getIntegerType() );
+
+        for ( const clang::EnumConstantDecl* l_enumerator :
+              l_enum->enumerators() ) {
+            hashString( _hash, l_enumerator->getName() );
+            hashString( _hash, llvm::toString( l_enumerator->getInitVal(),
+                                               10 ) );
+        }
+
+    } else if ( const auto* l_function =
+                    llvm::dyn_cast< clang::FunctionDecl >( _declaration ) ) {
+        hashString( _hash, "function" );
+
+        for ( const clang::ParmVarDecl* l_parameter :
+              l_function->parameters() ) {
+            hashString( _hash, l_parameter->getName() );
+            hashType( _hash, _context, l_parameter->getType() );
+        }
+
+        hashNumber( _hash, l_function->isVariadic() );
+
+    } else if ( const auto* l_variable =
+                    llvm::dyn_cast< clang::VarDecl >( _declaration ) ) {
+        hashString( _hash, "variable" );
+        hashString( _hash, l_variable->getName() );
+        hashType( _hash, _context, l_variable->getType() );
+
+    } else {
+        logWarning( std::string( "No structural hash for declaration kind " ) +
+                    _declaration->getDeclKindName() );
+    }
+
+    traceExit();
+}
+
+auto buildStructuralHash( const clang::ASTContext& _context,
+                          const clang::Decl* _declaration ) -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    llvm::SHA1 l_hash;
+
+    if ( !_declaration ) {
+        goto EXIT;
+    }
+
+    {
+        const std::lock_guard l_lock( g_structuralHashesMutex );
+
+        const auto l_hashes = g_structuralHashes.find( &_context );
+
+        if ( l_hashes != g_structuralHashes.end() ) {
+            const auto l_iterator = l_hashes->second.find( _declaration );
+
+            if ( l_iterator != l_hashes->second.end() ) {
+                l_returnValue = l_iterator->second;
+
+                goto EXIT;
+            }
+        }
+    }
+
+    {
+        const auto l_handlerStateLock = lockHandlerState();
+
+        hashDeclaration( l_hash, _context, _declaration );
+    }
+
+    l_returnValue = llvm::toHex( l_hash.final(), true );
+
+    {
+        // Same hash if other thread built it meanwhile
+        const std::lock_guard l_lock( g_structuralHashesMutex );
+
+        g_structuralHashes[ &_context ][ _declaration ] = l_returnValue;
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void clearStructuralHashes( const clang::ASTContext& _context ) {
+    traceEnter();
+
+    {
+        const std::lock_guard l_lock( g_structuralHashesMutex );
+
+        g_structuralHashes.erase( &_context );
+    }
+
+    traceExit();
+}
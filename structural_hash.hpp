@@ -0,0 +1,21 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+
+#include <string>
+
+// Stable hash of what expansions read from declaration, independent of its
+// location, formatting and unrelated declarations around it:
+// record - kind, name, size/ alignment, fields (name, written and canonical
+//   type, bit-field width, offset), nested records recursively
+// enum - name, underlying type, enumerators
+// function - parameters (name, written and canonical type), variadic only
+// variable - name, written and canonical type
+// Built once per declaration of context.
+auto buildStructuralHash( const clang::ASTContext& _context,
+                          const clang::Decl* _declaration ) -> std::string;
+
+// Forget hashes of translation unit, before its handlers run and once it is
+// written
+void clearStructuralHashes( const clang::ASTContext& _context );
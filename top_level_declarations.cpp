@@ -0,0 +1,115 @@
+#include "top_level_declarations.hpp"
+
+#include <algorithm>
+
+#include "log.hpp"
+#include "parallel_match.hpp"
+#include "trace.hpp"
+
+auto getMainFileDeclarations( clang::ASTContext& _context )
+    -> std::vector< clang::Decl* > {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+
+    std::vector< clang::Decl* > l_returnValue = _context.getTraversalScope();
+
+    if ( ( l_returnValue.size() == 1 ) &&
+         ( llvm::isa< clang::TranslationUnitDecl >(
+             l_returnValue.front() ) ) ) {
+        const clang::TranslationUnitDecl* l_translationUnit =
+            _context.getTranslationUnitDecl();
+
+        l_returnValue.assign( l_translationUnit->decls_begin(),
+                              l_translationUnit->decls_end() );
+    }
+
+    // Only main file declarations can be rewritten
+    llvm::erase_if( l_returnValue, [ & ]( const clang::Decl* _declaration ) {
+        return ( !l_sourceManager.isInMainFile(
+            l_sourceManager.getExpansionLoc( _declaration->getLocation() ) ) );
+    } );
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+void TopLevelDeclarations::build( clang::ASTContext& _context ) {
+    traceEnter();
+
+    const clang::SourceManager& l_sourceManager = _context.getSourceManager();
+
+    _declarations.clear();
+
+    for ( const clang::Decl* l_declaration :
+          getMainFileDeclarations( _context ) ) {
+        const clang::SourceLocation l_beginLocation =
+            l_sourceManager.getExpansionLoc( l_declaration->getBeginLoc() );
+        const clang::SourceLocation l_endLocation =
+            l_sourceManager.getExpansionLoc( l_declaration->getEndLoc() );
+
+        if ( ( !l_sourceManager.isInMainFile( l_beginLocation ) ) ||
+             ( !l_sourceManager.isInMainFile( l_endLocation ) ) ) {
+            continue;
+        }
+
+        _declarations.push_back(
+            { l_declaration, l_sourceManager.getFileOffset( l_beginLocation ),
+              l_sourceManager.getFileOffset( l_endLocation ) } );
+    }
+
+    // Declarations expanded from macros may come out of order
+    std::stable_sort( _declarations.begin(), _declarations.end(),
+                      []( const Declaration& _left,
+                          const Declaration& _right ) {
+                          return ( _left.beginOffset < _right.beginOffset );
+                      } );
+
+    logVariable( _declarations.size() );
+
+    traceExit();
+}
+
+auto TopLevelDeclarations::find( const clang::SourceManager& _sourceManager,
+                                 const clang::Stmt* _statement ) const
+    -> const clang::Decl* {
+    traceEnter();
+
+    const clang::Decl* l_returnValue = nullptr;
+
+    clang::SourceLocation l_location;
+
+    {
+        // Expansion of macro location may load source location entry
+        const auto l_handlerStateLock = lockHandlerState();
+
+        l_location =
+            _sourceManager.getExpansionLoc( _statement->getBeginLoc() );
+    }
+
+    if ( !_sourceManager.isInMainFile( l_location ) ) {
+        goto EXIT;
+    }
+
+    {
+        const unsigned l_offset = _sourceManager.getFileOffset( l_location );
+
+        // After last declaration beginning at or before statement
+        const auto l_declaration = std::upper_bound(
+            _declarations.begin(), _declarations.end(), l_offset,
+            []( const unsigned _offset, const Declaration& _declaration ) {
+                return ( _offset < _declaration.beginOffset );
+            } );
+
+        if ( ( l_declaration != _declarations.begin() ) &&
+             ( std::prev( l_declaration )->endOffset >= l_offset ) ) {
+            l_returnValue = std::prev( l_declaration )->declaration;
+        }
+    }
+
+EXIT:
+    traceExit();
+
+    return ( l_returnValue );
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/AST/Stmt.h>
+
+#include <vector>
+
+// Main file declarations at file scope, in source order.
+// Traversal scope narrowed to main file declarations by incremental session is
+// kept, so declarations of precompiled preamble are not deserialized.
+auto getMainFileDeclarations( clang::ASTContext& _context )
+    -> std::vector< clang::Decl* >;
+
+// Per translation unit source ranges of main file declarations at file scope,
+// built before handlers run and only read by them.
+// Declaration enclosing statement is found by binary search, so no parent map
+// is built.
+class TopLevelDeclarations {
+public:
+    void build( clang::ASTContext& _context );
+
+    // Declaration at file scope statement belongs to, nullptr if none
+    auto find( const clang::SourceManager& _sourceManager,
+               const clang::Stmt* _statement ) const -> const clang::Decl*;
+
+private:
+    struct Declaration {
+        const clang::Decl* declaration = nullptr;
+        // Of expansion locations in main file
+        unsigned beginOffset = 0;
+        unsigned endOffset = 0;
+    };
+
+    // By begin offset
+    std::vector< Declaration > _declarations;
+};
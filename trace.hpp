@@ -3,29 +3,32 @@
 #include "arguments_parse.hpp"
 #include "log.hpp"
 
-#define TRACE_ENTER_MESSAGE "Entering "
-#define TRACE_EXIT_MESSAGE "Exiting "
+#define TRACE_ENTER_MESSAGE "Entering"
+#define TRACE_EXIT_MESSAGE "Exiting"
 
+// Function is taken from location, see writeLog
+#if ( LOG_LEVEL <= LOG_LEVEL_TRACE )
 // TODO: Implement arguments tracing
-#define traceEnter()                                     \
-    do {                                                 \
-        if ( g_needTrace ) {                             \
-            std::string l_message = TRACE_ENTER_MESSAGE; \
-            l_message.append( "\"" )                     \
-                .append( __PRETTY_FUNCTION__ )           \
-                .append( "\"" );                         \
-            log( l_message );                            \
-        }                                                \
+#define traceEnter()                                                        \
+    do {                                                                    \
+        if ( ( g_needTrace ) && ( g_isVerboseRun ) ) {                      \
+            writeLog( logLevel::trace, LOG_LOCATION, TRACE_ENTER_MESSAGE ); \
+        }                                                                   \
     } while ( 0 )
 
 // TODO: Implement return value tracking
-#define traceExit()                                     \
-    do {                                                \
-        if ( g_needTrace ) {                            \
-            std::string l_message = TRACE_EXIT_MESSAGE; \
-            l_message.append( "\"" )                    \
-                .append( __PRETTY_FUNCTION__ )          \
-                .append( "\"" );                        \
-            log( l_message );                           \
-        }                                               \
+#define traceExit()                                                        \
+    do {                                                                   \
+        if ( ( g_needTrace ) && ( g_isVerboseRun ) ) {                     \
+            writeLog( logLevel::trace, LOG_LOCATION, TRACE_EXIT_MESSAGE ); \
+        }                                                                  \
     } while ( 0 )
+#else
+#define traceEnter() \
+    do {             \
+    } while ( 0 )
+
+#define traceExit() \
+    do {            \
+    } while ( 0 )
+#endif
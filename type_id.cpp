@@ -0,0 +1,164 @@
+#include "type_id.hpp"
+
+#include "arguments_parse.hpp"
+#include "parallel_match.hpp"
+#include "trace.hpp"
+
+auto getTypeId( const clang::ASTContext& _context, clang::QualType _type )
+    -> TypeId {
+    traceEnter();
+
+    TypeId l_returnValue = TypeId::other;
+
+    _type = _type.getCanonicalType();
+
+    if ( const auto* l_enumType = _type->getAs< clang::EnumType >() ) {
+        if ( l_enumType->getDecl()->isComplete() ) {
+            _type = l_enumType->getDecl()->getIntegerType().getCanonicalType();
+        }
+    }
+
+    if ( _type->isBooleanType() ) {
+        l_returnValue = TypeId::boolean;
+
+    } else if ( ( _type->isSpecificBuiltinType(
+                    clang::BuiltinType::Char_S ) ) ||
+                ( _type->isSpecificBuiltinType(
+                    clang::BuiltinType::Char_U ) ) ) {
+        l_returnValue = TypeId::character;
+
+    } else if ( _type->isIntegerType() ) {
+        const bool l_isSigned = _type->isSignedIntegerType();
+
+        uint64_t l_typeSize = 0;
+
+        {
+            const auto l_handlerStateLock = lockHandlerState();
+
+            l_typeSize = _context.getTypeSize( _type );
+        }
+
+        switch ( l_typeSize ) {
+            case 8: {
+                l_returnValue = ( ( l_isSigned ) ? ( TypeId::int8 )
+                                                 : ( TypeId::uint8 ) );
+
+                break;
+            }
+
+            case 16: {
+                l_returnValue = ( ( l_isSigned ) ? ( TypeId::int16 )
+                                                 : ( TypeId::uint16 ) );
+
+                break;
+            }
+
+            case 32: {
+                l_returnValue = ( ( l_isSigned ) ? ( TypeId::int32 )
+                                                 : ( TypeId::uint32 ) );
+
+                break;
+            }
+
+            case 64: {
+                l_returnValue = ( ( l_isSigned ) ? ( TypeId::int64 )
+                                                 : ( TypeId::uint64 ) );
+
+                break;
+            }
+
+            default: {
+                break;
+            }
+        }
+
+    } else if ( _type->isSpecificBuiltinType( clang::BuiltinType::Float ) ) {
+        l_returnValue = TypeId::float32;
+
+    } else if ( _type->isSpecificBuiltinType( clang::BuiltinType::Double ) ) {
+        l_returnValue = TypeId::float64;
+
+    } else if ( _type->isSpecificBuiltinType(
+                    clang::BuiltinType::LongDouble ) ) {
+        l_returnValue = TypeId::longDouble;
+
+    } else if ( ( _type->isAnyPointerType() ) ||
+                ( _type->isBlockPointerType() ) ||
+                ( _type->isNullPtrType() ) ) {
+        l_returnValue = TypeId::pointer;
+
+    } else if ( const clang::ArrayType* l_arrayType =
+                    _type->getAsArrayTypeUnsafe() ) {
+        l_returnValue = ( ( l_arrayType->getElementType()->isCharType() )
+                              ? ( TypeId::string )
+                              : ( TypeId::array ) );
+
+    } else if ( _type->isRecordType() ) {
+        l_returnValue = TypeId::record;
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto getTypeIdName( TypeId _typeId ) -> const char* {
+    traceEnter();
+
+    static constexpr const char* l_typeIdNames[] = {
+        "other",   "bool",    "char",    "int8",   "uint8",
+        "int16",   "uint16",  "int32",   "uint32", "int64",
+        "uint64",  "float32", "float64", "long_double",
+        "pointer", "string",  "array",   "record",
+    };
+
+    static_assert( ( sizeof( l_typeIdNames ) / sizeof( *l_typeIdNames ) ) ==
+                       ( size_t )TypeId::count,
+                   "Type identifier without name" );
+
+    const char* l_returnValue = l_typeIdNames[ ( size_t )TypeId::other ];
+
+    if ( _typeId < TypeId::count ) {
+        l_returnValue = l_typeIdNames[ ( size_t )_typeId ];
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto buildTypedCallbackName( clang::StringRef _callbackName, TypeId _typeId )
+    -> std::string {
+    traceEnter();
+
+    std::string l_returnValue = _callbackName.str();
+
+    if ( g_typedCallbacks == typedCallbacks::suffix ) {
+        l_returnValue += "_";
+        l_returnValue += getTypeIdName( _typeId );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
+
+auto buildTypedCallbackTypeArgument( clang::StringRef _typeName,
+                                     TypeId _typeId ) -> std::string {
+    traceEnter();
+
+    std::string l_returnValue;
+
+    if ( g_typedCallbacks == typedCallbacks::typeId ) {
+        // typeId /* typeName */
+        l_returnValue = ( std::to_string( ( unsigned )_typeId ) + " /* " +
+                          _typeName.str() + " */" );
+
+    } else {
+        l_returnValue = ( "\"" + _typeName.str() + "\"" );
+    }
+
+    traceExit();
+
+    return ( l_returnValue );
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Type.h>
+
+#include <cstdint>
+#include <string>
+
+// Dense identifiers of field/ variable types, resolved at rewrite time.
+// Values are part of generated code, new identifiers go before count.
+enum class TypeId : uint8_t {
+    other = 0,
+    boolean,
+    character,
+    int8,
+    uint8,
+    int16,
+    uint16,
+    int32,
+    uint32,
+    int64,
+    uint64,
+    float32,
+    float64,
+    longDouble,
+    pointer,
+    // Character array
+    string,
+    array,
+    record,
+    count,
+};
+
+// Typedefs are resolved to canonical type, enums to their underlying integer
+// type
+auto getTypeId( const clang::ASTContext& _context, clang::QualType _type )
+    -> TypeId;
+
+// "int32", used as callback name suffix
+auto getTypeIdName( TypeId _typeId ) -> const char*;
+
+// callbackName or callbackName_typeIdName, depending on --typed-callbacks
+auto buildTypedCallbackName( clang::StringRef _callbackName, TypeId _typeId )
+    -> std::string;
+
+// "typeName" or typeId, depending on --typed-callbacks
+auto buildTypedCallbackTypeArgument( clang::StringRef _typeName,
+                                     TypeId _typeId ) -> std::string;